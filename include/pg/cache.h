@@ -0,0 +1,138 @@
+#ifndef PG_CACHE_H
+#define PG_CACHE_H
+
+#include "pg.h"
+#include "thread.h"
+
+/*!
+ @brief bytes of the fingerprint that a password is cached under
+*/
+#define PG_CACHE_KEY 32
+
+/*!
+ @brief room for a password in a slot, its null character included
+ @details a password is at most two digests of SHA-512 long, as hex.
+*/
+#define PG_CACHE_PASS 0x84
+
+#define PG_CACHE_NONE 0xFFFFFFFF
+
+/*!
+ @brief slot of the cache, one generated password
+*/
+typedef struct pg_cache_slot
+{
+    a_byte key[PG_CACHE_KEY];
+    a_u32 prev; /*!< slot used just after this one */
+    a_u32 next; /*!< slot used just before this one, or the next free slot */
+    a_u32 chain; /*!< next slot in the same bucket */
+    char pass[PG_CACHE_PASS];
+} pg_cache_slot;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief instance structure for cache of generated passwords
+ @details passwords are kept under a fingerprint of everything they were
+ generated from, so a lookup costs one hash in place of several HMACs. The
+ least recently used slot makes room for a new one. Slots are in pages that
+ are locked in memory and left out of core dumps, and they are zeroed when
+ they are evicted, dropped or cleared and before the pages are given back.
+ The cache takes a lock of its own, so threads may share it.
+*/
+typedef struct pg_cache
+{
+    pg_cache_slot *slot; /*!< locked in memory */
+    a_u32 *bucket; /*!< first slot of every bucket */
+    a_size size; /*!< bytes mapped for slot */
+    a_u32 num; /*!< number of slots */
+    a_u32 used; /*!< slots that were ever taken */
+    a_u32 mask; /*!< number of buckets - 1 */
+    a_u32 head; /*!< most recently used slot */
+    a_u32 tail; /*!< least recently used slot, the next to go */
+    a_u32 free; /*!< list of dropped slots */
+    pg_mutex lock;
+} pg_cache;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief fingerprint of everything that a password is generated from
+ @param[out] key fingerprint, PG_CACHE_KEY bytes
+ @param[in] view fields of the record
+ @param[in] code code that the password is generated with
+ @param[in] rule rules given to pg_init, or null
+ @param[in] version 1 for pg_gen1, 2 for pg_gen2
+*/
+PG_PUBLIC void pg_cache_key(a_byte *key, pg_view const *view, char const *code, char const *rule, unsigned int version);
+
+/*!
+ @brief create a cache
+ @param[out] ctx points to an instance of cache
+ @param[in] num number of slots
+ @return error code value
+  @retval 0 success
+  @retval 1 the slots could not be mapped or locked, the cache is not usable
+*/
+PG_PUBLIC int pg_cache_init(pg_cache *ctx, a_size num);
+
+/*!
+ @brief zero every slot and give the memory back
+ @param[in,out] ctx points to an instance of cache
+*/
+PG_PUBLIC void pg_cache_exit(pg_cache *ctx);
+
+/*!
+ @brief look a password up and mark it as the most recently used
+ @param[in,out] ctx points to an instance of cache
+ @param[in] key fingerprint from pg_cache_key
+ @param[out] out password, PG_CACHE_PASS bytes
+ @return error code value
+  @retval 0 found
+  @retval 1 missing
+*/
+PG_PUBLIC int pg_cache_get(pg_cache *ctx, a_byte const *key, char *out);
+
+/*!
+ @brief keep a password as the most recently used, evicting the least recently used one when full
+ @details a password too long for a slot is not kept.
+ @param[in,out] ctx points to an instance of cache
+ @param[in] key fingerprint from pg_cache_key
+ @param[in] pass password terminated with a null character
+*/
+PG_PUBLIC void pg_cache_put(pg_cache *ctx, a_byte const *key, char const *pass);
+
+/*!
+ @brief forget a password, such as one of a record that changed
+ @param[in,out] ctx points to an instance of cache
+ @param[in] key fingerprint from pg_cache_key
+*/
+PG_PUBLIC void pg_cache_drop(pg_cache *ctx, a_byte const *key);
+
+/*!
+ @brief forget every password, such as after the code or the rules changed
+ @param[in,out] ctx points to an instance of cache
+*/
+PG_PUBLIC void pg_cache_clear(pg_cache *ctx);
+
+/*!
+ @brief set memory to zero in a way that is not optimized out
+ @param[out] pdata memory to clear
+ @param[in] nbyte number of bytes
+*/
+PG_PUBLIC void pg_cache_wipe(void *pdata, a_size nbyte);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/cache.h */
@@ -0,0 +1,173 @@
+#ifndef PG_COW_H
+#define PG_COW_H
+
+#include "pg.h"
+#include "thread.h"
+#include "a/vec.h"
+
+/*!
+ @brief readers that may hold a snapshot at the same time, more of them wait
+*/
+#define PG_COW_READERS 64
+
+/*!
+ @brief nodes from the root to a leaf in the deepest tree there can be
+*/
+#define PG_COW_DEPTH 96
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief node of a copy-on-write tree, never changed once it is published
+ @details the record is a copy, its strings are borrowed from the tree that
+ it came from, whose pool only grows until the tree is destroyed.
+*/
+typedef struct pg_cow_node
+{
+    struct pg_cow_node *left;
+    struct pg_cow_node *right;
+    a_size count; /*!< records in the subtree */
+    a_u64 epoch; /*!< epoch that the node was made in */
+    a_u32 height; /*!< height of the subtree */
+    pg_item item;
+} pg_cow_node;
+
+/*!
+ @brief instance structure for copy-on-write tree of records
+ @details a change copies the path from the root to the record it touches and
+ publishes the new root, so a reader that took a snapshot keeps a tree that
+ never changes under it, without a lock. Every change starts an epoch, a reader
+ announces the epoch that it entered in, and nodes that a change replaced are
+ freed once every reader announces an epoch after that change. Writers are
+ serialized by a lock that readers never take. Only readers that overlap
+ changes need it, a pg_tree that stays unchanged while it is read is shared
+ as it is.
+*/
+typedef struct pg_cow
+{
+    pg_cow_node *root; /*!< the tree that readers see, loaded atomically */
+    a_u64 epoch; /*!< number of changes published + 1, pg_cow_sync counts as a change */
+    a_u64 reader[PG_COW_READERS]; /*!< epoch that every reader entered in, 0 when free */
+    a_vec retire; /*!< nodes that were replaced, in the order of their epochs */
+    pg_cow_node *spare; /*!< nodes set aside so that a change cannot fail halfway */
+    a_size nspare; /*!< number of nodes in spare */
+    pg_mutex lock; /*!< serializes writers */
+} pg_cow;
+
+/*!
+ @brief snapshot that a reader holds between pg_cow_enter and pg_cow_leave
+*/
+typedef struct pg_cow_snap
+{
+    pg_cow_node const *root;
+    a_u64 version; /*!< changes published before the snapshot, at least */
+    unsigned int slot;
+} pg_cow_snap;
+
+/*!
+ @brief iterator over a snapshot in order
+*/
+typedef struct pg_cow_iter
+{
+    pg_cow_node const *stack[PG_COW_DEPTH];
+    unsigned int depth;
+} pg_cow_iter;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+PG_PUBLIC void pg_cow_ctor(pg_cow *ctx);
+
+/*!
+ @brief free every node
+ @details no reader may hold a snapshot any more.
+*/
+PG_PUBLIC void pg_cow_dtor(pg_cow *ctx);
+
+/*!
+ @brief replace the records with those of a tree, copied in linear time
+ @param[in,out] ctx points to an instance of copy-on-write tree
+ @param[in] tree records to copy, whose strings must outlive the snapshots
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_cow_load(pg_cow *ctx, pg_tree const *tree);
+
+/*!
+ @brief add a record, or replace the one with the same text
+ @param[in,out] ctx points to an instance of copy-on-write tree
+ @param[in] item record to copy, whose strings must outlive the snapshots
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_cow_put(pg_cow *ctx, pg_item const *item);
+
+/*!
+ @brief remove the record of a text
+ @param[in,out] ctx points to an instance of copy-on-write tree
+ @param[in] text text of the record
+ @return error code value
+  @retval 0 success, even when there was no such record
+*/
+PG_PUBLIC int pg_cow_del(pg_cow *ctx, char const *text);
+
+/*!
+ @brief start an epoch and wait until every reader of an earlier epoch left
+ @details a writer calls it before it changes what readers could reach before,
+ such as the tree that was loaded.
+ @param[in,out] ctx points to an instance of copy-on-write tree
+*/
+PG_PUBLIC void pg_cow_sync(pg_cow *ctx);
+
+/*!
+ @brief number of changes published so far, pg_cow_sync counts as a change
+*/
+PG_PUBLIC a_u64 pg_cow_version(pg_cow *ctx);
+
+/*!
+ @brief take a snapshot, with one atomic load of the root
+ @param[in,out] ctx points to an instance of copy-on-write tree
+ @param[out] snap snapshot to read until pg_cow_leave
+*/
+PG_PUBLIC void pg_cow_enter(pg_cow *ctx, pg_cow_snap *snap);
+
+/*!
+ @brief give a snapshot back, its nodes may then be freed
+*/
+PG_PUBLIC void pg_cow_leave(pg_cow *ctx, pg_cow_snap const *snap);
+
+/*!
+ @brief find the record of a text in a snapshot
+ @return record, or null when missing
+*/
+PG_PUBLIC pg_item const *pg_cow_get(pg_cow_node const *root, char const *text);
+
+/*!
+ @brief find the record at a position in a snapshot
+ @return record, or null when index is past the end
+*/
+PG_PUBLIC pg_item const *pg_cow_at(pg_cow_node const *root, a_size index);
+
+PG_PUBLIC a_size pg_cow_count(pg_cow_node const *root);
+
+PG_PUBLIC void pg_cow_iter_init(pg_cow_iter *ctx, pg_cow_node const *root);
+
+/*!
+ @brief take the next record of a snapshot
+ @return record, or null after the last one
+*/
+PG_PUBLIC pg_item const *pg_cow_iter_next(pg_cow_iter *ctx);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/cow.h */
@@ -0,0 +1,88 @@
+#ifndef PG_FUZZY_H
+#define PG_FUZZY_H
+
+#include "pg.h"
+#include "a/vec.h"
+
+/*!
+ @brief instance structure for fuzzy search
+ @details records are numbered in the order of the tree they were taken
+ from, and every bigram of their texts, with ASCII letters folded to lower
+ case, lists the records that hold it. A query reads the lists of its own
+ bigrams to skip records that cannot be within the distance, the rest are
+ checked with the bit-parallel algorithm of Myers. The index is a snapshot,
+ it is built again after the tree changes.
+*/
+typedef struct pg_fuzzy
+{
+    pg_item **item; /*!< records in the order of the tree */
+    a_u32 *head; /*!< start of the list of every bigram, 0x10001 entries */
+    a_u32 *list; /*!< numbers of records, ascending in every list */
+    a_size count; /*!< number of records */
+} pg_fuzzy;
+
+/*!
+ @brief record found by fuzzy search
+*/
+typedef struct pg_fuzzy_hit
+{
+    pg_item *item;
+    a_size index; /*!< position of the record in the tree */
+    a_size dist; /*!< edit distance from the pattern to the closest substring */
+} pg_fuzzy_hit;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief build the index of a tree
+ @param[out] ctx points to an instance of fuzzy search
+ @param[in] tree records to index, they must outlive the index
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_fuzzy_init(pg_fuzzy *ctx, pg_tree const *tree);
+PG_PUBLIC void pg_fuzzy_exit(pg_fuzzy *ctx);
+
+/*!
+ @brief edit distance from a pattern to its closest substring of a text
+ @details ASCII letters match regardless of case. A pattern of up to 64
+ bytes takes one machine word per byte of the text.
+ @param[in] pattern string terminated with a null character
+ @param[in] text string terminated with a null character
+ @return number of insertions, deletions and substitutions
+*/
+PG_PUBLIC a_size pg_fuzzy_dist(char const *pattern, char const *text);
+
+/*!
+ @brief find the records within a distance of a pattern
+ @details without in, candidates come from the bigram index and the hits are
+ in the order of the tree. With in, only its records are checked and the hits
+ keep its order, such as to narrow the hits of a shorter pattern, since one
+ more byte never makes the distance smaller.
+ @param[in] ctx points to an instance of fuzzy search
+ @param[in] pattern string terminated with a null character
+ @param[in] k largest distance of a hit
+ @param[in] in hits to check again, or null for every record
+ @param[out] out vector of \ref pg_fuzzy_hit that the hits are appended to
+ @param[in] stop called every few thousand records, nonzero gives up, may be null
+ @param[in] arg argument of stop
+ @return error code value
+  @retval 0 success
+  @retval 1 stop gave up, out holds part of the hits
+*/
+PG_PUBLIC int pg_fuzzy_find(pg_fuzzy const *ctx, char const *pattern, a_size k, a_vec const *in, a_vec *out,
+                            int (*stop)(void *), void *arg);
+
+/*!
+ @brief sort hits by distance, then by their position in the tree
+ @param[in,out] hits vector of \ref pg_fuzzy_hit
+*/
+PG_PUBLIC void pg_fuzzy_rank(a_vec *hits);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/fuzzy.h */
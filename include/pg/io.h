@@ -0,0 +1,181 @@
+#ifndef PG_IO_H
+#define PG_IO_H
+
+#include "pg.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief instance structure for the contents of a file
+ @details a regular file is mapped, anything else (a pipe, a terminal) is
+ read to the end into memory from the allocator.
+*/
+typedef struct pg_io_map
+{
+    char *data; /*!< contents of the file, read-only when mapped */
+    a_size size; /*!< number of bytes in data */
+    int mapped; /*!< whether data is a mapping */
+} pg_io_map;
+
+/*!
+ @brief iterator over the lines of a buffer
+ @details lines end with a newline, a carriage return before it is dropped.
+ lines point into the buffer and are not terminated with a null character.
+*/
+typedef struct pg_io_line
+{
+    char const *ptr;
+    char const *end;
+} pg_io_line;
+
+/*!
+ @brief instance structure for buffered writer
+ @details the writer goes to a temporary file next to the target, which
+ replaces the target only after its contents reach the disk, so readers
+ see either the old or the new file. A symbolic link is followed to the
+ file that it leads to. A target that exists and is not a regular file,
+ such as /dev/stdout, is written directly. Small writes are gathered in a buffer, a large one goes out
+ together with the buffer in a single call.
+*/
+typedef struct pg_io_writer
+{
+    char *buf;
+    char *pack; /*!< room for a packed block, or null when the file is not packed */
+    a_size len; /*!< bytes waiting in buf */
+    a_size cap; /*!< size of buf */
+    a_str temp; /*!< name of the temporary file, empty when the target is written directly */
+    a_str name; /*!< name of the target, the file that a symbolic link leads to */
+    int fd;
+    int error; /*!< set once a write fails, the target is then kept */
+} pg_io_writer;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+PG_PUBLIC long pg_io_fsize(FILE *handle);
+PG_PUBLIC long pg_io_size(char const *fname);
+
+/*!
+ @brief read a stream to its end
+ @param[in] handle stream to read
+ @param[out] pdata contents, release it with a_die
+ @param[out] nbyte number of bytes read
+ @return 0 on success, -1 on failure
+*/
+PG_PUBLIC int pg_io_fread(FILE *handle, char **pdata, size_t *nbyte);
+
+/*!
+ @brief read a file to its end, a regular file is read through a mapping
+ @param[in] fname name of the file
+ @param[out] pdata contents, release it with a_die
+ @param[out] nbyte number of bytes read
+ @return 0 on success, -1 on failure
+*/
+PG_PUBLIC int pg_io_read(char const *fname, char **pdata, size_t *nbyte);
+
+PG_PUBLIC int pg_io_fwrite(FILE *handle, void const *pdata, size_t nbyte);
+
+/*!
+ @brief replace a file atomically with data
+ @param[in] fname name of the file
+ @param[in] pdata data to write
+ @param[in] nbyte number of bytes to write
+ @return 0 on success, -1 on failure
+*/
+PG_PUBLIC int pg_io_write(char const *fname, void const *pdata, size_t nbyte);
+
+/*!
+ @brief map or read the contents of a file
+ @param[out] ctx points to an instance of file contents
+ @param[in] fname name of the file
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_map_open(pg_io_map *ctx, char const *fname);
+PG_PUBLIC void pg_io_map_close(pg_io_map *ctx);
+
+PG_PUBLIC void pg_io_line_init(pg_io_line *ctx, void const *pdata, a_size nbyte);
+
+/*!
+ @brief take the next line
+ @param[in,out] ctx points to an instance of line iterator
+ @param[out] nbyte length of the line without its newline
+ @return first byte of the line, or 0 when the buffer is used up
+*/
+PG_PUBLIC char const *pg_io_line_next(pg_io_line *ctx, a_size *nbyte);
+
+/*!
+ @brief read the first line of a file that is not empty
+ @param[in] fname name of the file, such as one given to PG_RULE or PG_CODE
+ @param[out] out string that the line is appended to
+ @return error code value
+  @retval 0 success, even when every line is empty
+*/
+PG_PUBLIC int pg_io_getline(char const *fname, a_str *out);
+
+/*!
+ @brief start to replace a file
+ @param[out] ctx points to an instance of buffered writer
+ @param[in] fname name of the file
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_writer_open(pg_io_writer *ctx, char const *fname);
+
+/*!
+ @brief pack what is written from now on into blocks, see \ref PG_LZ_VERSION
+ @details every full buffer becomes one block, the end follows on close.
+ A packed file cannot be overwritten with pg_io_writer_at.
+ @param[in,out] ctx points to an instance of buffered writer, just opened
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_writer_pack(pg_io_writer *ctx);
+
+/*!
+ @brief append data to the file
+ @param[in,out] ctx points to an instance of buffered writer
+ @param[in] pdata data to write
+ @param[in] nbyte number of bytes to write
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_writer_put(pg_io_writer *ctx, void const *pdata, a_size nbyte);
+
+/*!
+ @brief overwrite data that was written before, such as a header
+ @param[in,out] ctx points to an instance of buffered writer
+ @param[in] offset position of the data in the file
+ @param[in] pdata data to write
+ @param[in] nbyte number of bytes to write
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_writer_at(pg_io_writer *ctx, a_u64 offset, void const *pdata, a_size nbyte);
+
+/*!
+ @brief finish the file
+ @details on success the data is flushed to the disk and the temporary file
+ is renamed over the target, otherwise the temporary file is removed.
+ @param[in,out] ctx points to an instance of buffered writer
+ @param[in] commit 0 to abandon the file
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_io_writer_close(pg_io_writer *ctx, int commit);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/io.h */
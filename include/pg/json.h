@@ -25,6 +25,46 @@ PG_PUBLIC int pg_json_dump(cJSON *json, char const *fname);
 PG_PUBLIC int pg_json_export(cJSON const *json, pg_tree *tree);
 PG_PUBLIC int pg_json_import(cJSON *json, pg_tree const *tree);
 
+/*!
+ @brief stream records of a JSON file into a tree without building a DOM
+ @details a packed file, see \ref PG_LZ_VERSION, is unpacked first.
+ @param[in] fname name of a file that holds [{text,hash,size,type,misc,hint,time}]
+ @param[in,out] tree records are added to this tree
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_json_read(char const *fname, pg_tree *tree);
+
+/*!
+ @brief stream records of a tree into a JSON file through a fixed buffer
+ @details a large tree is cut into batches that a thread per processor prints
+ while the calling thread writes them in order, at most a few batches per
+ thread are held at once. A name that ends with .pgz gives a packed file.
+ @param[in] fname name of the file to write
+ @param[in] tree records to write in order
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_json_write(char const *fname, pg_tree const *tree);
+
+/*!
+ @brief append a string quoted and escaped the way cJSON prints it
+ @param[in,out] out string to append to
+ @param[in] str string terminated with a null character
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_json_quote(a_str *out, char const *str);
+
+/*!
+ @brief append a record as one JSON object {text,hash,size,type,misc,hint,time}
+ @param[in,out] out string to append to
+ @param[in] item record to print
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_json_item(a_str *out, pg_item const *item);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* __cplusplus */
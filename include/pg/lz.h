@@ -0,0 +1,82 @@
+#ifndef PG_LZ_H
+#define PG_LZ_H
+
+#include "pg.h"
+
+/*!
+ @brief version of the packed file format
+ @details a packed file is laid out as follows, every integer is little-endian:
+ - header, 8 bytes: "PGZ\0", version.
+ - blocks, each one a header of 8 bytes: size of the data, size of the block,
+   followed by the block. A block as large as its data is stored as it is.
+ - end, 8 bytes of zero.
+
+ Blocks refer only to themselves, so they are packed and unpacked apart.
+ A block is a run of sequences, each one a token, literals and a match:
+ - token, 1 byte: number of literals << 4 | length of the match - 4,
+   a field of 15 goes on in bytes that are added up until one is below 255.
+ - literals, copied as they are.
+ - offset of the match, 2 bytes, from 1 to 65535 bytes back.
+ The last sequence is literals only, the block ends right after them.
+*/
+#define PG_LZ_VERSION 1
+
+/*!
+ @brief largest data in a block that a reader accepts
+*/
+#define PG_LZ_BLOCK 0x100000
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief largest block that data of a size can be packed into
+ @param[in] nbyte size of the data
+ @return size of the block in the worst case
+*/
+PG_PUBLIC a_size pg_lz_bound(a_size nbyte);
+
+/*!
+ @brief pack data into one block
+ @param[in] pdata data to pack
+ @param[in] nbyte size of the data
+ @param[out] out block, at least cap bytes
+ @param[in] cap room in out, pg_lz_bound is always enough
+ @return size of the block, or 0 when it does not fit in cap
+*/
+PG_PUBLIC a_size pg_lz_pack(void const *pdata, a_size nbyte, void *out, a_size cap);
+
+/*!
+ @brief unpack one block
+ @param[in] pdata block to unpack
+ @param[in] nbyte size of the block
+ @param[out] out data, at least cap bytes
+ @param[in] cap room in out
+ @return size of the data, or ~0 when the block is broken or does not fit in cap
+*/
+PG_PUBLIC a_size pg_lz_unpack(void const *pdata, a_size nbyte, void *out, a_size cap);
+
+/*!
+ @brief check whether contents start like a packed file
+ @param[in] pdata contents of a file
+ @param[in] nbyte number of bytes in pdata
+ @return nonzero when the contents are packed
+*/
+PG_PUBLIC int pg_lz_is(void const *pdata, a_size nbyte);
+
+/*!
+ @brief replace packed contents of a file with the data they hold
+ @details blocks are unpacked by a thread per processor into memory from the
+ allocator. Contents that are not packed are kept as they are.
+ @param[in,out] ctx points to contents of a file, opened with pg_io_map_open
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_lz_map(pg_io_map *ctx);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/lz.h */
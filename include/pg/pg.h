@@ -2,6 +2,7 @@
 #define PG_PG_H
 
 #include "a/avl.h"
+#include "a/rbt.h"
 #include "a/str.h"
 
 #define PG_PUBLIC A_PUBLIC
@@ -14,6 +15,20 @@ typedef enum pg_type
     PG_TYPE_TOTAL,
 } pg_type;
 
+typedef enum pg_hash
+{
+    PG_HASH_MD5,
+    PG_HASH_SHA1,
+    PG_HASH_SHA224,
+    PG_HASH_SHA256,
+    PG_HASH_SHA384,
+    PG_HASH_SHA512,
+    PG_HASH_SHA3,
+    PG_HASH_BLAKE2S,
+    PG_HASH_BLAKE2B,
+    PG_HASH_TOTAL,
+} pg_hash;
+
 typedef struct pg_view
 {
     char const *text;
@@ -24,24 +39,103 @@ typedef struct pg_view
     unsigned int size;
 } pg_view;
 
+/*!
+ @brief instance structure for bump allocator
+ @details memory is carved out of large chunks and only given back all at once.
+*/
+typedef struct pg_pool
+{
+    void *head; /*!< list of chunks, newest first */
+    char *ptr; /*!< next free byte of the newest chunk */
+    char *end; /*!< end of the newest chunk */
+    a_size mem; /*!< preferred size of a chunk */
+    a_size size; /*!< bytes of every chunk */
+} pg_pool;
+
+/*!
+ @brief instance structure for record
+ @details fits in 64 bytes on 64-bit targets, the hash algorithm is stored as
+ a \ref pg_hash and translated to its name by pg_item_view.
+ @note strings are borrowed from the pool of the tree that owns the record.
+*/
 typedef struct pg_item
 {
     a_avl_node node;
-    a_str *text;
-    a_str *hash;
-    a_str *hint;
-    a_str *misc;
-    a_uint type;
-    a_uint size;
+    char const *text;
+    char const *hint;
+    char const *misc;
+    a_u32 ltext; /*!< length of text */
+    unsigned int type : 8; /*!< \ref pg_type */
+    unsigned int hash : 8; /*!< \ref pg_hash */
+    unsigned int size : 16; /*!< length of password */
     a_i64 time;
 } pg_item;
 
+/*!
+ @brief slot of the hash index of a record tree
+ @details the hash and the length of the text are kept next to the record,
+ so a probe reads the text of a record only when both of them match.
+*/
+typedef struct pg_slot
+{
+    pg_item *item; /*!< record, null for an empty slot */
+    a_u32 hash; /*!< hash of the text from pg_tree_hash */
+    a_u32 ltext; /*!< length of the text */
+} pg_slot;
+
+/*!
+ @brief entry of the time index of a record tree
+*/
+typedef struct pg_mark
+{
+    a_rbt_node node;
+    pg_item *item;
+} pg_mark;
+
+/*!
+ @brief instance structure for time index
+ @details records ordered by time and then by text, the entries live in a
+ pool of their own and deleted ones are reused.
+*/
+typedef struct pg_when
+{
+    a_rbt root;
+    pg_mark *spare; /*!< entries of deleted records */
+    pg_pool pool; /*!< entries */
+} pg_when;
+
+/*!
+ @brief instance structure for record tree
+ @details records and their strings live in two pools owned by the tree.
+ An open-addressing index by text sits beside the tree, so lookups by text
+ take one probe sequence while ordered traversal walks the tree. The index
+ is at most half full, it is turned off when it cannot grow and comes back
+ with the next merge.
+*/
 typedef struct pg_tree
 {
     a_avl root;
     a_size count;
+    pg_item *spare; /*!< slots of deleted records */
+    pg_pool node; /*!< slots for records */
+    pg_pool data; /*!< bytes for strings */
+    pg_slot *slot; /*!< hash index of texts, null when it is off */
+    a_size mask; /*!< number of slots minus one */
+    pg_when *when; /*!< index by time, null unless pg_tree_when turned it on */
 } pg_tree;
 
+/*!
+ @brief range of a record tree in order, from head up to but not including tail
+ @details ranges from pg_tree_split do not overlap and cover the tree in
+ order, so threads may walk them at once while nobody changes the tree.
+*/
+typedef struct pg_span
+{
+    a_avl_node *head; /*!< first node */
+    a_avl_node *tail; /*!< node after the last one, null at the end of the tree */
+    a_size count; /*!< records in the range, estimated from the heights of its subtrees */
+} pg_span;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif /* __cplusplus */
@@ -60,7 +154,7 @@ PG_PUBLIC int pg_xdigit(int x);
  @param[in] nbyte length of data to convert.
  @param[in,out] out points to buffer that holds the string.
  @return a pointer to the string.
- @note When out is 0, you need to use free to release the memory.
+ @note When out is 0, you need to use a_die to release the memory.
 */
 PG_PUBLIC void *pg_lower(void const *pdata, size_t nbyte, void *out);
 
@@ -70,7 +164,7 @@ PG_PUBLIC void *pg_lower(void const *pdata, size_t nbyte, void *out);
  @param[in] nbyte length of data to convert.
  @param[in,out] out points to buffer that holds the string.
  @return a pointer to the string.
- @note When out is 0, you need to use free to release the memory.
+ @note When out is 0, you need to use a_die to release the memory.
 */
 PG_PUBLIC void *pg_upper(void const *pdata, size_t nbyte, void *out);
 
@@ -83,66 +177,235 @@ PG_PUBLIC void *pg_upper(void const *pdata, size_t nbyte, void *out);
   @arg 1 upper
  @param[in,out] out points to buffer that holds the string.
  @return a pointer to the string.
- @note When out is 0, you need to use free to release the memory.
+ @note When out is 0, you need to use a_die to release the memory.
 */
 PG_PUBLIC void *pg_digest(void const *pdata, size_t nbyte, unsigned int cases, void *out);
 PG_PUBLIC void *pg_digest_lower(void const *pdata, size_t nbyte, void *out);
 PG_PUBLIC void *pg_digest_upper(void const *pdata, size_t nbyte, void *out);
 
+/*!
+ @brief look up a hash algorithm by name.
+ @param[in] name "MD5", "SHA256", ... in upper or lower case.
+ @return \ref pg_hash, PG_HASH_MD5 for an unknown name.
+*/
+PG_PUBLIC unsigned int pg_hash_id(char const *name);
+
+/*!
+ @brief name of a hash algorithm.
+ @param[in] id \ref pg_hash
+ @return the upper case name, "MD5" for an unknown id.
+*/
+PG_PUBLIC char const *pg_hash_name(unsigned int id);
+
 PG_PUBLIC int pg_init(char *s, char const *sep);
+
+/*!
+ @brief generate the password of a record
+ @param[in] ctx record to generate for
+ @param[in] code main password
+ @param[out] out generated password, release it with a_die
+ @return 0 on success, negative when text, code, misc or size is missing
+*/
 PG_PUBLIC int pg_gen1(pg_view const *ctx, char const *code, char **out);
 PG_PUBLIC int pg_gen2(pg_view const *ctx, char const *code, char **out);
 
-PG_PUBLIC pg_item *pg_item_new(void);
-PG_PUBLIC void pg_item_die(pg_item *ctx);
 PG_PUBLIC void pg_item_ctor(pg_item *ctx);
-PG_PUBLIC void pg_item_dtor(pg_item *ctx);
 PG_PUBLIC void pg_view_ctor(pg_view *ctx);
 PG_PUBLIC void pg_item_view(pg_item const *ctx, pg_view *out);
 PG_PUBLIC void pg_item_set_type(pg_item *ctx, unsigned int type);
 PG_PUBLIC void pg_item_set_size(pg_item *ctx, unsigned int size);
-PG_PUBLIC int pg_item_set_text(pg_item *ctx, void const *text);
-PG_PUBLIC int pg_item_set_hash(pg_item *ctx, void const *hash);
-PG_PUBLIC int pg_item_set_hint(pg_item *ctx, void const *hint);
-PG_PUBLIC int pg_item_set_misc(pg_item *ctx, void const *misc);
-PG_PUBLIC int pg_item_set_text2(pg_item *ctx, a_str const *text);
-PG_PUBLIC int pg_item_set_hash2(pg_item *ctx, a_str const *hash);
-PG_PUBLIC int pg_item_set_hint2(pg_item *ctx, a_str const *hint);
-PG_PUBLIC int pg_item_set_misc2(pg_item *ctx, a_str const *misc);
+
+/*!
+ @brief constructor for bump allocator
+ @param[in] ctx points to an instance of bump allocator
+ @param[in] mem preferred size of a chunk, 0 selects the default
+*/
+PG_PUBLIC void pg_pool_ctor(pg_pool *ctx, a_size mem);
+
+/*!
+ @brief destructor for bump allocator, releases every chunk at once
+ @param[in] ctx points to an instance of bump allocator
+*/
+PG_PUBLIC void pg_pool_dtor(pg_pool *ctx);
+
+/*!
+ @brief move every chunk of a bump allocator into another one
+ @param[in] ctx points to an instance of bump allocator
+ @param[in] src bump allocator that is left empty
+*/
+PG_PUBLIC void pg_pool_merge(pg_pool *ctx, pg_pool *src);
+
+/*!
+ @brief allocate a block aligned for any record from bump allocator
+ @param[in] ctx points to an instance of bump allocator
+ @param[in] size size of the block
+ @return a pointer to the block
+  @retval 0 out of memory
+*/
+PG_PUBLIC void *pg_pool_alloc(pg_pool *ctx, a_size size);
+
+/*!
+ @brief copy a string into bump allocator
+ @param[in] ctx points to an instance of bump allocator
+ @param[in] pdata points to data to copy
+ @param[in] nbyte length of data to copy
+ @return a pointer to the copy terminated with a null character
+  @retval 0 out of memory
+*/
+PG_PUBLIC char *pg_pool_strn(pg_pool *ctx, void const *pdata, a_size nbyte);
+PG_PUBLIC char *pg_pool_str(pg_pool *ctx, void const *str);
+
+/*!
+ @brief hash a text for the index of a record tree
+ @param[in] text string terminated with a null character
+ @param[out] ltext length of text, may be null
+ @return 32-bit FNV-1a hash of text
+*/
+PG_PUBLIC a_u32 pg_tree_hash(void const *text, a_size *ltext);
 
 PG_PUBLIC void pg_tree_ctor(pg_tree *ctx);
 PG_PUBLIC void pg_tree_dtor(pg_tree *ctx);
 PG_PUBLIC void pg_tree_insert(pg_tree *ctx, pg_item *item);
 PG_PUBLIC void pg_tree_remove(pg_tree *ctx, pg_item *item);
 
+/*!
+ @brief find the record for text, or create it when missing
+ @param[in] ctx points to an instance of record tree
+ @param[in] text string terminated with a null character
+ @return a pointer to the record
+  @retval 0 out of memory
+*/
 PG_PUBLIC pg_item *pg_tree_add(pg_tree *ctx, void const *text);
+
+/*!
+ @brief append a record whose text sorts after every record of the tree
+ @details input that is already sorted is linked at the tail with one
+ comparison, anything else falls back to pg_tree_add.
+ @param[in] ctx points to an instance of record tree
+ @param[in] text string terminated with a null character
+ @param[in] ltext length of text
+ @return a pointer to the record
+  @retval 0 out of memory
+*/
+PG_PUBLIC pg_item *pg_tree_push(pg_tree *ctx, void const *text, a_size ltext);
+
+/*!
+ @brief find the record for text
+ @param[in] ctx points to an instance of record tree
+ @param[in] text string terminated with a null character
+ @return a pointer to the record
+  @retval 0 not found
+*/
+PG_PUBLIC pg_item *pg_tree_get(pg_tree const *ctx, void const *text);
+
+/*!
+ @brief unlink the record for text
+ @param[in] ctx points to an instance of record tree
+ @param[in] text string terminated with a null character
+ @return a pointer to the record, valid until it is given to pg_tree_free
+  @retval 0 not found
+*/
 PG_PUBLIC pg_item *pg_tree_del(pg_tree *ctx, void const *text);
 
-#define pg_tree_foreach(cur, ctx) a_avl_foreach(cur, &(ctx)->root)
-#define pg_tree_entry(cur) a_avl_entry(cur, pg_item, node)
+/*!
+ @brief recycle the slot of a record that was unlinked from the tree
+ @param[in] ctx points to an instance of record tree
+ @param[in] item record returned by pg_tree_del or given to pg_tree_remove
+*/
+PG_PUBLIC void pg_tree_free(pg_tree *ctx, pg_item *item);
 
-#if defined(__cplusplus)
-} /* extern "C" */
-#endif /* __cplusplus */
+/*!
+ @brief merge every record of another tree in one linear pass
+ @details a record with the same text in both trees takes the fields of
+ src unless the record of ctx is newer. The merged tree is rebuilt balanced
+ and takes over the slots and strings of src without copying them.
+ @param[in] ctx points to an instance of record tree
+ @param[in] src record tree that is left empty
+*/
+PG_PUBLIC void pg_tree_merge(pg_tree *ctx, pg_tree *src);
 
-#include <stdlib.h>
-#include <stdio.h>
+/*!
+ @brief merge every record of several trees in one pass over their heads
+ @details the heads of the trees are kept in a heap, so the merge takes
+ O(n log num) comparisons. A text found in more than one tree keeps the
+ newest record, the one of the later tree if they are as new, as if the trees
+ were merged one by one. Like pg_tree_merge, the slots and strings are taken over.
+ @param[in] ctx points to an instance of record tree
+ @param[in] src array of record trees that are left empty
+ @param[in] num number of trees in src
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_tree_merge_n(pg_tree *ctx, pg_tree *src, a_size num);
 
-#if defined(__cplusplus)
-extern "C" {
-#endif /* __cplusplus */
+/*!
+ @brief turn on the index by time
+ @details the index is kept in sync by every change to the tree from then
+ on, so the time of a record must be changed with pg_tree_time. It is turned
+ off again when it runs out of memory.
+ @param[in] ctx points to an instance of record tree
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_tree_when(pg_tree *ctx);
+
+/*!
+ @brief change the time of a record and move it in the index by time
+ @param[in] ctx points to an instance of record tree
+ @param[in] item record owned by the tree
+ @param[in] time new time of the record
+*/
+PG_PUBLIC void pg_tree_time(pg_tree *ctx, pg_item *item, a_i64 time);
+
+/*!
+ @brief copy hash, hint, misc, type and size of a view into a record
+ @param[in] ctx points to an instance of record tree
+ @param[in] item record owned by the tree
+ @param[in] view source of the fields, text is ignored
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_tree_set(pg_tree *ctx, pg_item *item, pg_view const *view);
+
+/*!
+ @brief copy the strings of every record into a fresh pool and release the old one
+ @details strings of deleted and changed records are never given back by the
+ pool, a tree that lives long packs them away. Records keep their addresses.
+ @param[in] ctx points to an instance of record tree
+ @return error code value
+  @retval 0 success
+  @retval 2 out of memory, the tree is left as it was
+*/
+PG_PUBLIC int pg_tree_pack(pg_tree *ctx);
 
-PG_PUBLIC long pg_io_fsize(FILE *handle);
-PG_PUBLIC long pg_io_size(char const *fname);
+/*!
+ @brief split a record tree into ranges of about the same size, in order
+ @details the tree is cut along subtrees a few levels below the root, whose
+ sizes are estimated from their heights, so nothing is counted or copied.
+ The estimates are rough, so the sizes of the ranges are uneven at times.
+ @param[in] ctx points to an instance of record tree
+ @param[out] span ranges, num of them at most
+ @param[in] num largest number of ranges
+ @return number of ranges, 0 for an empty tree
+*/
+PG_PUBLIC a_size pg_tree_split(pg_tree const *ctx, pg_span *span, a_size num);
 
-PG_PUBLIC int pg_io_fread(FILE *handle, char **pdata, size_t *nbyte);
-PG_PUBLIC int pg_io_read(char const *fname, char **pdata, size_t *nbyte);
+#define pg_tree_foreach(cur, ctx) a_avl_foreach(cur, &(ctx)->root)
+#define pg_tree_entry(cur) a_avl_entry(cur, pg_item, node)
+/* in order from the head of a range up to its tail */
+#define pg_span_foreach(cur, span) \
+    for (a_avl_node *cur = (span)->head; cur != (span)->tail; cur = a_avl_next(cur))
 
-PG_PUBLIC int pg_io_fwrite(FILE *handle, void const *pdata, size_t nbyte);
-PG_PUBLIC int pg_io_write(char const *fname, void const *pdata, size_t nbyte);
+/* oldest first, the index must be on */
+#define pg_when_foreach(cur, ctx) a_rbt_foreach(cur, &(ctx)->when->root)
+/* newest first, the index must be on */
+#define pg_when_foreach_reverse(cur, ctx) a_rbt_foreach_reverse(cur, &(ctx)->when->root)
+#define pg_when_entry(cur) a_rbt_entry(cur, pg_mark, node)->item
 
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* __cplusplus */
 
+#include "io.h"
+
 #endif /* pg/pg.h */
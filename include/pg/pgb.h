@@ -0,0 +1,80 @@
+#ifndef PG_PGB_H
+#define PG_PGB_H
+
+#include "pg.h"
+
+/*!
+ @brief version of the binary vault format
+ @details a file is laid out as follows, every integer is little-endian:
+ - header, 32 bytes: "PGB\0", version, count, reserved, size of pool (8 bytes),
+   CRC-32 of table and pool, reserved.
+ - table, 32 bytes per record sorted by text: time (8 bytes), offset of text,
+   length of text, offset of hint, offset of misc, type | hash << 8 | size << 16,
+   reserved. A missing string has the offset 0xFFFFFFFF.
+ - pool, strings terminated with a null character.
+*/
+#define PG_PGB_VERSION 1
+
+typedef struct pg_pgb
+{
+    unsigned char const *table;
+    char const *pool;
+    a_size count;
+    a_size npool;
+    pg_io_map map; /*!< contents of the file */
+} pg_pgb;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief map a binary vault and check its header and checksum
+ @param[in,out] ctx points to an instance of binary vault
+ @param[in] fname name of the file to map
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgb_open(pg_pgb *ctx, char const *fname);
+PG_PUBLIC void pg_pgb_close(pg_pgb *ctx);
+
+/*!
+ @brief binary search a binary vault for text
+ @param[in] ctx points to an instance of binary vault
+ @param[in] text string terminated with a null character
+ @return index of the record, or count when text is missing
+*/
+PG_PUBLIC a_size pg_pgb_find(pg_pgb const *ctx, char const *text);
+
+/*!
+ @brief view a record of a binary vault without copying it
+ @param[in] ctx points to an instance of binary vault
+ @param[in] idx index of the record less than count
+ @param[out] out strings point into the mapping
+ @return time of the record
+*/
+PG_PUBLIC a_i64 pg_pgb_view(pg_pgb const *ctx, a_size idx, pg_view *out);
+
+/*!
+ @brief add every record of a binary vault to a tree
+ @param[in] ctx points to an instance of binary vault
+ @param[in,out] tree records are appended in order when it is empty
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgb_out(pg_pgb const *ctx, pg_tree *tree);
+
+/*!
+ @brief write a tree as a binary vault, replacing the file atomically
+ @param[in] fname name of the file to write
+ @param[in] tree records to write
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgb_dump(char const *fname, pg_tree const *tree);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/pgb.h */
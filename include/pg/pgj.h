@@ -0,0 +1,125 @@
+#ifndef PG_PGJ_H
+#define PG_PGJ_H
+
+#include "pg.h"
+#include "thread.h"
+
+/*!
+ @brief version of the change journal format
+ @details a journal starts with "PGJ\0" and the version, every integer is
+ little-endian. Records follow, each one is a 32-bit size and a CRC-32 of
+ the payload, then the payload: op (1 put, 2 delete), type, hash, reserved,
+ size (4 bytes), time (8 bytes), length of text, hint and misc (4 bytes
+ each, 0xFFFFFFFF when missing), then the strings without terminators.
+ A torn or corrupt record ends the journal, the next lock cuts it off.
+*/
+#define PG_PGJ_VERSION 1
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief instance structure for change journal opened for appending
+ @details the lock is a mutex and an exclusive lock on the file, so threads
+ and processes that share the journal append whole records to it.
+*/
+typedef struct pg_pgj
+{
+    pg_mutex lock;
+    a_str name; /*!< name of the journal */
+    a_u64 size; /*!< bytes in the journal */
+    a_u32 crc[0x100];
+    int fd;
+} pg_pgj;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief apply the records of a journal to trees
+ @details a put replaces the record in put and removes it from del, a delete
+ removes the record from put and adds its text to del. A missing journal is
+ an empty one.
+ @param[in] fname name of the journal
+ @param[in,out] put tree of the records that exist
+ @param[in,out] del tree of the texts that were deleted, may be null
+ @param[in] upto offset to stop at, the size of the journal if larger
+ @param[out] end offset after the last good record, may be null
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_replay(char const *fname, pg_tree *put, pg_tree *del, a_u64 upto, a_u64 *end);
+
+/*!
+ @brief open a journal for appending
+ @param[out] ctx points to an instance of change journal
+ @param[in] fname name of the journal
+ @param[in] create whether to create the journal when missing
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_open(pg_pgj *ctx, char const *fname, int create);
+PG_PUBLIC void pg_pgj_close(pg_pgj *ctx);
+
+/*!
+ @brief lock a journal against other threads and processes
+ @details a record torn by a crash is cut off, the records before it stay.
+ A journal replaced by another process is opened again.
+ @param[in,out] ctx points to an instance of change journal
+ @return error code value
+  @retval 0 success, size is the end of the whole records
+*/
+PG_PUBLIC int pg_pgj_lock(pg_pgj *ctx);
+PG_PUBLIC void pg_pgj_unlock(pg_pgj *ctx);
+
+/*!
+ @brief append a record with one write
+ @details it takes the lock, the caller must not hold it.
+ @param[in,out] ctx points to an instance of change journal
+ @param[in] item record that was created or changed
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_put(pg_pgj *ctx, pg_item const *item);
+
+/*!
+ @brief append a deletion with one write
+ @param[in,out] ctx points to an instance of change journal
+ @param[in] text text of the record that was deleted
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_del(pg_pgj *ctx, char const *text);
+
+/*!
+ @brief flush appended records to the disk
+ @param[in] ctx points to an instance of change journal
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_sync(pg_pgj *ctx);
+
+/*!
+ @brief remove the records before an offset once they are in the vault
+ @details the records after upto are kept and the journal is replaced
+ atomically, so a crash leaves either journal, both replay to the same vault.
+ The caller holds the lock since the replay that reached upto.
+ @param[in,out] ctx points to an instance of change journal
+ @param[in] upto offset of the first record to keep
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_pgj_drop(pg_pgj *ctx, a_u64 upto);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/pgj.h */
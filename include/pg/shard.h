@@ -0,0 +1,95 @@
+#ifndef PG_SHARD_H
+#define PG_SHARD_H
+
+#include "pg.h"
+
+/*!
+ @brief largest number of shards in a vault
+*/
+#define PG_SHARD_MAX 0x100
+
+/*!
+ @brief file in the directory of a sharded vault that holds the number of shards
+*/
+#define PG_SHARD_FILE "shards"
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief instance structure for sharded vault
+ @details a sharded vault is a directory of SQLite files named 0.db, 1.db
+ and so on, a record lives in the shard picked by the hash of its text.
+ Every shard has a connection of its own, so shards are loaded and saved
+ by one thread each. The number of shards is fixed when the vault is made.
+*/
+typedef struct pg_shard
+{
+    a_str *fname; /*!< names of the shards */
+    unsigned int num; /*!< number of shards */
+} pg_shard;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief open a sharded vault
+ @details the number of shards is stored in \ref PG_SHARD_FILE and the shards
+ that exist must match it. num only matters when there are none, then the
+ directory is made for num shards.
+ @param[out] ctx points to an instance of sharded vault
+ @param[in] dir name of the directory
+ @param[in] num number of shards for a new vault, 0 to only open one
+ @return error code value
+  @retval 0 success
+  @retval 1 not a sharded vault
+  @retval 2 the shards do not match the stored number, or the directory could not be made
+*/
+PG_PUBLIC int pg_shard_open(pg_shard *ctx, char const *dir, unsigned int num);
+PG_PUBLIC void pg_shard_close(pg_shard *ctx);
+
+/*!
+ @brief pick the shard of a text
+ @param[in] ctx points to an instance of sharded vault
+ @param[in] text string terminated with a null character
+ @return index of the shard
+*/
+PG_PUBLIC unsigned int pg_shard_index(pg_shard const *ctx, char const *text);
+
+/*!
+ @brief load every shard into a tree
+ @details the shards are read at the same time into trees of their own,
+ which are then merged with pg_tree_merge_n, so the tree is in text order
+ as if the vault were one file.
+ @param[in] ctx points to an instance of sharded vault
+ @param[in,out] tree tree that the records are merged into
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_shard_out(pg_shard const *ctx, pg_tree *tree);
+
+/*!
+ @brief write changes to every shard
+ @details each shard is changed in a transaction of its own, by a thread of
+ its own, and only with the records that hash to it. Without del the shards
+ are emptied first, so put becomes the whole vault.
+ @param[in] ctx points to an instance of sharded vault
+ @param[in] put records to insert or replace
+ @param[in] del texts to delete, null to rewrite the vault
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_shard_save(pg_shard const *ctx, pg_tree const *put, pg_tree const *del);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/shard.h */
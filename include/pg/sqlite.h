@@ -22,6 +22,18 @@
 #define PG_SQLITE_TABLE "pg_history"
 #endif /* PG_SQLITE_TABLE */
 
+/*!
+ @brief statements that read and write rows by version, prepared once for many rows
+*/
+typedef struct pg_sqlite_rows
+{
+    sqlite3 *db;
+    sqlite3_stmt *get;
+    sqlite3_stmt *put;
+    sqlite3_stmt *drop;
+    sqlite3_stmt *probe;
+} pg_sqlite_rows;
+
 #if defined(__cplusplus)
 extern "C" {
 #endif /* __cplusplus */
@@ -29,6 +41,14 @@ extern "C" {
 PG_PUBLIC int pg_sqlite_init(sqlite3 *db);
 PG_PUBLIC int pg_sqlite_exit(sqlite3 *db);
 
+/*!
+ @brief switch the vault to write-ahead logging, which lasts in the file
+ @details readers no longer block a writer, nor a writer readers.
+ @param[in] db connection to the vault
+ @return result code of SQLite
+*/
+PG_PUBLIC int pg_sqlite_wal(sqlite3 *db);
+
 PG_PUBLIC int pg_sqlite_begin(sqlite3 *db);
 PG_PUBLIC int pg_sqlite_commit(sqlite3 *db);
 
@@ -39,6 +59,86 @@ PG_PUBLIC int pg_sqlite_out(sqlite3 *db, pg_tree *tree);
 PG_PUBLIC int pg_sqlite_add(sqlite3 *db, pg_tree const *tree);
 PG_PUBLIC int pg_sqlite_del(sqlite3 *db, pg_tree const *tree);
 
+/*!
+ @brief insert the records of a tree that a filter keeps
+ @param[in] db connection to the vault
+ @param[in] tree records to insert
+ @param[in] keep returns nonzero for a record to insert, null keeps every record
+ @param[in] arg argument of keep
+ @return result code of SQLite
+*/
+PG_PUBLIC int pg_sqlite_add_if(sqlite3 *db, pg_tree const *tree, int (*keep)(void *, pg_item const *), void *arg);
+
+/*!
+ @brief delete the texts of a tree that a filter keeps
+ @param[in] db connection to the vault
+ @param[in] tree texts to delete
+ @param[in] keep returns nonzero for a text to delete, null keeps every text
+ @param[in] arg argument of keep
+ @return result code of SQLite
+*/
+PG_PUBLIC int pg_sqlite_del_if(sqlite3 *db, pg_tree const *tree, int (*keep)(void *, pg_item const *), void *arg);
+
+/*!
+ @brief load the version of every row that was ever written through pg_sqlite_put
+ @param[in] db connection to the vault
+ @param[in,out] version a record for every such text, with the version in time
+ @return result code of SQLite
+*/
+PG_PUBLIC int pg_sqlite_version(sqlite3 *db, pg_tree *version);
+
+/*!
+ @brief prepare the statements for pg_sqlite_get, pg_sqlite_put and pg_sqlite_drop
+ @param[out] ctx points to an instance of statements
+ @param[in] db connection to the vault
+ @return result code of SQLite, nothing is left to finalize on failure
+*/
+PG_PUBLIC int pg_sqlite_rows_ctor(pg_sqlite_rows *ctx, sqlite3 *db);
+PG_PUBLIC void pg_sqlite_rows_dtor(pg_sqlite_rows *ctx);
+
+/*!
+ @brief read one row again
+ @param[in] ctx statements of the vault
+ @param[in,out] tree the record of the text is added or set
+ @param[in] text text of the row
+ @param[out] version version of the row
+ @return result code of SQLite
+  @retval SQLITE_NOTFOUND there is no such row, the tree is left alone
+*/
+PG_PUBLIC int pg_sqlite_get(pg_sqlite_rows *ctx, pg_tree *tree, char const *text, a_i64 *version);
+
+/*!
+ @brief insert or update a row, if its version is still the one read
+ @param[in] ctx statements of the vault
+ @param[in] item record to write
+ @param[in,out] version version that was read, 0 for a row never seen, then the one written
+ @return result code of SQLite
+  @retval SQLITE_CONSTRAINT another connection wrote the row since, nothing was written
+*/
+PG_PUBLIC int pg_sqlite_put(pg_sqlite_rows *ctx, pg_item const *item, a_i64 *version);
+
+/*!
+ @brief delete a row, if its version is still the one read
+ @param[in] ctx statements of the vault
+ @param[in] text text of the row
+ @param[in] version version that was read
+ @return result code of SQLite
+  @retval SQLITE_OK deleted, or there was no such row
+  @retval SQLITE_CONSTRAINT another connection wrote the row since, nothing was deleted
+*/
+PG_PUBLIC int pg_sqlite_drop(pg_sqlite_rows *ctx, char const *text, a_i64 version);
+
+/*!
+ @brief replace every row with the records of a tree
+ @details a row gets the version it had plus one, or 1 when it is new, so a
+ connection that read a row before fails to write it over. It runs in the
+ transaction of the caller.
+ @param[in] db connection to the vault
+ @param[in] tree records to write
+ @return result code of SQLite
+*/
+PG_PUBLIC int pg_sqlite_rewrite(sqlite3 *db, pg_tree const *tree);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* __cplusplus */
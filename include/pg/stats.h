@@ -0,0 +1,121 @@
+#ifndef PG_STATS_H
+#define PG_STATS_H
+
+#include "pg.h"
+
+/*!
+ @brief phases timed with a monotonic clock
+*/
+typedef enum pg_stats_span
+{
+    PG_STATS_OPEN, /*!< opening the vault */
+    PG_STATS_LOAD, /*!< loading records into a tree */
+    PG_STATS_TREE, /*!< merging trees */
+    PG_STATS_GEN, /*!< generating passwords */
+    PG_STATS_SAVE, /*!< persisting a tree */
+    PG_STATS_JSON, /*!< parsing and printing JSON */
+    PG_STATS_LZ, /*!< packing and unpacking blocks */
+    PG_STATS_SPAN
+} pg_stats_span;
+
+/*!
+ @brief events that are counted
+*/
+typedef enum pg_stats_count
+{
+    PG_STATS_ROWS, /*!< records loaded */
+    PG_STATS_BYTES, /*!< bytes read from files */
+    PG_STATS_HMAC, /*!< HMAC computations */
+    PG_STATS_ALLOC, /*!< chunks allocated by pools */
+    PG_STATS_ALLOC_BYTES, /*!< bytes allocated by pools */
+    PG_STATS_INSERT, /*!< nodes inserted into trees and rebalanced */
+    PG_STATS_REMOVE, /*!< nodes removed from trees and rebalanced */
+    PG_STATS_LZ_BYTES, /*!< bytes of data packed or unpacked */
+    PG_STATS_CACHE, /*!< passwords found in the cache */
+    PG_STATS_COUNT
+} pg_stats_count;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief read the monotonic clock
+ @return nanoseconds since an unspecified point
+*/
+PG_PUBLIC a_u64 pg_stats_clock(void);
+
+/*!
+ @brief add the time of one pass through a phase
+ @param[in] id \ref pg_stats_span
+ @param[in] ns nanoseconds spent
+*/
+PG_PUBLIC void pg_stats_time(unsigned int id, a_u64 ns);
+
+/*!
+ @brief add to a counter
+ @param[in] id \ref pg_stats_count
+ @param[in] n amount to add
+*/
+PG_PUBLIC void pg_stats_add(unsigned int id, a_u64 n);
+
+/*!
+ @brief set all spans and counters to zero
+ @details the allocation profiler keeps its live blocks and restarts its peak from them.
+*/
+PG_PUBLIC void pg_stats_reset(void);
+
+/*!
+ @brief install the allocation profiler into a_alloc
+ @details every call through a_alloc is then counted, and live blocks are
+ tracked by address to give live and peak bytes and the call sites with the
+ most bytes. Blocks allocated before the install are passed through unseen.
+ A call site is the caller of a_alloc and a few frames above it, so an
+ allocation through a string or pool helper is told apart by its user. The
+ profiler stays installed until the process exits, it costs a lock, a hash
+ lookup and a short backtrace per call.
+*/
+PG_PUBLIC void pg_stats_alloc(void);
+
+/*!
+ @brief print spans and counters as aligned text, one per line
+ @details with the allocation profiler installed, its totals follow and then
+ the top call sites as calls, bytes and frames from the innermost out.
+ @param[out] out string that the report is appended to
+ @return the execution state of the function
+  @retval <0 failure
+  @retval 0 success
+*/
+PG_PUBLIC int pg_stats_text(a_str *out);
+
+/*!
+ @brief print spans and counters as one JSON object
+ @details {"span":{"open":{"count":1,"ns":123},...},"count":{"rows":1,...}}
+ and with the allocation profiler installed also
+ "alloc":{"calls":1,"frees":1,"bytes":1,"live":0,"peak":1,"sites":[{"calls":1,"bytes":1,"site":"f+0x1 < g+0x2"}]}
+ @param[out] out string that the report is appended to
+ @return the execution state of the function
+  @retval <0 failure
+  @retval 0 success
+*/
+PG_PUBLIC int pg_stats_json(a_str *out);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+/*
+ the macros below compile to nothing unless PG_STATS is defined,
+ use them rather than the functions on hot paths.
+*/
+#if defined(PG_STATS)
+#define PG_STATS_BEGIN(var) a_u64 const var = pg_stats_clock()
+#define PG_STATS_END(id, var) pg_stats_time(id, pg_stats_clock() - (var))
+#define PG_STATS_ADD(id, n) pg_stats_add(id, (a_u64)(n))
+#else /* !PG_STATS */
+#define PG_STATS_BEGIN(var)
+#define PG_STATS_END(id, var) ((void)0)
+#define PG_STATS_ADD(id, n) ((void)0)
+#endif /* PG_STATS */
+
+#endif /* pg/stats.h */
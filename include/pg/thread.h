@@ -0,0 +1,97 @@
+#ifndef PG_THREAD_H
+#define PG_THREAD_H
+
+#include "pg.h"
+#if defined(_WIN32)
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 5105)
+#endif /* _MSC_VER */
+#include <windows.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif /* _MSC_VER */
+#else /* !_WIN32 */
+#include <pthread.h>
+#endif /* _WIN32 */
+
+/*!
+ @brief instance structure for thread
+*/
+typedef struct pg_thread
+{
+#if defined(_WIN32)
+    HANDLE handle;
+#else /* !_WIN32 */
+    pthread_t handle;
+#endif /* _WIN32 */
+    void *(*func)(void *);
+    void *arg;
+} pg_thread;
+
+/*!
+ @brief instance structure for mutual exclusion
+*/
+typedef struct pg_mutex
+{
+#if defined(_WIN32)
+    CRITICAL_SECTION lock;
+#else /* !_WIN32 */
+    pthread_mutex_t lock;
+#endif /* _WIN32 */
+} pg_mutex;
+
+/*!
+ @brief instance structure for condition variable
+*/
+typedef struct pg_cond
+{
+#if defined(_WIN32)
+    CONDITION_VARIABLE cond;
+#else /* !_WIN32 */
+    pthread_cond_t cond;
+#endif /* _WIN32 */
+} pg_cond;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief start a thread that runs func(arg)
+ @param[in,out] ctx points to an instance of thread, it must live until joined
+ @param[in] func entry of the thread
+ @param[in] arg argument of func
+ @return error code value
+  @retval 0 success
+*/
+PG_PUBLIC int pg_thread_ctor(pg_thread *ctx, void *(*func)(void *), void *arg);
+
+/*!
+ @brief wait for a thread to finish
+ @param[in] ctx points to an instance of thread
+ @return value returned by func
+*/
+PG_PUBLIC void *pg_thread_join(pg_thread *ctx);
+
+/*!
+ @brief number of processors available to this process
+*/
+PG_PUBLIC unsigned int pg_thread_cpus(void);
+
+PG_PUBLIC void pg_mutex_ctor(pg_mutex *ctx);
+PG_PUBLIC void pg_mutex_dtor(pg_mutex *ctx);
+PG_PUBLIC void pg_mutex_lock(pg_mutex *ctx);
+PG_PUBLIC void pg_mutex_unlock(pg_mutex *ctx);
+
+PG_PUBLIC void pg_cond_ctor(pg_cond *ctx);
+PG_PUBLIC void pg_cond_dtor(pg_cond *ctx);
+PG_PUBLIC void pg_cond_wait(pg_cond *ctx, pg_mutex *mutex);
+PG_PUBLIC void pg_cond_signal(pg_cond *ctx);
+PG_PUBLIC void pg_cond_broadcast(pg_cond *ctx);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* pg/thread.h */
@@ -0,0 +1,606 @@
+#include "pg/pg.h"
+#include "pg/json.h"
+#include "pg/pgb.h"
+#include "pg/sqlite.h"
+#include "pg/stats.h"
+#include "a/vec.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <time.h>
+#if defined(_WIN32)
+#define DEVNULL "NUL"
+#else /* !_WIN32 */
+#define DEVNULL "/dev/null"
+#endif /* _WIN32 */
+
+#if !defined PG_BENCH_CLI
+#define PG_BENCH_CLI "pg"
+#endif /* PG_BENCH_CLI */
+
+/* lookups and searches that one phase times */
+#define BENCH_QUERY 0x400
+/* share of the vault that an import brings, half of it new */
+#define BENCH_IMPORT 10
+/* seconds that the records are spread over */
+#define BENCH_SPAN (5 * 365 * 24 * 60 * 60)
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic ignored "-Wc++-compat"
+#endif /* __GNUC__ || __clang__ */
+
+#pragma pack(push, 4)
+static struct
+{
+    char const *cli;
+    char const *name;
+    a_u64 seed;
+    a_u64 rand;
+    a_size num;
+    a_str out; /*!< results so far */
+    a_str cmd;
+    a_str file; /*!< name of the last file from bench_file */
+    a_vec text; /*!< texts of the vault, for queries */
+    pg_tree tree;
+    unsigned int runs;
+    int keep;
+    int sep;
+} local = {
+    .cli = PG_BENCH_CLI,
+    .name = "pg-bench",
+    .seed = 1,
+    .num = 10000,
+    .runs = 3,
+    .keep = 0,
+};
+#pragma pack(pop)
+
+static char const *const word[] = {
+    "alpha", "amber", "atlas", "bank", "blue", "cloud", "coral", "delta", "drive", "echo", "fern", "forum",
+    "game", "git", "harbor", "home", "iris", "jade", "king", "lake", "mail", "maple", "mint", "nova",
+    "oak", "orbit", "pay", "pixel", "quill", "river", "shop", "sky", "stone", "tide", "union", "vault",
+    "wave", "work", "xeno", "yarn", "zen", "zone",
+};
+#define WORDS (sizeof(word) / sizeof(*word))
+
+static char const *const tld[] = {"com", "net", "org", "io", "dev", "cn", "de", "co.uk"};
+#define TLDS (sizeof(tld) / sizeof(*tld))
+
+/* algorithms with weights that add up to 100, most records keep the default */
+static char const *const algo[] = {"MD5", "SHA256", "SHA1", "SHA512", "BLAKE2B", "BLAKE2S", "SHA3", "SHA224", "SHA384"};
+static unsigned char const weight[] = {50, 15, 8, 7, 5, 5, 5, 3, 2};
+
+/* xorshift64*, the same seed makes the same vault everywhere */
+static a_u64 bench_rand(void)
+{
+    local.rand ^= local.rand >> 12;
+    local.rand ^= local.rand << 25;
+    local.rand ^= local.rand >> 27;
+    return local.rand * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned int bench_below(unsigned int n)
+{
+    return (unsigned int)(bench_rand() >> 33) % n;
+}
+
+static void bench_word(a_str *out)
+{
+    a_str_cats(out, word[bench_below(WORDS)]);
+}
+
+/* a text unique by its index, shaped as an email, a site or an account */
+static void bench_text(a_str *out, a_size i)
+{
+    unsigned int const kind = bench_below(10);
+    a_str_setn_(out, 0);
+    if (kind < 6)
+    {
+        bench_word(out);
+        a_str_catc(out, '.');
+        bench_word(out);
+        a_str_catf(out, "%zx@", i);
+        bench_word(out);
+        a_str_catf(out, ".%s", tld[bench_below(TLDS)]);
+    }
+    else if (kind < 9)
+    {
+        bench_word(out);
+        a_str_catc(out, '-');
+        bench_word(out);
+        a_str_catf(out, "-%zx.%s", i, tld[bench_below(TLDS)]);
+    }
+    else
+    {
+        bench_word(out);
+        a_str_catf(out, "%zx", i);
+    }
+}
+
+/* most records have no hint, the others a few words */
+static char const *bench_hint(a_str *out)
+{
+    unsigned int n = bench_below(20);
+    if (n < 11) { return A_NULL; }
+    a_str_setn_(out, 0);
+    for (n = 1 + n % 4; n; --n)
+    {
+        bench_word(out);
+        if (n > 1) { a_str_catc(out, ' '); }
+    }
+    return a_str_ptr(out);
+}
+
+static char const *bench_misc(a_str *out)
+{
+    static char const sym[] = "!#$%&*+-=?@^_~";
+    a_str_setn_(out, 0);
+    for (unsigned int n = 4 + bench_below(9); n; --n) { a_str_catc(out, sym[bench_below(sizeof(sym) - 1)]); }
+    return a_str_ptr(out);
+}
+
+static char const *bench_algo(void)
+{
+    unsigned int n = bench_below(100);
+    a_size i = 0;
+    for (; n >= weight[i]; ++i) { n -= weight[i]; }
+    return algo[i];
+}
+
+/* adds records from index lo up to hi, texts past num are new to the vault */
+static int bench_fill(pg_tree *tree, a_size lo, a_size hi, a_i64 now)
+{
+    a_str text = A_STR_INIT, hint = A_STR_INIT, misc = A_STR_INIT;
+    int ok = A_SUCCESS;
+    for (a_size i = lo; i != hi && ok == A_SUCCESS; ++i)
+    {
+        pg_view view;
+        pg_view_ctor(&view);
+        /* the text of an index is the same whenever it is made */
+        a_u64 const rand = local.rand;
+        local.rand = (local.seed + i) * 0x9E3779B97F4A7C15ULL | 1;
+        bench_text(&text, i);
+        local.rand ^= rand;
+        view.text = a_str_ptr(&text);
+        view.hash = bench_algo();
+        view.hint = bench_hint(&hint);
+        unsigned int const type = bench_below(10);
+        if (type == 8)
+        {
+            view.type = PG_TYPE_DIGIT;
+            view.size = 4 + bench_below(5);
+        }
+        else if (type == 9)
+        {
+            view.type = PG_TYPE_OTHER;
+            view.misc = bench_misc(&misc);
+        }
+        if (view.type != PG_TYPE_DIGIT && bench_below(2)) { view.size = 8 + bench_below(25); }
+        pg_item *item = pg_tree_push(tree, view.text, a_str_len(&text));
+        if (!item || pg_tree_set(tree, item, &view)) { ok = A_OMEMORY; }
+        else { pg_tree_time(tree, item, now - (a_i64)bench_below(BENCH_SPAN)); }
+    }
+    a_str_dtor(&misc);
+    a_str_dtor(&hint);
+    a_str_dtor(&text);
+    return ok;
+}
+
+static char const *bench_file(char const *suffix)
+{
+    a_str_setn_(&local.file, 0);
+    a_str_catf(&local.file, "%s%s", local.name, suffix);
+    return a_str_ptr(&local.file);
+}
+
+static void bench_emit(char const *phase, char const *format, a_u64 ns, a_size items)
+{
+    a_str_catf(&local.out, "%s\n    {\"phase\":\"%s\",\"format\":\"%s\",\"ms\":%.3f,\"items\":%zu", local.sep ? "," : "",
+               phase, format, (double)ns / 1e6, items);
+    if (ns) { a_str_catf(&local.out, ",\"per_sec\":%.0f", (double)items * 1e9 / (double)ns); }
+    a_str_cats(&local.out, "}");
+    local.sep = 1;
+    fprintf(stderr, "%-8s%-8s%12.3f ms\n", phase, format, (double)ns / 1e6);
+}
+
+static a_u64 bench_clock(a_u64 *best, a_u64 start)
+{
+    a_u64 const ns = pg_stats_clock() - start;
+    if (ns < *best) { *best = ns; }
+    return ns;
+}
+
+/* texts of the vault at random, the same ones for every format */
+static char const *bench_pick(a_size i)
+{
+    char const *const *text = A_VEC_PTR(char const *, &local.text);
+    return text[(i * 0x9E3779B97F4A7C15ULL + local.seed) % a_vec_num(&local.text)];
+}
+
+static void bench_write(void)
+{
+    a_u64 best = ~(a_u64)0;
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        sqlite3 *db = 0;
+        remove(bench_file(".db"));
+        a_u64 const t = pg_stats_clock();
+        if (sqlite3_open(a_str_ptr(&local.file), &db) == SQLITE_OK)
+        {
+            pg_sqlite_create(db);
+            pg_sqlite_begin(db);
+            pg_sqlite_add(db, &local.tree);
+            pg_sqlite_commit(db);
+        }
+        sqlite3_close(db);
+        bench_clock(&best, t);
+    }
+    bench_emit("write", "sqlite", best, local.tree.count);
+
+    best = ~(a_u64)0;
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        a_u64 const t = pg_stats_clock();
+        pg_json_write(bench_file(".json"), &local.tree);
+        bench_clock(&best, t);
+    }
+    bench_emit("write", "json", best, local.tree.count);
+
+    best = ~(a_u64)0;
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        a_u64 const t = pg_stats_clock();
+        pg_pgb_dump(bench_file(".pgb"), &local.tree);
+        bench_clock(&best, t);
+    }
+    bench_emit("write", "binary", best, local.tree.count);
+}
+
+static void bench_load(void)
+{
+    static char const *const format[] = {"sqlite", "json", "binary"};
+    static char const *const suffix[] = {".db", ".json", ".pgb"};
+    for (unsigned int f = 0; f != 3; ++f)
+    {
+        a_u64 best = ~(a_u64)0;
+        a_size count = 0;
+        for (unsigned int r = 0; r != local.runs; ++r)
+        {
+            pg_tree tree;
+            pg_tree_ctor(&tree);
+            bench_file(suffix[f]);
+            a_u64 const t = pg_stats_clock();
+            if (f == 0)
+            {
+                sqlite3 *db = 0;
+                if (sqlite3_open(a_str_ptr(&local.file), &db) == SQLITE_OK) { pg_sqlite_out(db, &tree); }
+                sqlite3_close(db);
+            }
+            else if (f == 1) { pg_json_read(a_str_ptr(&local.file), &tree); }
+            else
+            {
+                pg_pgb pgb;
+                if (pg_pgb_open(&pgb, a_str_ptr(&local.file)) == A_SUCCESS)
+                {
+                    pg_pgb_out(&pgb, &tree);
+                    pg_pgb_close(&pgb);
+                }
+            }
+            bench_clock(&best, t);
+            count = tree.count;
+            pg_tree_dtor(&tree);
+        }
+        bench_emit("load", format[f], best, count);
+        if (count != local.tree.count)
+        {
+            fprintf(stderr, "%s: %zu of %zu records loaded\n", a_str_ptr(&local.file), count, local.tree.count);
+        }
+    }
+}
+
+/* lookups by text and merges of an import, in the tree that every command works on */
+static void bench_tree(void)
+{
+    a_u64 best = ~(a_u64)0;
+    a_size found = 0;
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        found = 0;
+        a_u64 const t = pg_stats_clock();
+        for (a_size i = 0; i != BENCH_QUERY; ++i) { found += pg_tree_get(&local.tree, bench_pick(i)) != A_NULL; }
+        bench_clock(&best, t);
+    }
+    bench_emit("lookup", "tree", best, found);
+
+    best = ~(a_u64)0;
+    a_size const lo = local.num - local.num / BENCH_IMPORT / 2;
+    a_size const hi = lo + local.num / BENCH_IMPORT;
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        pg_pgb pgb;
+        pg_tree tree, import;
+        pg_tree_ctor(&tree);
+        pg_tree_ctor(&import);
+        if (pg_pgb_open(&pgb, bench_file(".pgb")) == A_SUCCESS)
+        {
+            pg_pgb_out(&pgb, &tree);
+            pg_pgb_close(&pgb);
+        }
+        pg_json_read(bench_file(".import.json"), &import);
+        a_u64 const t = pg_stats_clock();
+        pg_tree_merge_n(&tree, &import, 1);
+        bench_clock(&best, t);
+        pg_tree_dtor(&import);
+        pg_tree_dtor(&tree);
+    }
+    bench_emit("merge", "tree", best, hi - lo);
+}
+
+/* runs the command line tool once without timing it */
+static int bench_call(char const *fmt, ...)
+{
+    a_str cmd = A_STR_INIT;
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[0x200];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    int ok = a_str_catf(&cmd, "\"%s\" %s >" DEVNULL " 2>&1", local.cli, buf) > 0 ? system(a_str_ptr(&cmd)) : -1;
+    a_str_dtor(&cmd);
+    return ok;
+}
+
+/* copies a file, or removes the copy when the file is missing */
+static int bench_copy(char const *from, char const *to)
+{
+    FILE *in = fopen(from, "rb");
+    if (!in)
+    {
+        remove(to);
+        return A_SUCCESS;
+    }
+    int ok = A_FAILURE;
+    FILE *out = fopen(to, "wb");
+    if (out)
+    {
+        char buf[0x4000];
+        size_t n;
+        ok = A_SUCCESS;
+        while ((n = fread(buf, 1, sizeof(buf), in)) != 0)
+        {
+            if (fwrite(buf, 1, n, out) != n) { ok = A_FAILURE; }
+        }
+        if (ferror(in) || fclose(out)) { ok = A_FAILURE; }
+    }
+    fclose(in);
+    return ok;
+}
+
+/* the files of a vault, its journal and the log of a database */
+static char const *const part[] = {"", ".pgj", "-wal"};
+#define PARTS (sizeof(part) / sizeof(*part))
+
+/* keeps a copy of the files of the vault beside them, or puts the copy back */
+static int bench_save(char const *vault, int back)
+{
+    int ok = A_SUCCESS;
+    for (a_size i = 0; i != PARTS; ++i)
+    {
+        char name[0x100], orig[0x100];
+        snprintf(name, sizeof(name), "%s%s", vault, part[i]);
+        snprintf(orig, sizeof(orig), "%s%s.orig", vault, part[i]);
+        if (back ? bench_copy(orig, name) : bench_copy(name, orig)) { ok = A_FAILURE; }
+    }
+    return ok;
+}
+
+static int bench_restore(char const *vault)
+{
+    return bench_save(vault, 1);
+}
+
+/* a create then adds the text each run, rather than changing the one the last run added */
+static int bench_absent(char const *vault)
+{
+    bench_call("-f \"%s\" -d --text=bench.new", vault);
+    return A_SUCCESS;
+}
+
+static int bench_present(char const *vault)
+{
+    return bench_call("-f \"%s\" -c -p code --text=bench.new --hint=bench", vault);
+}
+
+/* runs the command line tool the given number of times, the fastest run counts,
+ prep puts the vault back in the same state before every run and is not timed */
+static a_u64 bench_cli(int (*prep)(char const *), char const *vault, char const *fmt, ...)
+{
+    a_u64 best = ~(a_u64)0;
+    va_list ap;
+    va_start(ap, fmt);
+    a_str_setn_(&local.cmd, 0);
+    a_str_catf(&local.cmd, "\"%s\" ", local.cli);
+    char buf[0x200];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    a_str_catf(&local.cmd, "%s >" DEVNULL " 2>&1", buf);
+    va_end(ap);
+    for (unsigned int r = 0; r != local.runs; ++r)
+    {
+        if (prep && prep(vault))
+        {
+            fprintf(stderr, "failed to prepare: %s\n", vault);
+            return 0;
+        }
+        a_u64 const t = pg_stats_clock();
+        if (system(a_str_ptr(&local.cmd)))
+        {
+            fprintf(stderr, "failed: %s\n", a_str_ptr(&local.cmd));
+            return 0;
+        }
+        bench_clock(&best, t);
+    }
+    return best;
+}
+
+/* whole commands of the tool, each one opens the vault, works and writes it back */
+static void bench_app(char const *format, char const *suffix)
+{
+    char vault[0x100], other[0x100];
+    snprintf(vault, sizeof(vault), "%s", bench_file(suffix));
+    char const *text = bench_pick(0);
+    bench_emit("open", format, bench_cli(A_NULL, vault, "-f \"%s\" -p code --text=%s", vault, text), 1);
+    /* the domains of the texts are words, so a search finds a share of the vault */
+    char const *at = strchr(text, '@');
+    char sub[0x40];
+    snprintf(sub, sizeof(sub), "%.16s", at ? at + 1 : text);
+    bench_emit("search", format, bench_cli(A_NULL, vault, "-f \"%s\" -s --text=%s", vault, sub), 1);
+    bench_emit("index", format, bench_cli(A_NULL, vault, "-f \"%s\" -n -p code %zu %zu %zu", vault, local.num / 3, local.num / 2, local.num - 1), 3);
+    bench_emit("create", format, bench_cli(bench_absent, vault, "-f \"%s\" -c -p code --text=bench.new --hint=bench", vault), 1);
+    bench_emit("delete", format, bench_cli(bench_present, vault, "-f \"%s\" -d --text=bench.new", vault), 1);
+    /* every import merges into the vault as it was before the first one */
+    snprintf(other, sizeof(other), "%s", bench_file(".import.json"));
+    if (bench_save(vault, 0) == A_SUCCESS)
+    {
+        bench_emit("import", format, bench_cli(bench_restore, vault, "-f \"%s\" -i \"%s\"", vault, other), local.num / BENCH_IMPORT);
+        bench_restore(vault);
+    }
+    else { fprintf(stderr, "failed to copy: %s\n", vault); }
+    for (a_size i = 0; i != PARTS; ++i)
+    {
+        char orig[sizeof(vault) + 0x10];
+        snprintf(orig, sizeof(orig), "%s%s.orig", vault, part[i]);
+        remove(orig);
+    }
+    snprintf(other, sizeof(other), "%s", bench_file(".export.json"));
+    bench_emit("export", format, bench_cli(A_NULL, vault, "-f \"%s\" -o \"%s\"", vault, other), local.num);
+}
+
+static void bench_clean(void)
+{
+    static char const *const suffix[] = {".db", ".db-wal", ".db-shm", ".db.pgj", ".json", ".pgb", ".pgb.pgj", ".import.json", ".export.json"};
+    for (a_size i = 0; i != sizeof(suffix) / sizeof(*suffix); ++i) { remove(bench_file(suffix[i])); }
+}
+
+static int bench_help(char const *self)
+{
+    static const char help[] = " [option]...\n\
+option:\n\
+  -n --records   number of records, such as 1000 or 1e6\n\
+  -s --seed      number that the vault is made from\n\
+  -r --runs      runs of every phase, the fastest counts\n\
+  -o --output    prefix of the files, pg-bench by default\n\
+  -x --cli       command line tool to run\n\
+  -k --keep      keep the files\n\
+results go to stdout as JSON, progress to stderr.";
+    printf("%s%s\n", self, help);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    char const *shortopts = "?n:s:r:o:x:k";
+    static struct option const longopts[] = {
+        {"help", no_argument, 0, '?'},
+        {"records", required_argument, 0, 'n'},
+        {"seed", required_argument, 0, 's'},
+        {"runs", required_argument, 0, 'r'},
+        {"output", required_argument, 0, 'o'},
+        {"cli", required_argument, 0, 'x'},
+        {"keep", no_argument, 0, 'k'},
+        {0, 0, 0, 0},
+    };
+    for (int ok; ((void)(ok = getopt_long(argc, argv, shortopts, longopts, &ok)), ok) != -1;)
+    {
+        switch (ok)
+        {
+        case 'n':
+        {
+            double const n = strtod(optarg, 0);
+            local.num = n > 0 ? (a_size)n : 0;
+            break;
+        }
+        case 's':
+            local.seed = (a_u64)strtoull(optarg, 0, 0);
+            break;
+        case 'r':
+            local.runs = (unsigned int)strtoul(optarg, 0, 0);
+            break;
+        case 'o':
+            local.name = optarg;
+            break;
+        case 'x':
+            local.cli = optarg;
+            break;
+        case 'k':
+            local.keep = 1;
+            break;
+        case '?':
+        default:
+            return bench_help(argv[0]);
+        }
+    }
+    if (local.num < 2 || local.runs == 0) { return bench_help(argv[0]); }
+
+    int ok = EXIT_SUCCESS;
+    a_str_ctor(&local.out);
+    a_str_ctor(&local.cmd);
+    a_str_ctor(&local.file);
+    a_vec_ctor(&local.text, sizeof(char const *));
+    pg_tree_ctor(&local.tree);
+    sqlite3_initialize();
+
+    a_i64 const now = (a_i64)time(A_NULL);
+    local.rand = local.seed * 0x9E3779B97F4A7C15ULL | 1;
+    a_u64 const t = pg_stats_clock();
+    if (bench_fill(&local.tree, 0, local.num, now))
+    {
+        fprintf(stderr, "out of memory after %zu records\n", local.tree.count);
+        ok = EXIT_FAILURE;
+        goto exit;
+    }
+    bench_emit("make", "tree", pg_stats_clock() - t, local.tree.count);
+    pg_tree_foreach(cur, &local.tree)
+    {
+        char const **text = A_VEC_PUSH(char const *, &local.text);
+        if (!text)
+        {
+            fprintf(stderr, "out of memory after %zu texts\n", a_vec_num(&local.text));
+            ok = EXIT_FAILURE;
+            goto exit;
+        }
+        *text = pg_tree_entry(cur)->text;
+    }
+
+    /* the import is the last tenth of the vault and as many records after it */
+    {
+        pg_tree import;
+        pg_tree_ctor(&import);
+        local.rand = (local.seed ^ 0x5DEECE66DULL) | 1;
+        a_size const lo = local.num - local.num / BENCH_IMPORT / 2;
+        bench_fill(&import, lo, lo + local.num / BENCH_IMPORT, now);
+        pg_json_write(bench_file(".import.json"), &import);
+        pg_tree_dtor(&import);
+    }
+
+    pg_stats_reset();
+    bench_write();
+    bench_load();
+    bench_tree();
+    bench_app("sqlite", ".db");
+    bench_app("binary", ".pgb");
+
+    a_str stats = A_STR_INIT;
+    pg_stats_json(&stats);
+    printf("{\n  \"records\":%zu,\"seed\":%llu,\"runs\":%u,\n  \"phases\":[%s\n  ],\n  \"stats\":%s\n}\n", local.num,
+           (unsigned long long)local.seed, local.runs, a_str_ptr(&local.out), a_str_len(&stats) ? a_str_ptr(&stats) : "{}");
+    a_str_dtor(&stats);
+
+exit:
+    if (!local.keep) { bench_clean(); }
+    sqlite3_shutdown();
+    pg_tree_dtor(&local.tree);
+    a_vec_dtor(&local.text, A_NULL);
+    a_str_dtor(&local.file);
+    a_str_dtor(&local.cmd);
+    a_str_dtor(&local.out);
+    return ok;
+}
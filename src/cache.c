@@ -0,0 +1,232 @@
+#if !defined _GNU_SOURCE && defined(__linux__)
+#define _GNU_SOURCE /* NOLINT */
+#endif /* _GNU_SOURCE */
+#include "pg/cache.h"
+#include "pg/stats.h"
+#include "blake2b.h"
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#define NONE PG_CACHE_NONE
+
+void pg_cache_wipe(void *pdata, a_size nbyte)
+{
+    a_byte volatile *p = (a_byte volatile *)pdata;
+    while (nbyte--) { *p++ = 0; }
+}
+
+/* every field is ended so that the fields cannot run into each other */
+static void cache_str(blake2b_s *ctx, char const *str)
+{
+    if (str) { blake2b_proc(ctx, str, strlen(str) + 1); }
+    else { blake2b_proc(ctx, "\xFF", 1); }
+}
+
+void pg_cache_key(a_byte *key, pg_view const *view, char const *code, char const *rule, unsigned int version)
+{
+    a_byte num[12];
+    blake2b_s ctx;
+    blake2b_256_init(&ctx);
+    a_u32_setl(num, version);
+    a_u32_setl(num + 4, view->type);
+    a_u32_setl(num + 8, view->size);
+    blake2b_proc(&ctx, num, sizeof(num));
+    cache_str(&ctx, code);
+    cache_str(&ctx, rule);
+    cache_str(&ctx, view->text);
+    cache_str(&ctx, view->hash);
+    cache_str(&ctx, view->type == PG_TYPE_OTHER ? view->misc : A_NULL);
+    blake2b_done(&ctx, key);
+    pg_cache_wipe(&ctx, sizeof(ctx));
+}
+
+int pg_cache_init(pg_cache *ctx, a_size num)
+{
+    ctx->slot = A_NULL;
+    ctx->bucket = A_NULL;
+    ctx->size = 0;
+    ctx->num = 0;
+    if (num == 0 || num >= NONE) { return A_FAILURE; }
+    a_u32 nb = 1;
+    while (nb < num) { nb <<= 1; }
+    ctx->bucket = (a_u32 *)a_alloc(A_NULL, sizeof(a_u32) * nb);
+    if (!ctx->bucket) { return A_FAILURE; }
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    a_size const page = si.dwPageSize;
+#else /* !_WIN32 */
+    long const n = sysconf(_SC_PAGESIZE);
+    a_size const page = n > 0 ? (a_size)n : 0x1000;
+#endif /* _WIN32 */
+    ctx->size = (sizeof(pg_cache_slot) * num + page - 1) / page * page;
+#if defined(_WIN32)
+    ctx->slot = (pg_cache_slot *)VirtualAlloc(A_NULL, ctx->size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (ctx->slot && !VirtualLock(ctx->slot, ctx->size))
+    {
+        VirtualFree(ctx->slot, 0, MEM_RELEASE);
+        ctx->slot = A_NULL;
+    }
+#else /* !_WIN32 */
+    void *p = mmap(A_NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ctx->slot = p != MAP_FAILED ? (pg_cache_slot *)p : A_NULL;
+    /* a cache that could be swapped out is worse than none */
+    if (ctx->slot && mlock(ctx->slot, ctx->size))
+    {
+        munmap(ctx->slot, ctx->size);
+        ctx->slot = A_NULL;
+    }
+#if defined(MADV_DONTDUMP)
+    if (ctx->slot) { madvise(ctx->slot, ctx->size, MADV_DONTDUMP); }
+#endif /* MADV_DONTDUMP */
+#endif /* _WIN32 */
+    if (!ctx->slot)
+    {
+        a_die(ctx->bucket);
+        ctx->bucket = A_NULL;
+        return A_FAILURE;
+    }
+    ctx->num = (a_u32)num;
+    ctx->used = 0;
+    ctx->mask = nb - 1;
+    pg_mutex_ctor(&ctx->lock);
+    pg_cache_clear(ctx);
+    return A_SUCCESS;
+}
+
+void pg_cache_exit(pg_cache *ctx)
+{
+    if (!ctx->slot) { return; }
+    pg_cache_wipe(ctx->slot, ctx->size);
+#if defined(_WIN32)
+    VirtualUnlock(ctx->slot, ctx->size);
+    VirtualFree(ctx->slot, 0, MEM_RELEASE);
+#else /* !_WIN32 */
+    munlock(ctx->slot, ctx->size);
+    munmap(ctx->slot, ctx->size);
+#endif /* _WIN32 */
+    pg_mutex_dtor(&ctx->lock);
+    a_die(ctx->bucket);
+    ctx->slot = A_NULL;
+    ctx->bucket = A_NULL;
+    ctx->size = 0;
+    ctx->num = 0;
+}
+
+/* link that points to the slot of a key, the end of its bucket when missing */
+static a_u32 *cache_find(pg_cache *ctx, a_byte const *key)
+{
+    a_u32 *link = ctx->bucket + (a_u32_getl(key) & ctx->mask);
+    while (*link != NONE && memcmp(ctx->slot[*link].key, key, PG_CACHE_KEY)) { link = &ctx->slot[*link].chain; }
+    return link;
+}
+
+static void cache_unlink(pg_cache *ctx, a_u32 i)
+{
+    pg_cache_slot *s = ctx->slot + i;
+    if (s->prev != NONE) { ctx->slot[s->prev].next = s->next; }
+    else { ctx->head = s->next; }
+    if (s->next != NONE) { ctx->slot[s->next].prev = s->prev; }
+    else { ctx->tail = s->prev; }
+}
+
+static void cache_front(pg_cache *ctx, a_u32 i)
+{
+    pg_cache_slot *s = ctx->slot + i;
+    s->prev = NONE;
+    s->next = ctx->head;
+    if (ctx->head != NONE) { ctx->slot[ctx->head].prev = i; }
+    else { ctx->tail = i; }
+    ctx->head = i;
+}
+
+/* takes a slot out of its bucket and the order of use, then zeroes it */
+static void cache_evict(pg_cache *ctx, a_u32 *link)
+{
+    a_u32 const i = *link;
+    *link = ctx->slot[i].chain;
+    cache_unlink(ctx, i);
+    pg_cache_wipe(ctx->slot + i, sizeof(pg_cache_slot));
+}
+
+int pg_cache_get(pg_cache *ctx, a_byte const *key, char *out)
+{
+    if (!ctx->slot) { return A_FAILURE; }
+    pg_mutex_lock(&ctx->lock);
+    a_u32 const i = *cache_find(ctx, key);
+    if (i != NONE)
+    {
+        if (ctx->head != i)
+        {
+            cache_unlink(ctx, i);
+            cache_front(ctx, i);
+        }
+        a_copy(out, ctx->slot[i].pass, PG_CACHE_PASS);
+    }
+    pg_mutex_unlock(&ctx->lock);
+    if (i == NONE) { return A_FAILURE; }
+    PG_STATS_ADD(PG_STATS_CACHE, 1);
+    return A_SUCCESS;
+}
+
+void pg_cache_put(pg_cache *ctx, a_byte const *key, char const *pass)
+{
+    a_size const n = strlen(pass);
+    if (!ctx->slot || n >= PG_CACHE_PASS) { return; }
+    pg_mutex_lock(&ctx->lock);
+    a_u32 const j = *cache_find(ctx, key);
+    if (j != NONE && ctx->head != j)
+    {
+        cache_unlink(ctx, j);
+        cache_front(ctx, j);
+    }
+    else if (j == NONE)
+    {
+        a_u32 i = ctx->free;
+        if (i != NONE) { ctx->free = ctx->slot[i].next; }
+        else if (ctx->used != ctx->num) { i = ctx->used++; }
+        else
+        {
+            i = ctx->tail;
+            cache_evict(ctx, cache_find(ctx, ctx->slot[i].key));
+        }
+        pg_cache_slot *s = ctx->slot + i;
+        a_u32 *link = ctx->bucket + (a_u32_getl(key) & ctx->mask);
+        a_copy(s->key, key, PG_CACHE_KEY);
+        a_copy(s->pass, pass, n + 1);
+        s->chain = *link;
+        *link = i;
+        cache_front(ctx, i);
+    }
+    pg_mutex_unlock(&ctx->lock);
+}
+
+void pg_cache_drop(pg_cache *ctx, a_byte const *key)
+{
+    if (!ctx->slot) { return; }
+    pg_mutex_lock(&ctx->lock);
+    a_u32 *link = cache_find(ctx, key);
+    a_u32 const i = *link;
+    if (i != NONE)
+    {
+        cache_evict(ctx, link);
+        ctx->slot[i].next = ctx->free;
+        ctx->free = i;
+    }
+    pg_mutex_unlock(&ctx->lock);
+}
+
+void pg_cache_clear(pg_cache *ctx)
+{
+    if (!ctx->slot) { return; }
+    pg_mutex_lock(&ctx->lock);
+    pg_cache_wipe(ctx->slot, sizeof(pg_cache_slot) * ctx->used);
+    a_fill(ctx->bucket, sizeof(a_u32) * (ctx->mask + 1), 0xFF);
+    ctx->used = 0;
+    ctx->head = NONE;
+    ctx->tail = NONE;
+    ctx->free = NONE;
+    pg_mutex_unlock(&ctx->lock);
+}
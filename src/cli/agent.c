@@ -0,0 +1,542 @@
+#if !defined _GNU_SOURCE && defined(__linux__)
+#define _GNU_SOURCE /* NOLINT */
+#endif /* _GNU_SOURCE */
+#include "agent.h"
+#include "a/hash.h"
+#include "pg/thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#endif /* _WIN32 */
+
+#if !defined(_WIN32)
+/* the directory of the sockets of the user */
+static int agent_dir(a_str *path)
+{
+    char const *base = getenv("XDG_RUNTIME_DIR");
+    if (base == 0 || base[0] != '/') { base = "/tmp"; }
+    a_str_setn_(path, 0);
+    return a_str_catf(path, "%s/pg-%u", base, (unsigned int)geteuid()) > 0 ? 0 : ~0;
+}
+#endif /* _WIN32 */
+
+int agent_path(a_str *path, char const *fname)
+{
+#if defined(_WIN32)
+    (void)path;
+    (void)fname;
+    return ~0;
+#else /* !_WIN32 */
+    struct sockaddr_un addr;
+    struct stat st;
+    char name[PATH_MAX];
+    if (agent_dir(path)) { return ~0; }
+    /* the directory is private, so no other user can reach or replace the socket */
+    if (lstat(a_str_ptr(path), &st) || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) { return ~0; }
+    /* every name of the vault leads to the same socket */
+    if (realpath(fname, name) == 0)
+    {
+        if (fname[0] == '/' || getcwd(name, sizeof(name)) == 0) { name[0] = 0; }
+        size_t const n = strlen(name);
+        if (n + strlen(fname) + 2 > sizeof(name)) { return ~0; }
+        if (n) { strcpy(name + n, "/"); }
+        strcat(name, fname);
+    }
+    if (a_str_catf(path, "/%08x%08x.sock", a_hash_bkdr(name, 0), a_hash_sdbm(name, 0)) <= 0) { return ~0; }
+    return a_str_len(path) < sizeof(addr.sun_path) ? 0 : ~0;
+#endif /* _WIN32 */
+}
+
+#if defined(_WIN32)
+
+int agent_call(char const *fname, int argc, char const *const *argv, int *status)
+{
+    (void)fname;
+    (void)argc;
+    (void)argv;
+    (void)status;
+    return ~0;
+}
+
+int agent_serve(char const *fname, int (*serve)(int argc, char *argv[]), void (*flush)(void))
+{
+    (void)fname;
+    (void)serve;
+    (void)flush;
+    fprintf(stderr, "agent is not supported on this platform\n");
+    return ~0;
+}
+
+#else /* !_WIN32 */
+
+/* a peer that went away is an error of the call, not a signal that kills the process */
+#if defined(MSG_NOSIGNAL)
+#define AGENT_NOSIGNAL MSG_NOSIGNAL
+#else /* !MSG_NOSIGNAL */
+#define AGENT_NOSIGNAL 0
+#endif /* MSG_NOSIGNAL */
+
+/* seconds a peer may keep the other end waiting */
+#define AGENT_WAIT 5
+
+static int agent_socket(char const *path, struct sockaddr_un *addr)
+{
+    a_zero(addr, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    if (fd >= 0) { setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on)); }
+#endif /* SO_NOSIGPIPE */
+    return fd;
+}
+
+/* whether the process at the other end runs as the same user */
+static int agent_peer(int fd)
+{
+#if defined(__linux__)
+    struct ucred cred;
+    socklen_t n = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &n)) { return ~0; }
+    return cred.uid == geteuid() ? 0 : ~0;
+#else /* !__linux__ */
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid)) { return ~0; }
+    return uid == geteuid() ? 0 : ~0;
+#endif /* __linux__ */
+}
+
+/* bounds a receive or send on a socket by sec seconds, or lifts the bound with 0 */
+static void agent_wait(int fd, int opt, int sec)
+{
+    struct timeval tv;
+    tv.tv_sec = sec;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, opt, &tv, sizeof(tv));
+}
+
+static int agent_send(int fd, void const *pdata, size_t nbyte)
+{
+    char const *p = (char const *)pdata;
+    while (nbyte)
+    {
+        ssize_t n = send(fd, p, nbyte, AGENT_NOSIGNAL);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return ~0; }
+        p += n;
+        nbyte -= (size_t)n;
+    }
+    return 0;
+}
+
+static int agent_recv(int fd, void *pdata, size_t nbyte)
+{
+    char *p = (char *)pdata;
+    while (nbyte)
+    {
+        ssize_t n = recv(fd, p, nbyte, 0);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return ~0; }
+        p += n;
+        nbyte -= (size_t)n;
+    }
+    return 0;
+}
+
+int agent_call(char const *fname, int argc, char const *const *argv, int *status)
+{
+    struct sockaddr_un addr;
+    unsigned char head[4];
+    a_str path = A_STR_INIT;
+    a_str data = A_STR_INIT;
+    char cwd[4096];
+    int ok = ~0;
+    int fd = -1;
+
+    if (agent_path(&path, fname)) { goto exit; }
+    fd = agent_socket(a_str_ptr(&path), &addr);
+    if (fd < 0) { goto exit; }
+    /* only a missing socket or one nobody listens on means no agent, the request then runs locally */
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        if (errno != ENOENT && errno != ECONNREFUSED)
+        {
+            perror(a_str_ptr(&path));
+            ok = 1;
+        }
+        goto exit;
+    }
+    ok = 1;
+    /* the streams of this process go to no agent of another user */
+    if (agent_peer(fd))
+    {
+        fprintf(stderr, "%s: agent of another user\n", a_str_ptr(&path));
+        goto exit;
+    }
+    /* the agent greets a client it takes, one that serves another for too long is busy,
+       the wait outlasts a stalled client, which holds the agent for a few AGENT_WAIT at most */
+    agent_wait(fd, SO_RCVTIMEO, AGENT_WAIT * 4);
+    agent_wait(fd, SO_SNDTIMEO, AGENT_WAIT);
+    if (agent_recv(fd, head, 1))
+    {
+        fprintf(stderr, "%s: agent is busy\n", a_str_ptr(&path));
+        goto exit;
+    }
+
+    if (getcwd(cwd, sizeof(cwd)) == 0)
+    {
+        perror("getcwd");
+        goto exit;
+    }
+    a_str_catn(&data, cwd, strlen(cwd) + 1);
+    for (int i = 0; i < argc; ++i)
+    {
+        a_str_catn(&data, argv[i], strlen(argv[i]) + 1);
+    }
+    a_u32_setl(head, (a_u32)a_str_len(&data));
+
+    /* the size carries the standard streams of this process */
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = {head, sizeof(head)};
+    struct msghdr msg;
+    a_zero(&msg, sizeof(msg));
+    a_zero(&ctrl, sizeof(ctrl));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    a_copy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+    /* the agent may have run the request in part, so it is not run a second time */
+    if (sendmsg(fd, &msg, AGENT_NOSIGNAL) != (ssize_t)sizeof(head) ||
+        agent_send(fd, a_str_ptr(&data), a_str_len(&data)))
+    {
+        fprintf(stderr, "%s: agent failed\n", a_str_ptr(&path));
+        goto exit;
+    }
+    /* the request runs as long as it needs, a batch reads the input of this process */
+    agent_wait(fd, SO_RCVTIMEO, 0);
+    if (agent_recv(fd, head, sizeof(head)))
+    {
+        fprintf(stderr, "%s: agent failed\n", a_str_ptr(&path));
+        goto exit;
+    }
+    *status = (int)a_u32_getl(head);
+    ok = 0;
+
+exit:
+    if (fd >= 0) { close(fd); }
+    a_str_dtor(&data);
+    a_str_dtor(&path);
+    return ok;
+}
+
+static volatile sig_atomic_t agent_stop = 0;
+
+static void agent_signal(int sig)
+{
+    (void)sig;
+    agent_stop = 1;
+}
+
+/* the pipes that carry the output and error of a request to the client */
+typedef struct agent_pipe
+{
+    int in[2];
+    int put[2];
+    int out[2];
+} agent_pipe;
+
+/* writes to a stream of the client, failing when it takes nothing for AGENT_WAIT */
+static int agent_put(int fd, char const *p, size_t nbyte)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    while (nbyte)
+    {
+        int rc = poll(&pfd, 1, AGENT_WAIT * 1000);
+        if (rc < 0 && errno == EINTR) { continue; }
+        if (rc <= 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) { return ~0; }
+        ssize_t n = write(fd, p, nbyte);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return ~0; }
+        p += n;
+        nbyte -= (size_t)n;
+    }
+    return 0;
+}
+
+/* drains the pipes until both are closed, what a stalled stream does not take is dropped */
+static void *agent_relay(void *arg)
+{
+    agent_pipe *ctx = (agent_pipe *)arg;
+    struct pollfd pfd[2];
+    char buf[PIPE_BUF];
+    int live = 2;
+    for (int i = 0; i != 2; ++i)
+    {
+        pfd[i].fd = ctx->in[i];
+        pfd[i].events = POLLIN;
+    }
+    while (live)
+    {
+        if (poll(pfd, 2, -1) < 0)
+        {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        for (int i = 0; i != 2; ++i)
+        {
+            if (pfd[i].fd < 0 || pfd[i].revents == 0) { continue; }
+            ssize_t n = read(pfd[i].fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0)
+            {
+                pfd[i].fd = -1;
+                --live;
+                continue;
+            }
+            if (ctx->out[i] >= 0 && agent_put(ctx->out[i], buf, (size_t)n)) { ctx->out[i] = -1; }
+        }
+    }
+    return arg;
+}
+
+static int agent_pipe_ctor(agent_pipe *ctx, int const *out, pg_thread *relay)
+{
+    int p[2][2];
+    if (pipe(p[0])) { return ~0; }
+    if (pipe(p[1]))
+    {
+        close(p[0][0]);
+        close(p[0][1]);
+        return ~0;
+    }
+    for (int i = 0; i != 2; ++i)
+    {
+        ctx->in[i] = p[i][0];
+        ctx->put[i] = p[i][1];
+        ctx->out[i] = out[i];
+    }
+    if (pg_thread_ctor(relay, agent_relay, ctx) == A_SUCCESS) { return 0; }
+    for (int i = 0; i != 2; ++i)
+    {
+        close(p[i][0]);
+        close(p[i][1]);
+    }
+    return ~0;
+}
+
+static void agent_request(int fd, int (*serve)(int argc, char *argv[]), void (*flush)(void))
+{
+    int fds[3] = {-1, -1, -1};
+    unsigned char head[4];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = {head, sizeof(head)};
+    struct msghdr msg;
+    a_zero(&msg, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    if (recvmsg(fd, &msg, 0) != (ssize_t)sizeof(head)) { return; }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+        {
+            a_copy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+    }
+
+    a_u32 size = a_u32_getl(head);
+    char *data = size && size <= (1U << 24) ? (char *)malloc(size) : 0;
+    char **argv = 0;
+    int argc = -1;
+    if (data && agent_recv(fd, data, size) == 0 && data[size - 1] == 0)
+    {
+        for (a_u32 i = 0; i != size; ++i)
+        {
+            if (data[i] == 0) { ++argc; }
+        }
+        argv = (char **)malloc(sizeof(char *) * (size_t)(argc + 1));
+    }
+
+    int status = EXIT_FAILURE;
+    int cwd = open(".", O_RDONLY);
+    if (argv && fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 && cwd >= 0 && chdir(data) == 0)
+    {
+        int save[3];
+        agent_pipe pipes;
+        pg_thread relay;
+        char *p = data + strlen(data) + 1;
+        for (int i = 0; i != argc; ++i)
+        {
+            argv[i] = p;
+            p += strlen(p) + 1;
+        }
+        argv[argc] = 0;
+        fflush(stdout);
+        fflush(stderr);
+        /* the output goes through pipes of the agent, so a client that reads none of it stalls the agent no longer than AGENT_WAIT */
+        int const relayed = agent_pipe_ctor(&pipes, fds + 1, &relay) == 0;
+        int const src[3] = {fds[0], relayed ? pipes.put[0] : fds[1], relayed ? pipes.put[1] : fds[2]};
+        for (int i = 0; i != 3; ++i)
+        {
+            save[i] = dup(i);
+            if (save[i] >= 0) { dup2(src[i], i); }
+        }
+        if (relayed)
+        {
+            close(pipes.put[0]);
+            close(pipes.put[1]);
+        }
+        clearerr(stdin);
+        status = serve(argc, argv);
+        fflush(stdout);
+        fflush(stderr);
+        for (int i = 0; i != 3; ++i)
+        {
+            if (save[i] < 0) { continue; }
+            dup2(save[i], i);
+            close(save[i]);
+        }
+        clearerr(stdin);
+        if (relayed)
+        {
+            pg_thread_join(&relay);
+            close(pipes.in[0]);
+            close(pipes.in[1]);
+            /* a client that lost some output is told so */
+            if (pipes.out[0] < 0 || pipes.out[1] < 0) { status = EXIT_FAILURE; }
+        }
+    }
+    if (cwd >= 0)
+    {
+        if (fchdir(cwd)) { perror("fchdir"); }
+        close(cwd);
+    }
+    if (flush) { flush(); }
+    for (int i = 0; i != 3; ++i)
+    {
+        if (fds[i] >= 0) { close(fds[i]); }
+    }
+    free(argv);
+    free(data);
+
+    a_u32_setl(head, (a_u32)status);
+    agent_send(fd, head, sizeof(head));
+}
+
+int agent_serve(char const *fname, int (*serve)(int argc, char *argv[]), void (*flush)(void))
+{
+    struct sockaddr_un addr;
+    struct sigaction act;
+    a_str path = A_STR_INIT;
+    int ok = ~0;
+    int fd = -1;
+
+    /* only the agent makes the directory, a client that finds none has no agent to call */
+    if (agent_dir(&path) || (mkdir(a_str_ptr(&path), 0700) && errno != EEXIST) || agent_path(&path, fname))
+    {
+        fprintf(stderr, "%s: no private directory for the socket\n", fname);
+        goto exit;
+    }
+    fd = agent_socket(a_str_ptr(&path), &addr);
+    if (fd < 0) { goto exit; }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        fprintf(stderr, "%s: agent is already running\n", a_str_ptr(&path));
+        goto exit;
+    }
+    /* a socket left by an agent that died is removed, anything else is kept */
+    struct stat st;
+    if (lstat(a_str_ptr(&path), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "%s: not a socket\n", a_str_ptr(&path));
+            goto exit;
+        }
+        unlink(a_str_ptr(&path));
+    }
+    close(fd);
+    fd = agent_socket(a_str_ptr(&path), &addr);
+    if (fd < 0) { goto exit; }
+    /* only the owner of the agent may talk to it */
+    mode_t mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (rc || listen(fd, 16))
+    {
+        perror(a_str_ptr(&path));
+        goto exit;
+    }
+
+    a_zero(&act, sizeof(act));
+    act.sa_handler = agent_signal;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGINT, &act, 0);
+    sigaction(SIGTERM, &act, 0);
+    sigaction(SIGHUP, &act, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!agent_stop)
+    {
+        int client = accept(fd, 0, 0);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            perror("accept");
+            break;
+        }
+        if (agent_peer(client))
+        {
+            close(client);
+            continue;
+        }
+        /* a client that stops talking is dropped after AGENT_WAIT */
+        agent_wait(client, SO_RCVTIMEO, AGENT_WAIT);
+        agent_wait(client, SO_SNDTIMEO, AGENT_WAIT);
+        unsigned char const hello = 0;
+        if (agent_send(client, &hello, 1) == 0) { agent_request(client, serve, flush); }
+        close(client);
+    }
+    unlink(a_str_ptr(&path));
+    ok = 0;
+
+exit:
+    if (fd >= 0) { close(fd); }
+    a_str_dtor(&path);
+    return ok;
+}
+
+#endif /* _WIN32 */
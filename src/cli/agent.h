@@ -0,0 +1,64 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "a/str.h"
+
+/*!
+ @brief resident agent that serves requests for one vault
+ @details the agent listens on a Unix domain socket in a directory that only
+ the user may enter, pg-UID in $XDG_RUNTIME_DIR or /tmp, named after a hash
+ of the absolute name of the vault. Both ends refuse a peer of another user.
+ The agent greets a client it takes with one byte. A request is a
+ little-endian 32-bit size followed
+ by that many bytes of strings terminated with a null character: working
+ directory of the client, then its arguments. The standard input, output
+ and error of the client are passed along with the size, so the agent uses
+ them directly. The reply is a little-endian 32-bit exit status. Either end
+ gives up on a peer that stalls for a few seconds, except while the client
+ waits for the reply.
+*/
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief name of the socket of the agent for a vault
+ @details fails when the directory of the socket is missing or not private.
+ @param[out] path name of the socket
+ @param[in] fname name of the vault
+ @return the execution state of the function
+  @retval -1 failure
+  @retval 0 success
+*/
+int agent_path(a_str *path, char const *fname);
+
+/*!
+ @brief run a request on the agent of a vault when it is running
+ @param[in] fname name of the vault
+ @param[in] argc number of arguments
+ @param[in] argv arguments of the request
+ @param[out] status exit status of the request
+ @return the execution state of the function
+  @retval -1 no agent is running, run the request locally
+  @retval 0 success
+  @retval 1 failure, the error is printed
+*/
+int agent_call(char const *fname, int argc, char const *const *argv, int *status);
+
+/*!
+ @brief serve requests for a vault until a signal stops the agent
+ @param[in] fname name of the vault
+ @param[in] serve handles the arguments of one request
+ @param[in] flush runs after the working directory is restored, may be null
+ @return the execution state of the function
+  @retval -1 failure
+  @retval 0 success
+*/
+int agent_serve(char const *fname, int (*serve)(int argc, char *argv[]), void (*flush)(void));
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* AGENT_H */
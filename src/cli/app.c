@@ -1,4 +1,10 @@
 #include "app.h"
+#include "batch.h"
+#include "pg/cache.h"
+#include "pg/cow.h"
+#include "pg/pgj.h"
+#include "pg/shard.h"
+#include <ctype.h>
 #include <time.h>
 #if defined(_WIN32)
 #if defined(_MSC_VER)
@@ -9,11 +15,15 @@
 #if defined(_MSC_VER)
 #pragma warning(pop)
 #endif /* _MSC_VER */
+#include <stdlib.h>
+#else /* !_WIN32 */
+#include <unistd.h>
 #endif /* _WIN32 */
 
 // clang-format off
 #define TEXT_RED       CONSOLE_TEXT_RED
 #define TEXT_GREEN     CONSOLE_TEXT_GREEN
+#define TEXT_YELLOW    CONSOLE_TEXT_YELLOW
 #define TEXT_TURQUOISE CONSOLE_TEXT_TURQUOISE
 #define TEXT_WHITE     CONSOLE_TEXT_WHITE
 #define TEXT_DEFAULT   CONSOLE_TEXT_DEFAULT
@@ -24,21 +34,21 @@ static void app_log3(char const *obj, unsigned int color, char const *status, ch
     app_log(3, TEXT_WHITE, obj, color, status, TEXT_TURQUOISE, text);
 }
 
-static void app_item(size_t index, pg_item const *item)
+static void app_item_(char const *buf_i, pg_item const *item)
 {
     pg_view view;
     pg_item_view(item, &view);
-    char buf_i[1 << 4];
-    snprintf(buf_i, 1 << 4, "%05zu", index);
     char buf_t[1 << 2];
     snprintf(buf_t, 1 << 2, "%u", view.type);
     char buf_z[1 << 2];
     snprintf(buf_z, 1 << 2, "%3u", view.size);
     char buf_h[1 << 3];
     snprintf(buf_h, 1 << 3, "%-7s", view.hash);
-    char *text = a_str_ptr(item->text);
 #if defined(_WIN32)
-    code_utf8_to(&text, text);
+    char *text = 0;
+    code_utf8_to(&text, view.text);
+#else /* !_WIN32 */
+    char const *text = view.text;
 #endif /* _WIN32 */
     app_log(7, TEXT_TURQUOISE, buf_i, TEXT_GREEN, buf_t, TEXT_GREEN, buf_z, TEXT_GREEN, buf_h,
             TEXT_DEFAULT, text, TEXT_GREEN, view.misc, TEXT_DEFAULT, view.hint);
@@ -47,6 +57,26 @@ static void app_item(size_t index, pg_item const *item)
 #endif /* _WIN32 */
 }
 
+static void app_item(size_t index, pg_item const *item)
+{
+    char buf_i[1 << 4];
+    snprintf(buf_i, 1 << 4, "%05zu", index);
+    app_item_(buf_i, item);
+}
+
+/* the day of the last change is shown in place of the index */
+static void app_item_time(pg_item const *item)
+{
+    char buf_d[1 << 4] = "-";
+    if (item->time != A_I32_MIN)
+    {
+        time_t t = (time_t)(item->time - A_I32_MIN);
+        struct tm *tm = localtime(&t);
+        if (tm) { strftime(buf_d, sizeof(buf_d), "%Y-%m-%d", tm); }
+    }
+    app_item_(buf_d, item);
+}
+
 void app_log(unsigned int num, ...)
 {
     va_list ap;
@@ -61,6 +91,21 @@ void app_log(unsigned int num, ...)
 #define STATUS_DONE (1 << 1)
 #define STATUS_DUMP (1 << 2)
 #define STATUS_ISV2 (1 << 3)
+#define STATUS_PGJ (1 << 4)
+#define STATUS_JOIN (1 << 5)
+#define STATUS_SHARD (1 << 6)
+#define STATUS_FUZZY (1 << 7)
+#define STATUS_CACHE (1 << 8)
+#define STATUS_LAZY (1 << 9)
+
+/* journal size that starts a compaction */
+#define APP_PGJ_SIZE (1 << 16)
+/* milliseconds that a connection waits for a lock of the other one */
+#define APP_BUSY 5000
+/* records that a search walks on several threads from */
+#define APP_SCAN (1 << 14)
+/* generated passwords that are kept, they fit in the default RLIMIT_MEMLOCK */
+#define APP_CACHE 0x100
 
 #pragma pack(push, 4)
 static struct
@@ -69,11 +114,36 @@ static struct
     char const *code;
     char const *fname;
     pg_tree tree;
+    pg_pgj pgj;
+    pg_shard shard;
+    pg_pgb pgb; /*!< mapping of the binary vault, tree only overlays it while STATUS_LAZY */
+    pg_tree gone; /*!< texts deleted from the mapping while STATUS_LAZY */
+    pg_fuzzy fuzzy; /*!< index for fuzzy search, stale unless STATUS_FUZZY */
+    pg_cache cache; /*!< generated passwords, usable once STATUS_CACHE */
+    a_byte epoch[PG_CACHE_KEY]; /*!< fingerprint of the code and rules the cache holds */
+    pg_cow cow; /*!< copy of tree that the workers of the batch mode read, made by the first change */
+    pg_tree changed; /*!< texts that the batch mode changed, time is the version of the last change */
+    pg_tree dirty; /*!< texts whose rows the database vault, or whose records the journal, has yet to write */
+    pg_tree version; /*!< texts of the database vault with the version of their rows in time, 0 when missing */
+    pg_thread compact;
+    a_str rule;
+    a_str stat;
+    a_str jname;
+    int nrule;
     int status;
+    int compacted; /*!< set by the compaction once it finishes */
+    int snap; /*!< cow follows tree, unset when a change could not be copied */
+    pg_cache *bcache; /*!< cache of the batch workers, set before they start since status changes under them */
+    unsigned int bversion; /*!< generator of the batch workers */
+    unsigned int nshard; /*!< number of shards for a new vault */
+    int lazy; /*!< a binary vault is kept mapped instead of loaded */
+    int resident; /*!< the process serves many commands, so the strings of the tree are packed */
+    a_size packed; /*!< bytes of the strings of the tree when they were last counted */
 } local = {
     .db = 0,
     .code = 0,
     .fname = 0,
+    .nrule = 0,
     .status = STATUS_ZERO,
 };
 #pragma pack(pop)
@@ -83,39 +153,87 @@ static struct
 #define STATUS_IS1(mask) ((local.status & (mask)) == (mask))
 #define STATUS_IS0(mask) ((local.status & (mask)) != (mask))
 
-int app_gen(pg_item const *item, char const *code)
+/* the cache is made on first use, generation goes on without it when memory cannot be locked */
+static pg_cache *app_cache(void)
 {
+    static int tried = 0;
+    if (STATUS_IS0(STATUS_CACHE) && !tried)
+    {
+        tried = 1;
+        if (pg_cache_init(&local.cache, APP_CACHE) == A_SUCCESS) { STATUS_SET(STATUS_CACHE); }
+    }
+    return STATUS_IS1(STATUS_CACHE) ? &local.cache : A_NULL;
+}
+
+static unsigned int app_version(void)
+{
+    return STATUS_IS1(STATUS_ISV2) ? 2 : 1;
+}
+
+/* generates into out, PG_CACHE_PASS bytes, or takes the password from the cache if there is one */
+static int app_pass(pg_view const *view, char const *code, pg_cache *cache, unsigned int version, char *out)
+{
+    a_byte key[PG_CACHE_KEY];
+    if (cache)
+    {
+        pg_cache_key(key, view, code, a_str_ptr(&local.rule), version);
+        if (pg_cache_get(cache, key, out) == A_SUCCESS) { return A_SUCCESS; }
+    }
+    char *pass = 0;
+    int (*gen)(pg_view const *, char const *, char **) = pg_gen1;
+    if (version == 2) { gen = pg_gen2; }
+    if (gen(view, code, &pass)) { return A_FAILURE; }
+    a_size const n = strlen(pass);
+    int ok = n < PG_CACHE_PASS ? A_SUCCESS : A_FAILURE;
+    if (ok == A_SUCCESS)
+    {
+        a_copy(out, pass, n + 1);
+        if (cache) { pg_cache_put(cache, key, out); }
+    }
+    pg_cache_wipe(pass, n);
+    a_die(pass);
+    return ok;
+}
+
+/* forgets the password of a record that is about to change or go */
+static void app_drop(pg_item const *item)
+{
+    if (STATUS_IS0(STATUS_CACHE) || local.code == 0) { return; }
     pg_view view;
+    a_byte key[PG_CACHE_KEY];
     pg_item_view(item, &view);
+    pg_cache_key(key, &view, local.code, a_str_ptr(&local.rule), app_version());
+    pg_cache_drop(&local.cache, key);
+}
 
+int app_gen(pg_view const *view, char const *code)
+{
     if (code == 0 || strlen(code) == 0)
     {
         app_log(2, TEXT_RED, s_missing, TEXT_TURQUOISE, "-p");
         return A_FAILURE;
     }
-    if (a_str_len(item->text) == 0)
+    if (view->text == 0 || *view->text == 0)
     {
         app_log(2, TEXT_RED, s_missing, TEXT_TURQUOISE, "-g");
         return A_FAILURE;
     }
-    if (a_str_len(item->misc) == 0 && item->type == PG_TYPE_OTHER)
+    if ((view->misc == 0 || *view->misc == 0) && view->type == PG_TYPE_OTHER)
     {
         app_log(2, TEXT_RED, s_missing, TEXT_TURQUOISE, "-m");
         return A_FAILURE;
     }
 
-    char *out = 0;
-    int (*gen)(pg_view const *, char const *, char **) = pg_gen1;
-    if (STATUS_IS1(STATUS_ISV2)) { gen = pg_gen2; }
-    if (gen(&view, code, &out))
+    char out[PG_CACHE_PASS];
+    if (app_pass(view, code, app_cache(), app_version(), out))
     {
-        app_log(2, TEXT_RED, s_failure, TEXT_TURQUOISE, view.text);
+        app_log(2, TEXT_RED, s_failure, TEXT_TURQUOISE, view->text);
         return A_FAILURE;
     }
 
 #if defined(_WIN32)
     char *text = 0;
-    code_utf8_to(&text, view.text);
+    code_utf8_to(&text, view->text);
     app_log(2, TEXT_TURQUOISE, out, TEXT_DEFAULT, text);
     free(text);
     if (OpenClipboard(0))
@@ -133,14 +251,373 @@ int app_gen(pg_item const *item, char const *code)
         CloseClipboard();
     }
 #else /* !_WIN32 */
-    app_log(2, TEXT_TURQUOISE, out, TEXT_DEFAULT, view.text);
+    app_log(2, TEXT_TURQUOISE, out, TEXT_DEFAULT, view->text);
+#endif /* _WIN32 */
+
+    pg_cache_wipe(out, sizeof(out));
+
+    return A_SUCCESS;
+}
+
+static int app_pgb(char const *fname)
+{
+    size_t n = strlen(fname);
+    return n > 4 && strcmp(fname + n - 4, ".pgb") == 0;
+}
+
+static int app_init_pgb(char const *fname)
+{
+    pg_pgb pgb;
+    PG_STATS_BEGIN(t);
+    int ok = pg_pgb_open(&pgb, fname);
+    PG_STATS_END(PG_STATS_OPEN, t);
+    if (ok == A_SUCCESS && local.lazy)
+    {
+        /* a command on single texts looks them up in the mapping, the tree holds only the journal */
+        local.pgb = pgb;
+        STATUS_SET(STATUS_LAZY);
+    }
+    else if (ok == A_SUCCESS)
+    {
+        ok = pg_pgb_out(&pgb, &local.tree);
+        pg_pgb_close(&pgb);
+    }
+    else if (pg_io_size(fname) < 0) { ok = A_SUCCESS; }
+    return ok;
+}
+
+/*
+ folds the journal into the vault, the records of the dirty texts are taken from the tree, the lock is held,
+ shard is the sharded vault or null, so a compaction does not read status while the main thread changes it
+*/
+static int app_fold(pg_pgj *pgj, pg_tree const *dirty, pg_shard *shard)
+{
+    a_u64 const upto = pgj->size;
+    pg_tree put, del;
+    pg_tree_ctor(&put);
+    pg_tree_ctor(&del);
+    int ok = A_SUCCESS;
+    if (!shard)
+    {
+        pg_pgb pgb;
+        if (pg_pgb_open(&pgb, local.fname) == A_SUCCESS)
+        {
+            ok = pg_pgb_out(&pgb, &put);
+            pg_pgb_close(&pgb);
+        }
+        else if (pg_io_size(local.fname) >= 0) { ok = A_FAILURE; }
+    }
+    /* the vault may hold changes of other processes, only the journal and the dirty texts are applied to it */
+    if (ok == A_SUCCESS) { ok = pg_pgj_replay(a_str_ptr(&pgj->name), &put, &del, upto, A_NULL); }
+    pg_tree_foreach(cur, dirty)
+    {
+        if (ok != A_SUCCESS) { break; }
+        char const *text = pg_tree_entry(cur)->text;
+        pg_item const *item = pg_tree_get(&local.tree, text);
+        pg_item *it = pg_tree_del(item ? &del : &put, text);
+        if (it) { pg_tree_free(item ? &del : &put, it); }
+        if (item)
+        {
+            pg_view view;
+            it = pg_tree_add(&put, text);
+            pg_item_view(item, &view);
+            if (!it || pg_tree_set(&put, it, &view)) { ok = A_OMEMORY; }
+            else { pg_tree_time(&put, it, item->time); }
+        }
+        else if (!pg_tree_add(&del, text)) { ok = A_OMEMORY; }
+    }
+    if (ok == A_SUCCESS)
+    {
+        ok = shard ? pg_shard_save(shard, &put, &del) : pg_pgb_dump(local.fname, &put);
+    }
+    /* a crash before the drop replays records that are in the vault already */
+    if (ok == A_SUCCESS) { ok = pg_pgj_drop(pgj, upto); }
+    pg_tree_dtor(&del);
+    pg_tree_dtor(&put);
+    return ok;
+}
+
+/* folds the journal into the vault while other threads and processes wait to append */
+static void *app_compact(void *arg)
+{
+    pg_pgj *pgj = &local.pgj;
+    pg_tree none;
+    pg_tree_ctor(&none);
+    int ok = pg_pgj_lock(pgj);
+    if (ok == A_SUCCESS)
+    {
+        ok = app_fold(pgj, &none, (pg_shard *)arg);
+        local.compacted = 1;
+        pg_pgj_unlock(pgj);
+    }
+    else
+    {
+        pg_mutex_lock(&pgj->lock);
+        local.compacted = 1;
+        pg_mutex_unlock(&pgj->lock);
+    }
+    return ok == A_SUCCESS ? A_NULL : pgj;
+}
+
+static void app_compact_join(void)
+{
+    if (STATUS_IS1(STATUS_JOIN))
+    {
+        if (pg_thread_join(&local.compact))
+        {
+            fprintf(stderr, "%s: failed to compact journal\n", a_str_ptr(&local.jname));
+        }
+        STATUS_CLR(STATUS_JOIN);
+    }
+}
+
+/* starts a compaction unless one runs, foreground commands do not wait for it */
+static void app_compact_start(void)
+{
+    if (STATUS_IS0(STATUS_PGJ)) { return; }
+    if (STATUS_IS1(STATUS_JOIN))
+    {
+        pg_mutex_lock(&local.pgj.lock);
+        int const done = local.compacted;
+        pg_mutex_unlock(&local.pgj.lock);
+        if (!done) { return; }
+        app_compact_join();
+    }
+    if (local.pgj.size > APP_PGJ_SIZE)
+    {
+        local.compacted = 0;
+        pg_shard *shard = STATUS_IS1(STATUS_SHARD) ? &local.shard : A_NULL;
+        if (pg_thread_ctor(&local.compact, app_compact, shard) == A_SUCCESS)
+        {
+            STATUS_SET(STATUS_JOIN);
+        }
+    }
+}
+
+/* writes the rows of the dirty texts in one transaction, a row that another process wrote since it was read is read again */
+static int app_flush(void)
+{
+    if (local.dirty.count == 0) { return A_SUCCESS; }
+    PG_STATS_BEGIN(t);
+    pg_sqlite_rows rows;
+    int ok = pg_sqlite_rows_ctor(&rows, local.db);
+    if (ok != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", local.fname, sqlite3_errmsg(local.db));
+        return A_FAILURE;
+    }
+    ok = sqlite3_exec(local.db, "BEGIN IMMEDIATE;", 0, 0, 0);
+    pg_tree_foreach(cur, &local.dirty)
+    {
+        if (ok != SQLITE_OK) { break; }
+        pg_item *mark = pg_tree_entry(cur);
+        pg_item const *ver = pg_tree_get(&local.version, mark->text);
+        a_i64 version = ver ? ver->time : 0;
+        pg_item *item = pg_tree_get(&local.tree, mark->text);
+        if (item) { ok = pg_sqlite_put(&rows, item, &version); }
+        else if ((ok = pg_sqlite_drop(&rows, mark->text, version)) == SQLITE_OK) { version = 0; }
+        if (ok == SQLITE_CONSTRAINT)
+        {
+            /* the other change wins, this one is reported and the row is taken as it is now */
+            app_log3(local.fname, TEXT_YELLOW, s_conflict, mark->text);
+            if (item) { app_drop(item); }
+            ok = pg_sqlite_get(&rows, &local.tree, mark->text, &version);
+            if (ok == SQLITE_NOTFOUND)
+            {
+                if (item) { pg_tree_free(&local.tree, pg_tree_del(&local.tree, mark->text)); }
+                version = 0;
+                ok = SQLITE_OK;
+            }
+            STATUS_CLR(STATUS_FUZZY);
+        }
+        /* the versions are kept only once the transaction commits */
+        mark->time = version;
+    }
+    pg_sqlite_rows_dtor(&rows);
+    if (ok == SQLITE_OK) { ok = sqlite3_exec(local.db, "COMMIT;", 0, 0, 0); }
+    if (ok != SQLITE_OK)
+    {
+        sqlite3_exec(local.db, "ROLLBACK;", 0, 0, 0);
+        fprintf(stderr, "%s: %s\n", local.fname, sqlite3_errmsg(local.db));
+        return A_FAILURE;
+    }
+    pg_tree_foreach(cur, &local.dirty)
+    {
+        pg_item const *mark = pg_tree_entry(cur);
+        if (mark->time)
+        {
+            pg_item *ver = pg_tree_add(&local.version, mark->text);
+            if (ver) { ver->time = mark->time; }
+        }
+        else
+        {
+            pg_item *ver = pg_tree_del(&local.version, mark->text);
+            if (ver) { pg_tree_free(&local.version, ver); }
+        }
+    }
+    pg_tree_dtor(&local.dirty);
+    pg_tree_ctor(&local.dirty);
+    PG_STATS_END(PG_STATS_SAVE, t);
+    return A_SUCCESS;
+}
+
+/* opens the journal for a change, a command that only reads creates none */
+static int app_journal(void)
+{
+    if (STATUS_IS1(STATUS_PGJ)) { return A_SUCCESS; }
+    if (pg_pgj_open(&local.pgj, a_str_ptr(&local.jname), 1)) { return A_FAILURE; }
+    STATUS_SET(STATUS_PGJ);
+    return A_SUCCESS;
+}
+
+static void app_init_pgj(char const *fname)
+{
+    a_str_ctor(&local.jname);
+    /* the agent opens the journal with the working directory of a client, so its name is absolute */
+#if defined(_WIN32)
+    char full[_MAX_PATH];
+    if (_fullpath(full, fname, sizeof(full))) { fname = full; }
+#else /* !_WIN32 */
+    char cwd[4096];
+    if (fname[0] != '/' && getcwd(cwd, sizeof(cwd)))
+    {
+        a_str_cats(&local.jname, cwd);
+        a_str_cats(&local.jname, "/");
+    }
 #endif /* _WIN32 */
+    a_str_cats(&local.jname, fname);
+    a_str_cats(&local.jname, ".pgj");
+    if (local.db)
+    {
+        /* a database vault writes its own rows, a journal left from before is folded into it at once */
+        pg_tree put, del;
+        if (pg_pgj_replay(a_str_ptr(&local.jname), &local.tree, A_NULL, ~(a_u64)0, A_NULL) != A_SUCCESS)
+        {
+            fprintf(stderr, "%s: invalid journal\n", a_str_ptr(&local.jname));
+            exit(EXIT_FAILURE);
+        }
+        pg_tree_ctor(&put);
+        pg_tree_ctor(&del);
+        pg_pgj_replay(a_str_ptr(&local.jname), &put, &del, ~(a_u64)0, A_NULL);
+        pg_tree_foreach(cur, &put) { pg_tree_add(&local.dirty, pg_tree_entry(cur)->text); }
+        pg_tree_foreach(cur, &del) { pg_tree_add(&local.dirty, pg_tree_entry(cur)->text); }
+        pg_tree_dtor(&del);
+        pg_tree_dtor(&put);
+        if (pg_io_size(a_str_ptr(&local.jname)) >= 0 && app_flush() == A_SUCCESS) { remove(a_str_ptr(&local.jname)); }
+        return;
+    }
+    if (pg_io_size(a_str_ptr(&local.jname)) < 0) { return; }
+    /* the journal is locked while it is read, so no record of another process is read half written */
+    int ok = pg_pgj_open(&local.pgj, a_str_ptr(&local.jname), 0);
+    if (ok == A_SUCCESS)
+    {
+        STATUS_SET(STATUS_PGJ);
+        if ((ok = pg_pgj_lock(&local.pgj)) == A_SUCCESS)
+        {
+            pg_tree *const gone = STATUS_IS1(STATUS_LAZY) ? &local.gone : A_NULL;
+            ok = pg_pgj_replay(a_str_ptr(&local.jname), &local.tree, gone, local.pgj.size, A_NULL);
+            pg_pgj_unlock(&local.pgj);
+        }
+    }
+    if (ok != A_SUCCESS)
+    {
+        fprintf(stderr, "%s: invalid journal\n", a_str_ptr(&local.jname));
+        exit(EXIT_FAILURE);
+    }
+}
 
-    free(out);
+/* marks a text to be written by the next sync, or the whole vault when out of memory */
+static void app_mark(char const *text)
+{
+    if (!pg_tree_add(&local.dirty, text)) { STATUS_SET(STATUS_DUMP); }
+}
 
+/* marks the row of a database vault, or appends a change to the journal, or marks it when the append fails */
+static void app_put(pg_item const *item)
+{
+    STATUS_CLR(STATUS_FUZZY);
+    if (local.db || app_journal() || pg_pgj_put(&local.pgj, item)) { app_mark(item->text); }
+}
+
+static void app_del(char const *text)
+{
+    STATUS_CLR(STATUS_FUZZY);
+    if (STATUS_IS1(STATUS_LAZY) && !pg_tree_add(&local.gone, text)) { STATUS_SET(STATUS_DUMP); }
+    if (local.db || app_journal() || pg_pgj_del(&local.pgj, text)) { app_mark(text); }
+}
+
+/* copies the record of text from the mapping to the tree, so a change of it goes on as if the vault was loaded */
+static void app_fault(char const *text)
+{
+    if (STATUS_IS0(STATUS_LAZY) || pg_tree_get(&local.tree, text) || pg_tree_get(&local.gone, text)) { return; }
+    a_size const idx = pg_pgb_find(&local.pgb, text);
+    if (idx >= local.pgb.count) { return; }
+    pg_view view;
+    a_i64 const time = pg_pgb_view(&local.pgb, idx, &view);
+    pg_item *ctx = pg_tree_add(&local.tree, text);
+    if (ctx && pg_tree_set(&local.tree, ctx, &view) == A_SUCCESS) { pg_tree_time(&local.tree, ctx, time); }
+    else if (ctx) { pg_tree_free(&local.tree, pg_tree_del(&local.tree, text)); }
+}
+
+/* loads the records of the mapping under the ones the tree holds, before a command reads the whole vault */
+static int app_load(void)
+{
+    if (STATUS_IS0(STATUS_LAZY)) { return A_SUCCESS; }
+    pg_tree tree;
+    pg_tree_ctor(&tree);
+    /* a failure leaves the mapping in place, so no command works on a part of the vault */
+    if (pg_pgb_out(&local.pgb, &tree) != A_SUCCESS)
+    {
+        pg_tree_dtor(&tree);
+        fprintf(stderr, "%s: invalid binary vault\n", local.fname);
+        return A_FAILURE;
+    }
+    pg_tree_foreach(cur, &local.gone)
+    {
+        pg_item *it = pg_tree_del(&tree, pg_tree_entry(cur)->text);
+        if (it) { pg_tree_free(&tree, it); }
+    }
+    pg_tree_foreach(cur, &local.tree)
+    {
+        pg_item *it = pg_tree_del(&tree, pg_tree_entry(cur)->text);
+        if (it) { pg_tree_free(&tree, it); }
+    }
+    pg_tree_merge(&local.tree, &tree);
+    pg_tree_dtor(&tree);
+    pg_tree_dtor(&local.gone);
+    pg_tree_ctor(&local.gone);
+    pg_pgb_close(&local.pgb);
+    STATUS_CLR(STATUS_LAZY);
     return A_SUCCESS;
 }
 
+void app_lazy(int on)
+{
+    local.lazy = on;
+}
+
+void app_resident(int on)
+{
+    local.resident = on;
+}
+
+/* packs the strings of the tree once the dead ones outweigh the live ones, counted each time the pool doubles */
+static void app_pack(void)
+{
+    pg_pool const *data = &local.tree.data;
+    if (!local.resident || data->size <= local.packed << 1) { return; }
+    a_size live = 0;
+    pg_tree_foreach(cur, &local.tree)
+    {
+        pg_item const *it = pg_tree_entry(cur);
+        live += it->ltext + 1;
+        if (it->hint) { live += strlen(it->hint) + 1; }
+        if (it->misc) { live += strlen(it->misc) + 1; }
+    }
+    if (data->size - live > live) { pg_tree_pack(&local.tree); }
+    local.packed = data->size;
+}
+
 int app_init(char const *fname, a_str const *code, a_str const *rule, int flag)
 {
     if (STATUS_IS1(STATUS_INIT))
@@ -151,34 +628,182 @@ int app_init(char const *fname, a_str const *code, a_str const *rule, int flag)
     sqlite3_initialize();
     STATUS_CLR(STATUS_DONE);
 
-    int ok = sqlite3_open(fname, &local.db);
-    if (ok != SQLITE_OK)
+    int ok = SQLITE_OK;
+    pg_tree_ctor(&local.tree);
+    pg_tree_ctor(&local.dirty);
+    pg_tree_ctor(&local.version);
+    pg_tree_ctor(&local.gone);
+    int const shard = pg_shard_open(&local.shard, fname, local.nshard);
+    if (shard != A_SUCCESS && shard != A_FAILURE)
     {
-        fprintf(stderr, "%s\n", sqlite3_errmsg(local.db));
+        fprintf(stderr, "%s: invalid sharded vault\n", fname);
         exit(EXIT_FAILURE);
     }
+    if (shard == A_SUCCESS)
+    {
+        STATUS_SET(STATUS_SHARD);
+        if (pg_shard_out(&local.shard, &local.tree) != A_SUCCESS)
+        {
+            fprintf(stderr, "%s: invalid sharded vault\n", fname);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (app_pgb(fname))
+    {
+        if (app_init_pgb(fname) != A_SUCCESS)
+        {
+            fprintf(stderr, "%s: invalid binary vault\n", fname);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        PG_STATS_BEGIN(t);
+        ok = sqlite3_open(fname, &local.db);
+        if (ok != SQLITE_OK)
+        {
+            fprintf(stderr, "%s\n", sqlite3_errmsg(local.db));
+            exit(EXIT_FAILURE);
+        }
+        /* other processes may share the vault, each writes only the rows it changed */
+        sqlite3_busy_timeout(local.db, APP_BUSY);
+        pg_sqlite_wal(local.db);
+        pg_sqlite_create(local.db);
+        PG_STATS_END(PG_STATS_OPEN, t);
+        pg_sqlite_out(local.db, &local.tree);
+        pg_sqlite_version(local.db, &local.version);
+    }
 
     local.fname = fname;
-    pg_sqlite_init(local.db);
+    app_init_pgj(fname);
+    app_compact_start();
+    a_str_ctor(&local.rule);
+    a_str_ctor(&local.stat);
     STATUS_SET(STATUS_INIT);
 
-    pg_tree_ctor(&local.tree);
+    app_conf(code, rule, flag);
 
-    pg_sqlite_out(local.db, &local.tree);
+    return ok;
+}
 
-    if (a_str_len(code))
-    {
-        local.code = a_str_ptr(code);
-    }
+void app_shards(unsigned int num)
+{
+    local.nshard = num;
+}
 
-    if (a_str_len(rule) && pg_init(a_str_ptr(rule), ",") > 2)
+void app_conf(a_str const *code, a_str const *rule, int flag)
+{
+    local.code = a_str_len(code) ? a_str_ptr(code) : 0;
+
+    /* pg_init splits the rule in place and keeps pointers into it */
+    if (a_str_cmp(&local.rule, rule) || !a_str_ptr(&local.stat))
     {
-        STATUS_SET(STATUS_ISV2);
+        a_str_setn_(&local.rule, 0);
+        a_str_cat(&local.rule, rule);
+        a_str_setn_(&local.stat, 0);
+        a_str_cat(&local.stat, rule);
+        local.nrule = pg_init(a_str_ptr(&local.stat), ",");
     }
+
+    STATUS_CLR(STATUS_ISV2);
+    if (local.nrule > 2) { STATUS_SET(STATUS_ISV2); }
     if (flag & (1 << 8)) { STATUS_CLR(STATUS_ISV2); }
     if (flag & (1 << 9)) { STATUS_SET(STATUS_ISV2); }
 
-    return ok;
+    /* passwords of other code or rules are of no more use, so they go at once */
+    pg_view view;
+    a_byte epoch[PG_CACHE_KEY];
+    pg_view_ctor(&view);
+    pg_cache_key(epoch, &view, local.code, a_str_ptr(&local.rule), app_version());
+    if (memcmp(epoch, local.epoch, sizeof(epoch)))
+    {
+        a_copy(local.epoch, epoch, sizeof(epoch));
+        if (STATUS_IS1(STATUS_CACHE)) { pg_cache_clear(&local.cache); }
+    }
+}
+
+void app_sync(void)
+{
+    app_pack();
+    if (STATUS_IS1(STATUS_DUMP))
+    {
+        int ok = A_SUCCESS;
+        PG_STATS_BEGIN(t);
+        /* the vault is rewritten from the tree, which holds the whole journal */
+        if (app_load() != A_SUCCESS) { return; }
+        app_compact_join();
+        int const lock = !local.db && app_journal() == A_SUCCESS && pg_pgj_lock(&local.pgj) == A_SUCCESS;
+        if (STATUS_IS1(STATUS_SHARD))
+        {
+            if ((ok = pg_shard_save(&local.shard, &local.tree, A_NULL)) != A_SUCCESS)
+            {
+                fprintf(stderr, "%s: failed to write sharded vault\n", local.fname);
+            }
+        }
+        else if (local.db)
+        {
+            /* only when a change could not be marked, every row is raised past the versions other processes read */
+            ok = sqlite3_exec(local.db, "BEGIN IMMEDIATE;", 0, 0, 0);
+            if (ok == SQLITE_OK) { ok = pg_sqlite_rewrite(local.db, &local.tree); }
+            if (ok == SQLITE_OK) { ok = sqlite3_exec(local.db, "COMMIT;", 0, 0, 0); }
+            if (ok == SQLITE_OK)
+            {
+                pg_tree_dtor(&local.dirty);
+                pg_tree_ctor(&local.dirty);
+                pg_tree_dtor(&local.version);
+                pg_tree_ctor(&local.version);
+                pg_sqlite_version(local.db, &local.version);
+            }
+            else
+            {
+                fprintf(stderr, "%s: %s\n", local.fname, sqlite3_errmsg(local.db));
+                sqlite3_exec(local.db, "ROLLBACK;", 0, 0, 0);
+            }
+        }
+        else if ((ok = pg_pgb_dump(local.fname, &local.tree)) != A_SUCCESS)
+        {
+            fprintf(stderr, "%s: failed to write binary vault\n", local.fname);
+        }
+        if (lock)
+        {
+            if (ok == A_SUCCESS) { pg_pgj_drop(&local.pgj, local.pgj.size); }
+            pg_pgj_unlock(&local.pgj);
+        }
+        if (ok == A_SUCCESS && !local.db)
+        {
+            pg_tree_dtor(&local.dirty);
+            pg_tree_ctor(&local.dirty);
+        }
+        STATUS_CLR(STATUS_DUMP);
+        PG_STATS_END(PG_STATS_SAVE, t);
+    }
+    else if (local.db) { app_flush(); }
+    else if (local.dirty.count)
+    {
+        int ok = A_FAILURE;
+        PG_STATS_BEGIN(t);
+        /* the changes that are not in the journal are written with the ones other processes appended */
+        app_compact_join();
+        if (app_journal() == A_SUCCESS && pg_pgj_lock(&local.pgj) == A_SUCCESS)
+        {
+            ok = app_fold(&local.pgj, &local.dirty, STATUS_IS1(STATUS_SHARD) ? &local.shard : A_NULL);
+            pg_pgj_unlock(&local.pgj);
+        }
+        if (ok == A_SUCCESS)
+        {
+            pg_tree_dtor(&local.dirty);
+            pg_tree_ctor(&local.dirty);
+        }
+        else { fprintf(stderr, "%s: failed to write vault\n", local.fname); }
+        PG_STATS_END(PG_STATS_SAVE, t);
+    }
+    else if (STATUS_IS1(STATUS_PGJ))
+    {
+        PG_STATS_BEGIN(t);
+        pg_pgj_sync(&local.pgj);
+        PG_STATS_END(PG_STATS_SAVE, t);
+        app_compact_start();
+    }
 }
 
 int app_exit(void)
@@ -188,18 +813,42 @@ int app_exit(void)
         return A_FAILURE;
     }
 
-    if (STATUS_IS1(STATUS_DUMP))
+    app_sync();
+    app_compact_join();
+
+    if (STATUS_IS1(STATUS_LAZY))
     {
-        pg_sqlite_delete(local.db);
-        pg_sqlite_create(local.db);
-        pg_sqlite_add(local.db, &local.tree);
-        STATUS_CLR(STATUS_DUMP);
+        pg_pgb_close(&local.pgb);
+        STATUS_CLR(STATUS_LAZY);
     }
 
-    pg_sqlite_exit(local.db);
-    sqlite3_close(local.db);
+    if (STATUS_IS1(STATUS_PGJ))
+    {
+        pg_pgj_close(&local.pgj);
+        STATUS_CLR(STATUS_PGJ);
+    }
+    if (STATUS_IS1(STATUS_SHARD))
+    {
+        pg_shard_close(&local.shard);
+        STATUS_CLR(STATUS_SHARD);
+    }
+    if (local.db)
+    {
+        sqlite3_close(local.db);
+        local.db = 0;
+    }
     STATUS_CLR(STATUS_INIT);
 
+    STATUS_CLR(STATUS_FUZZY);
+    pg_fuzzy_exit(&local.fuzzy);
+    if (STATUS_IS1(STATUS_CACHE)) { pg_cache_exit(&local.cache); }
+    STATUS_CLR(STATUS_CACHE);
+    a_str_dtor(&local.jname);
+    a_str_dtor(&local.rule);
+    a_str_dtor(&local.stat);
+    pg_tree_dtor(&local.gone);
+    pg_tree_dtor(&local.version);
+    pg_tree_dtor(&local.dirty);
     pg_tree_dtor(&local.tree);
     STATUS_SET(STATUS_DONE);
 
@@ -209,30 +858,29 @@ int app_exit(void)
 int app_create(a_vec const *item)
 {
     int ok = A_FAILURE;
-    a_vec_foreach(pg_item, *, it, item)
+    a_vec_foreach(pg_view, *, it, item)
     {
-        if (a_str_len(it->misc) == 0 && it->type == PG_TYPE_OTHER)
+        if ((it->misc == 0 || *it->misc == 0) && it->type == PG_TYPE_OTHER)
         {
             app_log3(local.fname, TEXT_RED, s_missing, "-m");
             break;
         }
-        if (a_str_len(it->text) == 0)
+        if (it->text == 0 || *it->text == 0)
         {
             app_log3(local.fname, TEXT_RED, s_missing, "-g");
             break;
         }
-        char const *text = a_str_ptr(it->text);
+        char const *text = it->text;
+        app_fault(text);
         pg_item *ctx = pg_tree_add(&local.tree, text);
-        if (ctx)
+        if (ctx) { app_drop(ctx); }
+        if (ctx && pg_tree_set(&local.tree, ctx, it) == A_SUCCESS)
         {
-            STATUS_SET(STATUS_DUMP);
-            ctx->time = time(NULL) + A_I32_MIN;
-            pg_item_set_hash2(ctx, it->hash);
-            pg_item_set_hint2(ctx, it->hint);
-            pg_item_set_misc2(ctx, it->misc);
-            pg_item_set_type(ctx, it->type);
-            pg_item_set_size(ctx, it->size);
-            ok = app_gen(ctx, local.code);
+            pg_view view;
+            pg_tree_time(&local.tree, ctx, time(NULL) + A_I32_MIN);
+            app_put(ctx);
+            pg_item_view(ctx, &view);
+            ok = app_gen(&view, local.code);
         }
         else
         {
@@ -242,33 +890,156 @@ int app_create(a_vec const *item)
     return ok;
 }
 
+static int app_match(pg_item const *it, a_vec const *item)
+{
+    int matched = (int)a_vec_num(item);
+    a_vec_foreach(pg_view, *, at, item)
+    {
+        if (at->text && *at->text && !strstr(it->text, at->text)) { matched = 0; }
+    }
+    return matched;
+}
+
+typedef struct app_hit
+{
+    pg_item const *item;
+    a_size index; /*!< position in its range */
+} app_hit;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct app_scan
+{
+    pg_mutex lock;
+    pg_span *span; /*!< count becomes the real number of records once a range is walked */
+    a_vec *hit; /*!< matches of every range */
+    a_vec const *item;
+    a_size num;
+    a_size next; /*!< next range to take */
+    int ok;
+} app_scan;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+static void *app_scan_(void *arg)
+{
+    app_scan *ctx = (app_scan *)arg;
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        a_size const i = ctx->next++;
+        pg_mutex_unlock(&ctx->lock);
+        if (i >= ctx->num) { break; }
+        a_size idx = 0;
+        int ok = A_SUCCESS;
+        pg_span_foreach(cur, ctx->span + i)
+        {
+            pg_item const *it = pg_tree_entry(cur);
+            if (app_match(it, ctx->item))
+            {
+                app_hit *hit = A_VEC_PUSH(app_hit, ctx->hit + i);
+                if (hit)
+                {
+                    hit->item = it;
+                    hit->index = idx;
+                }
+                else { ok = A_OMEMORY; }
+            }
+            ++idx;
+        }
+        ctx->span[i].count = idx;
+        if (ok)
+        {
+            pg_mutex_lock(&ctx->lock);
+            ctx->ok = ok;
+            pg_mutex_unlock(&ctx->lock);
+        }
+    }
+    return A_NULL;
+}
+
+/*
+ walks ranges of the tree on up to one thread per processor, then prints the matches in order,
+ nothing changes the tree while a command runs, so the workers read it without a snapshot
+*/
+static int app_search_scan(a_vec const *item)
+{
+    a_size const jobs = pg_thread_cpus();
+    if (jobs < 2 || local.tree.count < APP_SCAN) { return A_FAILURE; }
+    /* more ranges than threads, so that a thread with a small one takes another */
+    a_size num = jobs * 4;
+    app_scan ctx;
+    ctx.span = (pg_span *)a_alloc(A_NULL, sizeof(pg_span) * num);
+    ctx.hit = (a_vec *)a_alloc(A_NULL, sizeof(a_vec) * num);
+    pg_thread *worker = (pg_thread *)a_alloc(A_NULL, sizeof(pg_thread) * jobs);
+    if (!ctx.span || !ctx.hit || !worker)
+    {
+        a_die(worker);
+        a_die(ctx.hit);
+        a_die(ctx.span);
+        return A_OMEMORY;
+    }
+    num = pg_tree_split(&local.tree, ctx.span, num);
+    for (a_size i = 0; i != num; ++i) { a_vec_ctor(ctx.hit + i, sizeof(app_hit)); }
+    pg_mutex_ctor(&ctx.lock);
+    ctx.item = item;
+    ctx.num = num;
+    ctx.next = 0;
+    ctx.ok = A_SUCCESS;
+    a_size n = 0;
+    /* the calling thread is one of the workers */
+    for (; n + 1 < jobs; ++n)
+    {
+        if (pg_thread_ctor(worker + n, app_scan_, &ctx)) { break; }
+    }
+    app_scan_(&ctx);
+    while (n) { pg_thread_join(worker + --n); }
+    pg_mutex_dtor(&ctx.lock);
+    a_size base = 0;
+    for (a_size i = 0; i != num; ++i)
+    {
+        a_vec_foreach(app_hit, *, it, ctx.hit + i)
+        {
+            if (ctx.ok == A_SUCCESS) { app_item(base + it->index, it->item); }
+        }
+        base += ctx.span[i].count;
+        a_vec_dtor(ctx.hit + i, A_NULL);
+    }
+    a_die(worker);
+    a_die(ctx.hit);
+    a_die(ctx.span);
+    return ctx.ok;
+}
+
 void app_search(a_vec const *item)
 {
+    if (app_load() != A_SUCCESS) { return; }
+    if (app_search_scan(item) == A_SUCCESS) { return; }
     size_t idx = 0;
     pg_tree_foreach(cur, &local.tree)
     {
         pg_item *it = pg_tree_entry(cur);
-        int matched = (int)a_vec_num(item);
-        char const *text = a_str_ptr(it->text);
-        a_vec_foreach(pg_item, *, at, item)
-        {
-            if (a_str_len(at->text) && !strstr(text, a_str_ptr(at->text))) { matched = 0; }
-        }
-        if (matched) { app_item(idx, it); }
+        if (app_match(it, item)) { app_item(idx, it); }
         ++idx;
     }
 }
 
 void app_search_n(a_vec const *item)
 {
+    if (app_load() != A_SUCCESS) { return; }
     a_vec number;
     a_vec_ctor(&number, sizeof(unsigned int));
-    a_vec_foreach(pg_item, *, it, item)
+    a_vec_foreach(pg_view, *, it, item)
     {
-        if (a_str_len(it->text))
+        if (it->text && *it->text)
         {
             char *p = 0;
-            char const *s = a_str_ptr(it->text);
+            char const *s = it->text;
             unsigned long x = strtoul(s, &p, 0);
             if (s == p)
             {
@@ -297,22 +1068,112 @@ void app_search_n(a_vec const *item)
     a_vec_dtor(&number, 0);
 }
 
+/* the index for fuzzy search is built on first use and again after a change */
+static int app_fuzzy(void)
+{
+    if (STATUS_IS1(STATUS_FUZZY)) { return A_SUCCESS; }
+    pg_fuzzy_exit(&local.fuzzy);
+    if (pg_fuzzy_init(&local.fuzzy, &local.tree) == A_SUCCESS)
+    {
+        STATUS_SET(STATUS_FUZZY);
+        return A_SUCCESS;
+    }
+    app_log3(local.fname, TEXT_RED, s_failure, "fuzzy");
+    return A_FAILURE;
+}
+
+int app_search_fuzzy(a_vec const *item, a_size k)
+{
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
+    if (app_fuzzy()) { return A_FAILURE; }
+    int ok = A_SUCCESS, first = 1;
+    a_vec hits, next;
+    a_vec_ctor(&hits, sizeof(pg_fuzzy_hit));
+    a_vec_ctor(&next, sizeof(pg_fuzzy_hit));
+    a_vec_foreach(pg_view, *, at, item)
+    {
+        if (!at->text || !*at->text) { continue; }
+        a_vec_setn(&next, 0, 0);
+        /* later texts only check the hits of the earlier ones */
+        ok = pg_fuzzy_find(&local.fuzzy, at->text, k, first ? A_NULL : &hits, &next, A_NULL, A_NULL);
+        if (ok) { break; }
+        if (!first)
+        {
+            /* next keeps the order of hits, so the distances add up in one pass */
+            pg_fuzzy_hit const *h = A_VEC_PTR(pg_fuzzy_hit, &hits);
+            a_vec_foreach(pg_fuzzy_hit, *, it, &next)
+            {
+                while (h->index != it->index) { ++h; }
+                it->dist += h->dist;
+            }
+        }
+        a_vec_swap(&hits, &next);
+        first = 0;
+    }
+    if (ok) { app_log3(local.fname, TEXT_RED, s_failure, "fuzzy"); }
+    else if (first) { app_search(item); }
+    else
+    {
+        pg_fuzzy_rank(&hits);
+        a_vec_foreach(pg_fuzzy_hit, *, it, &hits) { app_item(it->index, it->item); }
+    }
+    a_vec_dtor(&next, 0);
+    a_vec_dtor(&hits, 0);
+    return ok;
+}
+
+/* the index by time is built on first use, the agent then keeps it in sync */
+static int app_when(void)
+{
+    if (pg_tree_when(&local.tree) == A_SUCCESS) { return A_SUCCESS; }
+    app_log3(local.fname, TEXT_RED, s_failure, "time");
+    return A_FAILURE;
+}
+
+int app_older(a_i64 age)
+{
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
+    if (app_when()) { return A_FAILURE; }
+    a_i64 const limit = time(NULL) + A_I32_MIN - age;
+    pg_when_foreach(cur, &local.tree)
+    {
+        pg_item *it = pg_when_entry(cur);
+        if (it->time >= limit) { break; }
+        app_item_time(it);
+    }
+    return A_SUCCESS;
+}
+
+int app_recent(a_size num)
+{
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
+    if (app_when()) { return A_FAILURE; }
+    pg_when_foreach_reverse(cur, &local.tree)
+    {
+        if (num-- == 0) { break; }
+        app_item_time(pg_when_entry(cur));
+    }
+    return A_SUCCESS;
+}
+
 int app_delete(a_vec const *item)
 {
     int ok = A_FAILURE;
-    a_vec_foreach(pg_item, *, it, item)
+    a_vec_foreach(pg_view, *, it, item)
     {
         char const *text = "";
-        if (a_str_len(it->text))
+        if (it->text)
         {
-            text = a_str_ptr(it->text);
+            text = it->text;
         }
+        app_fault(text);
         pg_item *ctx = pg_tree_del(&local.tree, text);
         if (ctx)
         {
-            STATUS_SET(STATUS_DUMP);
+            app_drop(ctx);
+            app_del(text);
             app_log3(local.fname, TEXT_GREEN, s_success, text);
-            pg_item_die(ctx);
+            pg_tree_free(&local.tree, ctx);
             ok = A_SUCCESS;
         }
         else
@@ -326,6 +1187,7 @@ int app_delete(a_vec const *item)
 
 int app_delete_n(a_vec const *item)
 {
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
     struct pg_deleted
     {
         a_size index;
@@ -336,12 +1198,12 @@ int app_delete_n(a_vec const *item)
     a_vec_ctor(&number, sizeof(unsigned int));
     a_vec_ctor(&deleted, sizeof(struct pg_deleted));
 
-    a_vec_foreach(pg_item, *, it, item)
+    a_vec_foreach(pg_view, *, it, item)
     {
-        if (a_str_len(it->text))
+        if (it->text && *it->text)
         {
             char *p = 0;
-            char const *s = a_str_ptr(it->text);
+            char const *s = it->text;
             unsigned long x = strtoul(s, &p, 0);
             if (s == p)
             {
@@ -376,10 +1238,11 @@ int app_delete_n(a_vec const *item)
 
     a_vec_foreach(struct pg_deleted, *, it, &deleted)
     {
-        STATUS_SET(STATUS_DUMP);
+        app_drop(it->item);
+        app_del(it->item->text);
         pg_tree_remove(&local.tree, it->item);
         app_item(it->index, it->item);
-        pg_item_die(it->item);
+        pg_tree_free(&local.tree, it->item);
         ok = A_SUCCESS;
     }
 
@@ -393,7 +1256,7 @@ int app_exec(a_vec const *item)
     int ok = A_FAILURE;
     if (local.code)
     {
-        a_vec_foreach(pg_item, *, it, item)
+        a_vec_foreach(pg_view, *, it, item)
         {
             ok = app_gen(it, local.code);
         }
@@ -407,6 +1270,7 @@ int app_exec(a_vec const *item)
 
 int app_exec_n(a_vec const *item)
 {
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
     int ok = A_FAILURE;
 
     a_vec number;
@@ -424,12 +1288,12 @@ int app_exec_n(a_vec const *item)
         goto exit;
     }
 
-    a_vec_foreach(pg_item, *, it, item)
+    a_vec_foreach(pg_view, *, it, item)
     {
-        if (a_str_len(it->text))
+        if (it->text && *it->text)
         {
             char *p = 0;
-            char const *s = a_str_ptr(it->text);
+            char const *s = it->text;
             unsigned long x = strtoul(s, &p, 0);
             if (s == p)
             {
@@ -453,7 +1317,9 @@ int app_exec_n(a_vec const *item)
         {
             if (*n == index)
             {
-                ok = app_gen(it, local.code);
+                pg_view view;
+                pg_item_view(it, &view);
+                ok = app_gen(&view, local.code);
                 break;
             }
         }
@@ -469,21 +1335,35 @@ static int app_import_(pg_tree *tree, char const *fname)
 {
     int ok;
 
-    cJSON *json = pg_json_load(fname);
-    if (json)
+    if (app_pgb(fname))
     {
-        ok = pg_json_export(json, tree);
-        pg_json_die(json);
+        pg_pgb pgb;
+        ok = pg_pgb_open(&pgb, fname);
+        if (ok == A_SUCCESS)
+        {
+            ok = pg_pgb_out(&pgb, tree);
+            pg_pgb_close(&pgb);
+        }
         return ok;
     }
 
+    if (pg_json_read(fname, tree) == A_SUCCESS)
+    {
+        return A_SUCCESS;
+    }
+    pg_tree_dtor(tree);
+    pg_tree_ctor(tree);
+
     sqlite3 *db = 0;
     ok = sqlite3_open(fname, &db);
     if (ok == SQLITE_OK)
     {
-        return pg_sqlite_out(db, tree);
+        ok = pg_sqlite_out(db, tree);
+    }
+    if (ok != SQLITE_OK)
+    {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(db));
     }
-    fprintf(stderr, "%s\n", sqlite3_errmsg(db));
     sqlite3_close(db);
 
     return ok;
@@ -508,60 +1388,535 @@ static int app_export_(pg_tree *tree, char const *fname)
         return ok;
     }
 
-    cJSON *json = pg_json_new();
-    pg_json_import(json, tree);
-    ok = pg_json_dump(json, fname);
+    if (app_pgb(fname))
+    {
+        return pg_pgb_dump(fname, tree);
+    }
 
-    return ok;
+    return pg_json_write(fname, tree);
 }
 
-int app_convert(char const *in, char const *out)
+typedef struct app_parse
 {
-    int ok;
+    pg_mutex lock;
+    char const *const *fname;
+    pg_tree *tree;
+    int *ok;
+    a_size num;
+    a_size next; /*!< next file to take */
+} app_parse;
+
+static void *app_parse_(void *arg)
+{
+    app_parse *ctx = (app_parse *)arg;
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        a_size const i = ctx->next++;
+        pg_mutex_unlock(&ctx->lock);
+        if (i >= ctx->num) { break; }
+        ctx->ok[i] = app_import_(ctx->tree + i, ctx->fname[i]);
+    }
+    return A_NULL;
+}
+
+/* parses every file into a tree of its own, with up to one thread per processor */
+static int app_parse_n(char const *const *fname, a_size num, pg_tree **tree, int **ok)
+{
+    *tree = (pg_tree *)a_alloc(A_NULL, sizeof(pg_tree) * num);
+    *ok = (int *)a_alloc(A_NULL, sizeof(int) * num);
+    if (!*tree || !*ok)
+    {
+        a_die(*tree);
+        a_die(*ok);
+        return A_OMEMORY;
+    }
+    app_parse ctx;
+    pg_mutex_ctor(&ctx.lock);
+    ctx.fname = fname;
+    ctx.tree = *tree;
+    ctx.ok = *ok;
+    ctx.num = num;
+    ctx.next = 0;
+    for (a_size i = 0; i != num; ++i) { pg_tree_ctor(ctx.tree + i); }
+
+    a_size jobs = pg_thread_cpus();
+    if (jobs > num) { jobs = num; }
+    pg_thread *worker = (pg_thread *)a_alloc(A_NULL, sizeof(pg_thread) * jobs);
+    a_size n = 0;
+    /* the calling thread is one of the workers */
+    for (; worker && n + 1 < jobs; ++n)
+    {
+        if (pg_thread_ctor(worker + n, app_parse_, &ctx)) { break; }
+    }
+    app_parse_(&ctx);
+    while (n) { pg_thread_join(worker + --n); }
+    a_die(worker);
+    pg_mutex_dtor(&ctx.lock);
+    return A_SUCCESS;
+}
+
+static void app_parse_free(pg_tree *tree, int *ok, a_size num)
+{
+    for (a_size i = 0; i != num; ++i) { pg_tree_dtor(tree + i); }
+    a_die(tree);
+    a_die(ok);
+}
+
+int app_convert(char const *const *in, a_size num, char const *out)
+{
+    pg_tree *trees;
+    int *oks;
+    int ok = app_parse_n(in, num, &trees, &oks);
+    if (ok) { return ok; }
     pg_tree tree;
     pg_tree_ctor(&tree);
-    ok = app_import_(&tree, in);
-    if (ok) { goto exit; }
-    ok = app_export_(&tree, out);
-    if (ok) { goto exit; }
-exit:
+    for (a_size i = 0; i != num; ++i)
+    {
+        if (oks[i])
+        {
+            app_log3(out, TEXT_RED, s_failure, in[i]);
+            ok = oks[i];
+        }
+    }
+    if (ok == A_SUCCESS) { ok = pg_tree_merge_n(&tree, trees, num); }
+    if (ok == A_SUCCESS) { ok = app_export_(&tree, out); }
     pg_tree_dtor(&tree);
+    app_parse_free(trees, oks, num);
     return ok;
 }
 
-int app_import(char const *fname)
+/* whether two records of a text hold the same fields */
+static int app_same(pg_item const *a, pg_item const *b)
 {
-    pg_tree tree;
-    pg_tree_ctor(&tree);
-    int ok = app_import_(&tree, fname);
-    if (tree.count && ok == A_SUCCESS)
+    return a->type == b->type && a->hash == b->hash && a->size == b->size &&
+           !strcmp(a->hint ? a->hint : "", b->hint ? b->hint : "") &&
+           !strcmp(a->misc ? a->misc : "", b->misc ? b->misc : "");
+}
+
+int app_import(char const *const *fname, a_size num)
+{
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
+    pg_tree *tree;
+    int *oks;
+    int ok = app_parse_n(fname, num, &tree, &oks);
+    if (ok) { return ok; }
+    a_size count = 0;
+    for (a_size i = 0; i != num; ++i)
     {
-        STATUS_SET(STATUS_DUMP);
-        pg_tree_foreach(cur, &tree)
+        /* a valid file without records imports nothing and still succeeds */
+        if (oks[i] == A_SUCCESS)
         {
-            pg_item *it = pg_tree_entry(cur);
-            pg_item *item = pg_tree_add(&local.tree, a_str_ptr(it->text));
-            if (it->time >= item->time)
-            {
-                pg_item_set_hash2(item, it->hash);
-                pg_item_set_hint2(item, it->hint);
-                pg_item_set_misc2(item, it->misc);
-                pg_item_set_type(item, it->type);
-                pg_item_set_size(item, it->size);
-                item->time = it->time;
-            }
+            count += tree[i].count;
+            continue;
+        }
+        app_log3(local.fname, TEXT_RED, s_failure, fname[i]);
+        if (oks[i]) { ok = oks[i]; }
+        /* a file that failed halfway adds nothing */
+        pg_tree_dtor(tree + i);
+        pg_tree_ctor(tree + i);
+        oks[i] = A_FAILURE;
+    }
+    /* the next sync writes the texts whose record the merge takes, the vault keeps a record that is newer */
+    pg_tree mark;
+    pg_tree_ctor(&mark);
+    for (a_size i = 0; count && i != num; ++i)
+    {
+        pg_tree_foreach(cur, tree + i)
+        {
+            pg_item const *item = pg_tree_entry(cur);
+            pg_item const *old = pg_tree_get(&local.tree, item->text);
+            if (old && (old->time > item->time || (old->time == item->time && app_same(old, item)))) { continue; }
+            if (!pg_tree_add(&mark, item->text)) { STATUS_SET(STATUS_DUMP); }
+        }
+    }
+    /* the runs are merged at once, a text in several files keeps the newest record */
+    if (count == 0 || pg_tree_merge_n(&local.tree, tree, num) == A_SUCCESS)
+    {
+        if (count)
+        {
+            pg_tree_merge(&local.dirty, &mark);
+            STATUS_CLR(STATUS_FUZZY);
+        }
+        for (a_size i = 0; i != num; ++i)
+        {
+            if (oks[i] == A_SUCCESS) { app_log3(local.fname, TEXT_GREEN, s_success, fname[i]); }
         }
-        app_log3(local.fname, TEXT_GREEN, s_success, fname);
     }
     else
     {
-        app_log3(local.fname, TEXT_RED, s_failure, fname);
+        app_log3(local.fname, TEXT_RED, s_failure, "merge");
+        ok = A_OMEMORY;
     }
-    pg_tree_dtor(&tree);
+    pg_tree_dtor(&mark);
+    app_parse_free(tree, oks, num);
     return ok;
 }
 
 int app_export(char const *fname)
 {
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
     return app_export_(&local.tree, fname);
 }
+
+#define BATCH_GEN 0
+#define BATCH_CREATE 1
+#define BATCH_DELETE 2
+#define BATCH_GET 3
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct app_task
+{
+    pg_view view;
+    char *pass; /*!< generated password, wiped once its line is written */
+    char const *error;
+    char const *json; /*!< record that a get found in the snapshot, null when missing */
+    a_u64 version; /*!< version of that snapshot, ~0 when it was not read */
+    size_t line;
+    unsigned int op;
+} app_task;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct app_tasks
+{
+    pg_pool pool;
+    a_vec task;
+    char *rest; /*!< lines left without a task when out of memory, or null */
+    size_t line; /*!< number of the first of them */
+} app_tasks;
+
+/* takes the next line of a block, s == e when it is blank */
+static char *app_batch_line(char *p, char *end, char **s, char **e)
+{
+    char *eol = (char *)memchr(p, '\n', (size_t)(end - p));
+    if (eol == 0) { eol = end; }
+    *s = p;
+    *e = eol;
+    while (*s != *e && isspace((unsigned char)**s)) { ++*s; }
+    while (*e != *s && isspace((unsigned char)(*e)[-1])) { --*e; }
+    return eol == end ? end : eol + 1;
+}
+
+static void app_batch_error(a_str *out, size_t line, char const *text, char const *error)
+{
+    a_str_catf(out, "{\"line\":%zu", line);
+    if (text)
+    {
+        a_str_cats(out, ",\"text\":");
+        pg_json_quote(out, text);
+    }
+    a_str_cats(out, ",\"error\":");
+    pg_json_quote(out, error);
+    a_str_cats(out, "}\n");
+}
+
+/* every line that got no task is answered with a failure, so none goes missing from the output */
+static void app_batch_lost(a_str *out, char *p, char *end, size_t line)
+{
+    for (char *s, *e; p != end; ++line)
+    {
+        p = app_batch_line(p, end, &s, &e);
+        if (s != e) { app_batch_error(out, line, A_NULL, s_failure); }
+    }
+}
+
+static char const *app_batch_str(pg_pool *pool, cJSON const *json, char const *key)
+{
+    char const *str = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, key));
+    return str ? pg_pool_str(pool, str) : A_NULL;
+}
+
+static unsigned int app_batch_num(cJSON const *json, char const *key, unsigned int num)
+{
+    cJSON const *item = cJSON_GetObjectItemCaseSensitive(json, key);
+    return cJSON_IsNumber(item) && item->valuedouble >= 0 ? (unsigned int)item->valuedouble : num;
+}
+
+/* looks a record up without waiting for the changes of earlier lines, done checks that it is still there */
+static void app_batch_get(pg_pool *pool, app_task *task, a_str *buf)
+{
+    pg_cow_snap snap;
+    pg_cow_enter(&local.cow, &snap);
+    /* before the first change the tree itself is read, done waits for such readers before changing it */
+    char const *text = task->view.text;
+    pg_item const *item = snap.version ? pg_cow_get(snap.root, text) : pg_tree_get(&local.tree, text);
+    a_str_setn_(buf, 0);
+    if (item == 0) { task->version = snap.version; }
+    else if (pg_json_item(buf, item) == A_SUCCESS)
+    {
+        task->json = pg_pool_str(pool, a_str_ptr(buf));
+        if (task->json) { task->version = snap.version; }
+    }
+    pg_cow_leave(&local.cow, &snap);
+}
+
+static void app_batch_task(pg_pool *pool, app_task *task, char const *line, size_t size, a_str *buf)
+{
+    cJSON *json = cJSON_ParseWithLength(line, size);
+    char const *op = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "op"));
+    pg_view *view = &task->view;
+    pg_view_ctor(view);
+    task->pass = 0;
+    task->error = 0;
+    task->json = 0;
+    task->version = ~(a_u64)0;
+    if (!cJSON_IsObject(json))
+    {
+        task->error = s_invalid;
+        goto exit;
+    }
+    view->text = app_batch_str(pool, json, "text");
+    if (op == 0 || strcmp(op, "gen") == 0) { task->op = BATCH_GEN; }
+    else if (strcmp(op, "create") == 0) { task->op = BATCH_CREATE; }
+    else if (strcmp(op, "delete") == 0) { task->op = BATCH_DELETE; }
+    else if (strcmp(op, "get") == 0) { task->op = BATCH_GET; }
+    else
+    {
+        task->error = s_invalid;
+        goto exit;
+    }
+    if (view->text == 0 || *view->text == 0)
+    {
+        task->error = "missing text";
+        goto exit;
+    }
+    if (task->op == BATCH_GET) { app_batch_get(pool, task, buf); }
+    if (task->op == BATCH_DELETE || task->op == BATCH_GET) { goto exit; }
+
+    char const *code = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "code"));
+    if (code == 0) { code = local.code; }
+    view->hash = app_batch_str(pool, json, "hash");
+    if (view->hash == 0) { view->hash = "MD5"; }
+    view->hint = app_batch_str(pool, json, "hint");
+    view->type = app_batch_num(json, "type", view->type);
+    view->size = app_batch_num(json, "size", view->size);
+    if (view->type == PG_TYPE_OTHER) { view->misc = app_batch_str(pool, json, "misc"); }
+    if (code == 0 || *code == 0)
+    {
+        task->error = "missing code";
+        goto exit;
+    }
+    if ((view->misc == 0 || *view->misc == 0) && view->type == PG_TYPE_OTHER)
+    {
+        task->error = "missing misc";
+        goto exit;
+    }
+    if (task->op == BATCH_CREATE)
+    {
+        /* generate from the record as it will be stored */
+        pg_item item;
+        pg_item_ctor(&item);
+        item.text = view->text;
+        item.hint = view->hint && *view->hint ? view->hint : A_NULL;
+        item.misc = view->misc;
+        item.hash = pg_hash_id(view->hash) & 0xFF;
+        pg_item_set_type(&item, view->type);
+        pg_item_set_size(&item, view->size);
+        pg_item_view(&item, view);
+    }
+
+    char out[PG_CACHE_PASS];
+    if (app_pass(view, code, local.bcache, local.bversion, out) == A_SUCCESS) { task->pass = pg_pool_str(pool, out); }
+    if (task->pass == 0) { task->error = s_failure; }
+    pg_cache_wipe(out, sizeof(out));
+
+exit:
+    cJSON_Delete(json);
+}
+
+static void app_batch_work(batch_block *block, void *arg)
+{
+    app_tasks *ctx = (app_tasks *)malloc(sizeof(app_tasks));
+    (void)arg;
+    block->user = ctx;
+    if (ctx == 0) { return; }
+    pg_pool_ctor(&ctx->pool, 0);
+    a_vec_ctor(&ctx->task, sizeof(app_task));
+    ctx->rest = A_NULL;
+    a_str buf = A_STR_INIT;
+    size_t line = block->line;
+    for (char *p = block->data, *end = p + block->size, *s, *e; p != end; ++line)
+    {
+        char *const at = p;
+        p = app_batch_line(p, end, &s, &e);
+        if (s == e) { continue; }
+        app_task *task = A_VEC_PUSH(app_task, &ctx->task);
+        if (task == 0)
+        {
+            ctx->rest = at;
+            ctx->line = line;
+            break;
+        }
+        task->line = line;
+        app_batch_task(&ctx->pool, task, s, (size_t)(e - s), &buf);
+    }
+    a_str_dtor(&buf);
+}
+
+/* the first change of the batch copies the tree for the workers, then waits for those still reading it */
+static void app_batch_own(void)
+{
+    if (pg_cow_version(&local.cow)) { return; }
+    local.snap = pg_cow_load(&local.cow, &local.tree) == A_SUCCESS;
+    pg_cow_sync(&local.cow);
+}
+
+/* publishes a change to the snapshot and notes its version under the text */
+static void app_batch_copy(pg_item const *item, char const *text)
+{
+    if (local.snap == 0) { return; }
+    int ok = item ? pg_cow_put(&local.cow, item) : pg_cow_del(&local.cow, text);
+    pg_item *mark = ok == A_SUCCESS ? pg_tree_add(&local.changed, text) : A_NULL;
+    if (mark) { mark->time = (a_i64)pg_cow_version(&local.cow); }
+    else { local.snap = 0; }
+}
+
+/* creates or changes the record of text, a failure leaves no new record behind and an existing one as it was */
+static pg_item *app_batch_set(char const *text, pg_view const *view)
+{
+    a_size const count = local.tree.count;
+    pg_item *item = pg_tree_add(&local.tree, text);
+    if (item == 0) { return item; }
+    pg_item const keep = *item;
+    app_drop(item);
+    if (pg_tree_set(&local.tree, item, view) == A_SUCCESS) { return item; }
+    if (local.tree.count != count) { pg_tree_free(&local.tree, pg_tree_del(&local.tree, text)); }
+    else { *item = keep; }
+    return A_NULL;
+}
+
+/* whether the text of a get was left alone since the snapshot that a worker read */
+static int app_batch_same(app_task const *task)
+{
+    if (task->version == ~(a_u64)0) { return 0; }
+    if (pg_cow_version(&local.cow) == 0) { return 1; }
+    if (local.snap == 0) { return 0; }
+    pg_item const *mark = pg_tree_get(&local.changed, task->view.text);
+    return mark == 0 || (a_u64)mark->time <= task->version;
+}
+
+static void app_batch_done(batch_block *block, void *arg)
+{
+    a_str *out = (a_str *)arg;
+    app_tasks *ctx = (app_tasks *)block->user;
+    if (ctx == 0)
+    {
+        app_batch_lost(out, block->data, block->data + block->size, block->line);
+        fwrite(a_str_ptr(out), 1, a_str_len(out), stdout);
+        a_str_setn_(out, 0);
+        return;
+    }
+    a_vec_foreach(app_task, *, task, &ctx->task)
+    {
+        pg_item *item = 0;
+        char const *text = task->view.text;
+        a_size const mark = a_str_len(out);
+        if (task->error == 0)
+        {
+            switch (task->op)
+            {
+            case BATCH_CREATE:
+                app_batch_own();
+                item = app_batch_set(text, &task->view);
+                if (item == 0)
+                {
+                    task->error = s_failure;
+                    break;
+                }
+                pg_tree_time(&local.tree, item, time(NULL) + A_I32_MIN);
+                app_put(item);
+                app_batch_copy(item, text);
+                A_FALLTHROUGH;
+            case BATCH_GEN:
+                a_str_cats(out, "{\"text\":");
+                pg_json_quote(out, text);
+                a_str_cats(out, ",\"pass\":");
+                pg_json_quote(out, task->pass);
+                a_str_cats(out, "}\n");
+                break;
+            case BATCH_DELETE:
+                app_batch_own();
+                item = pg_tree_del(&local.tree, text);
+                if (item)
+                {
+                    app_drop(item);
+                    app_del(text);
+                    app_batch_copy(A_NULL, text);
+                    pg_tree_free(&local.tree, item);
+                }
+                a_str_cats(out, "{\"text\":");
+                pg_json_quote(out, text);
+                a_str_cats(out, item ? ",\"ok\":true}\n" : ",\"ok\":false}\n");
+                break;
+            case BATCH_GET:
+                if (app_batch_same(task))
+                {
+                    if (task->json == 0)
+                    {
+                        task->error = s_missing;
+                        break;
+                    }
+                    a_str_cats(out, task->json);
+                    a_str_catc(out, '\n');
+                    break;
+                }
+                item = pg_tree_get(&local.tree, text);
+                if (item == 0)
+                {
+                    task->error = s_missing;
+                    break;
+                }
+                pg_json_item(out, item);
+                a_str_catc(out, '\n');
+                break;
+            default:
+                break;
+            }
+        }
+        if (task->error)
+        {
+            a_str_setn_(out, mark);
+            app_batch_error(out, task->line, text, task->error);
+        }
+    }
+    if (ctx->rest) { app_batch_lost(out, ctx->rest, block->data + block->size, ctx->line); }
+    /* one write per block, the output is not flushed per line */
+    fwrite(a_str_ptr(out), 1, a_str_len(out), stdout);
+    /* the passwords of the block are wiped before their memory is given back */
+    pg_cache_wipe(a_str_ptr(out), a_str_len(out));
+    a_str_setn_(out, 0);
+    a_vec_foreach(app_task, *, task, &ctx->task)
+    {
+        if (task->pass) { pg_cache_wipe(task->pass, strlen(task->pass)); }
+    }
+    a_vec_dtor(&ctx->task, 0);
+    pg_pool_dtor(&ctx->pool);
+    free(ctx);
+}
+
+int app_batch(unsigned int jobs)
+{
+    if (app_load() != A_SUCCESS) { return A_FAILURE; }
+    a_str out = A_STR_INIT;
+    /* workers share the cache, so it is made before they start */
+    local.bcache = app_cache();
+    local.bversion = app_version();
+    /* gets are answered by the workers from a snapshot, while done changes the tree */
+    pg_cow_ctor(&local.cow);
+    pg_tree_ctor(&local.changed);
+    local.snap = 0;
+    int ok = batch_run(stdin, jobs, app_batch_work, app_batch_done, &out);
+    pg_tree_dtor(&local.changed);
+    pg_cow_dtor(&local.cow);
+    local.snap = 0;
+    a_str_dtor(&out);
+    fflush(stdout);
+    return ok;
+}
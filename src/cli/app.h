@@ -2,8 +2,11 @@
 #define APP_H
 
 #include "a/vec.h"
+#include "pg/fuzzy.h"
 #include "pg/json.h"
+#include "pg/pgb.h"
 #include "pg/sqlite.h"
+#include "pg/stats.h"
 
 #include "console.h"
 #include "convert.h"
@@ -13,25 +16,99 @@ extern "C" {
 #endif /* __cplusplus */
 
 void app_log(unsigned int n, ...);
-int app_gen(pg_item const *view, char const *code);
+int app_gen(pg_view const *view, char const *code);
+
+/*!
+ @brief make a vault that does not exist yet a sharded one
+ @details must come before app_init, the vault is then a directory of num
+ SQLite files that are loaded and saved in parallel. A directory that holds
+ shards already is opened as a sharded vault without this.
+ @param[in] num number of shards, 0 for a single file
+*/
+void app_shards(unsigned int num);
+
+/*!
+ @brief keep a binary vault mapped instead of loading it into the tree
+ @details must come before app_init. Generation, creation and deletion of
+ single texts then look their records up in the mapping, and a command that
+ reads the whole vault loads it first, so lazy opening only saves the load.
+ @param[in] on nonzero for a command on single texts
+*/
+void app_lazy(int on);
+
+/*!
+ @brief keep the tree small for a process that serves many commands
+ @details must come before app_init. The strings of changed and deleted
+ records are packed away by app_sync once they outweigh the live ones.
+ @param[in] on nonzero for the agent
+*/
+void app_resident(int on);
 
 int app_init(char const *fname, a_str const *code, a_str const *rule, int flag);
 int app_exit(void);
+void app_conf(a_str const *code, a_str const *rule, int flag);
+void app_sync(void);
 
 int app_create(a_vec const *item);
 
 void app_search(a_vec const *item);
 void app_search_n(a_vec const *item);
 
+/*!
+ @brief list the records whose texts hold every text within k typos
+ @details ASCII letters match regardless of case, the records come in order of
+ their total distance. The index of bigrams is built on first use and again
+ after a change, so an agent builds it once for many searches.
+ @param[in] item texts to look for, an empty one matches anything
+ @param[in] k largest number of insertions, deletions and substitutions
+*/
+int app_search_fuzzy(a_vec const *item, a_size k);
+
+/*!
+ @brief list the records that did not change for an age, oldest first
+ @details the index by time is built on first use and kept in sync from then
+ on, so an agent answers in O(log n + k).
+ @param[in] age seconds
+*/
+int app_older(a_i64 age);
+
+/*!
+ @brief list the records that changed last, newest first
+ @param[in] num largest number of records
+*/
+int app_recent(a_size num);
+
 int app_delete(a_vec const *item);
 int app_delete_n(a_vec const *item);
 
 int app_exec(a_vec const *item);
 int app_exec_n(a_vec const *item);
 
-int app_import(char const *fname);
+/*!
+ @brief merge the records of several files into the vault
+ @details the files are parsed at the same time, each into a tree of its
+ own, then all of them are merged in one pass. A text found in several files
+ keeps the newest record, the one of the later file if they are as new.
+ @param[in] fname names of JSON, SQLite or binary files
+ @param[in] num number of files
+*/
+int app_import(char const *const *fname, a_size num);
 int app_export(char const *fname);
-int app_convert(char const *in, char const *out);
+
+/*!
+ @brief merge the records of several files into a new file, like app_import
+*/
+int app_convert(char const *const *in, a_size num, char const *out);
+
+/*!
+ @brief answer NDJSON requests read from the standard input
+ @details each line is an object {op,text,hash,size,type,misc,hint,code} with
+ op one of "gen" (default), "create", "delete" and "get". Every request gets
+ one line of output in input order, in the same format as the vault or as
+ {text,pass}, {text,ok} and {line,text,error}.
+ @param[in] jobs number of threads that parse and generate, 0 selects all processors
+*/
+int app_batch(unsigned int jobs);
 
 #if defined(__cplusplus)
 } /* extern "C" */
@@ -42,5 +119,6 @@ static const char s_failure[] = "failure";
 static const char s_missing[] = "missing";
 static const char s_invalid[] = "invalid";
 static const char s_overrun[] = "overrun";
+static const char s_conflict[] = "conflict";
 
 #endif /* APP_H */
@@ -0,0 +1,196 @@
+#include "batch.h"
+#include "pg/thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK (1 << 16)
+
+typedef struct batch
+{
+    pg_mutex lock;
+    pg_cond todo_cond; /* a block waits for a worker, or input ended */
+    pg_cond done_cond; /* a block finished work, or input ended */
+    pg_cond room_cond; /* a block left the pipeline */
+    batch_block *todo;
+    batch_block **tail;
+    batch_block *done; /* finished blocks sorted by position */
+    size_t count; /* number of blocks read */
+    size_t inflight; /* number of blocks read and not yet done */
+    void (*work)(batch_block *, void *);
+    void (*done_)(batch_block *, void *);
+    void *arg;
+    unsigned int limit;
+    int eof;
+} batch;
+
+static void *batch_worker(void *arg)
+{
+    batch *ctx = (batch *)arg;
+    pg_mutex_lock(&ctx->lock);
+    for (;;)
+    {
+        while (!ctx->todo && !ctx->eof) { pg_cond_wait(&ctx->todo_cond, &ctx->lock); }
+        batch_block *block = ctx->todo;
+        if (!block) { break; }
+        ctx->todo = block->next;
+        if (!ctx->todo) { ctx->tail = &ctx->todo; }
+        pg_mutex_unlock(&ctx->lock);
+
+        ctx->work(block, ctx->arg);
+
+        pg_mutex_lock(&ctx->lock);
+        batch_block **link = &ctx->done;
+        while (*link && (*link)->seq < block->seq) { link = &(*link)->next; }
+        block->next = *link;
+        *link = block;
+        pg_cond_signal(&ctx->done_cond);
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return A_NULL;
+}
+
+static void *batch_writer(void *arg)
+{
+    batch *ctx = (batch *)arg;
+    size_t seq = 0;
+    pg_mutex_lock(&ctx->lock);
+    for (;;)
+    {
+        while (!(ctx->done && ctx->done->seq == seq) && !(ctx->eof && seq == ctx->count))
+        {
+            pg_cond_wait(&ctx->done_cond, &ctx->lock);
+        }
+        batch_block *block = ctx->done;
+        if (!block || block->seq != seq) { break; }
+        ctx->done = block->next;
+        pg_mutex_unlock(&ctx->lock);
+
+        ctx->done_(block, ctx->arg);
+        free(block);
+        ++seq;
+
+        pg_mutex_lock(&ctx->lock);
+        --ctx->inflight;
+        pg_cond_signal(&ctx->room_cond);
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return A_NULL;
+}
+
+static int batch_push(batch *ctx, char const *data, size_t size, size_t *line)
+{
+    batch_block *block = (batch_block *)malloc(sizeof(batch_block) + size);
+    if (!block) { return ~0; }
+    block->next = A_NULL;
+    block->data = (char *)(block + 1);
+    block->size = size;
+    block->line = *line;
+    block->user = A_NULL;
+    memcpy(block->data, data, size);
+    for (char const *p = data, *end = data + size; (p = (char const *)memchr(p, '\n', (size_t)(end - p))) != 0; ++p)
+    {
+        ++*line;
+    }
+
+    pg_mutex_lock(&ctx->lock);
+    while (ctx->inflight >= ctx->limit) { pg_cond_wait(&ctx->room_cond, &ctx->lock); }
+    block->seq = ctx->count++;
+    ++ctx->inflight;
+    *ctx->tail = block;
+    ctx->tail = &block->next;
+    pg_cond_signal(&ctx->todo_cond);
+    pg_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static int batch_read(batch *ctx, FILE *in)
+{
+    int ok = 0;
+    size_t line = 1;
+    size_t len = 0, cap = BLOCK;
+    char *buf = (char *)malloc(cap);
+    if (!buf) { return ~0; }
+    for (;;)
+    {
+        if (cap - len < BLOCK)
+        {
+            char *ptr = (char *)realloc(buf, cap << 1);
+            if (!ptr)
+            {
+                ok = ~0;
+                break;
+            }
+            buf = ptr;
+            cap <<= 1;
+        }
+        size_t n = fread(buf + len, 1, cap - len, in);
+        if (n == 0)
+        {
+            if (len) { ok = batch_push(ctx, buf, len, &line); }
+            break;
+        }
+        len += n;
+        char *p = buf + len;
+        while (p != buf && p[-1] != '\n') { --p; }
+        if (p == buf) { continue; }
+        size_t size = (size_t)(p - buf);
+        if (batch_push(ctx, buf, size, &line))
+        {
+            ok = ~0;
+            break;
+        }
+        len -= size;
+        memmove(buf, p, len);
+    }
+    free(buf);
+    return ok;
+}
+
+int batch_run(FILE *in, unsigned int jobs,
+              void (*work)(batch_block *, void *),
+              void (*done)(batch_block *, void *), void *arg)
+{
+    batch ctx;
+    pg_thread writer;
+    if (jobs == 0) { jobs = pg_thread_cpus(); }
+    pg_thread *worker = (pg_thread *)malloc(sizeof(pg_thread) * jobs);
+    if (!worker) { return ~0; }
+
+    pg_mutex_ctor(&ctx.lock);
+    pg_cond_ctor(&ctx.todo_cond);
+    pg_cond_ctor(&ctx.done_cond);
+    pg_cond_ctor(&ctx.room_cond);
+    ctx.todo = A_NULL;
+    ctx.tail = &ctx.todo;
+    ctx.done = A_NULL;
+    ctx.count = 0;
+    ctx.inflight = 0;
+    ctx.limit = jobs << 2;
+    ctx.eof = 0;
+    ctx.work = work;
+    ctx.done_ = done;
+    ctx.arg = arg;
+
+    unsigned int n = 0;
+    int const writing = pg_thread_ctor(&writer, batch_writer, &ctx) == A_SUCCESS;
+    for (; writing && n != jobs; ++n)
+    {
+        if (pg_thread_ctor(worker + n, batch_worker, &ctx)) { break; }
+    }
+    int ok = writing && n ? batch_read(&ctx, in) : ~0;
+
+    pg_mutex_lock(&ctx.lock);
+    ctx.eof = 1;
+    pg_cond_broadcast(&ctx.todo_cond);
+    pg_cond_broadcast(&ctx.done_cond);
+    pg_mutex_unlock(&ctx.lock);
+    for (unsigned int i = 0; i != n; ++i) { pg_thread_join(worker + i); }
+    if (writing) { pg_thread_join(&writer); }
+
+    pg_cond_dtor(&ctx.room_cond);
+    pg_cond_dtor(&ctx.done_cond);
+    pg_cond_dtor(&ctx.todo_cond);
+    pg_mutex_dtor(&ctx.lock);
+    free(worker);
+    return ok;
+}
@@ -0,0 +1,44 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+/*!
+ @brief a block of whole lines that moves through the pipeline
+*/
+typedef struct batch_block
+{
+    struct batch_block *next;
+    char *data; /*!< lines, each terminated with a newline except maybe the last */
+    size_t size; /*!< number of bytes in data */
+    size_t seq; /*!< position of the block in the input */
+    size_t line; /*!< number of the first line, counting from 1 */
+    void *user; /*!< set by work, consumed by done */
+} batch_block;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief run a three-stage pipeline over the lines of a stream
+ @details the calling thread reads blocks of lines, jobs threads run work on
+ blocks in any order, and one more thread runs done on blocks in input order.
+ @param[in] in stream to read lines from
+ @param[in] jobs number of threads that run work, 0 selects one per processor
+ @param[in] work called on each block, from any worker thread
+ @param[in] done called on each block in input order, from a single thread
+ @param[in] arg passed to work and done
+ @return the execution state of the function
+  @retval -1 failure
+  @retval 0 success
+*/
+int batch_run(FILE *in, unsigned int jobs,
+              void (*work)(batch_block *, void *),
+              void (*done)(batch_block *, void *), void *arg);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* BATCH_H */
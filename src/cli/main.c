@@ -1,5 +1,8 @@
 #include "app.h"
+#include "agent.h"
+#include "pg/shard.h"
 #include <getopt.h>
+#include <errno.h>
 #if defined(_WIN32)
 #if defined(_MSC_VER)
 #pragma warning(push)
@@ -11,6 +14,7 @@
 #endif /* _MSC_VER */
 #else /* !_WIN32 */
 #include <unistd.h>
+#include <glob.h>
 #endif /* _WIN32 */
 
 static char *path_self(void)
@@ -43,19 +47,24 @@ static struct
 {
     char *self;
     char *file;
-    char *import;
     char *export;
     pg_view view;
+    pg_pool pool;
     a_str rule;
     a_str code;
     a_vec item;
+    a_vec import; /*!< names of files for -i */
+    a_i64 older; /*!< seconds for --older-than */
+    a_size recent; /*!< number for --recent */
+    a_size fuzzy; /*!< edits for --fuzzy */
     int option;
+    int stats;
 } local = {
     .self = 0,
     .file = 0,
-    .import = 0,
     .export = 0,
     .option = 0,
+    .stats = 0,
 };
 #pragma pack(pop)
 
@@ -63,6 +72,11 @@ static struct
 #define OPTION_SEARCH (1 << 1)
 #define OPTION_CREATE (1 << 2)
 #define OPTION_DELETE (1 << 3)
+#define OPTION_AGENT (1 << 4)
+#define OPTION_BATCH (1 << 5)
+#define OPTION_OLDER (1 << 6)
+#define OPTION_RECENT (1 << 7)
+#define OPTION_FUZZY (1 << 10)
 
 #define OPTION_GET(mask) (local.option & (mask))
 #define OPTION_SET(mask) (local.option |= (mask))
@@ -71,44 +85,90 @@ static struct
 
 static A_INLINE void item_push(pg_view const *view)
 {
-    pg_item *item = A_VEC_PUSH(pg_item, &local.item);
-    pg_item_ctor(item);
-    pg_item_set_text(item, view->text);
-    pg_item_set_hash(item, view->hash);
-    pg_item_set_hint(item, view->hint);
-    if (view->type == PG_TYPE_OTHER)
+    pg_view *item = A_VEC_PUSH(pg_view, &local.item);
+    *item = *view;
+    if (view->type != PG_TYPE_OTHER)
     {
-        pg_item_set_misc(item, view->misc);
+        item->misc = 0;
     }
-    pg_item_set_type(item, view->type);
-    pg_item_set_size(item, view->size);
 }
 
-static int io_getline(char const *fname, char **pdata, size_t *nbyte)
+/* seconds in an age such as 90 or 90d, 12h, 30m and 10s, or -1 when it is none */
+/* a whole decimal number from lo to hi, or -1 */
+static long main_num(char const *s, long lo, long hi)
 {
-    long seek = 0;
-    FILE *handle = fopen(fname, "r");
-    if (handle == 0) { return ~0; }
-    *nbyte = 0;
-    for (int c = fgetc(handle); c > ~0; c = fgetc(handle))
+    char *p = 0;
+    errno = 0;
+    long const x = strtol(s, &p, 10);
+    if (p == s || *p || errno || x < lo || x > hi) { return -1; }
+    return x;
+}
+
+static a_i64 main_age(char const *s)
+{
+    char *p = 0;
+    double x = strtod(s, &p);
+    double unit = 60 * 60 * 24;
+    if (p == s || !(x >= 0)) { return -1; }
+    switch (*p)
     {
-        if (c == '\n' || c == '\r')
-        {
-            if (*nbyte) { break; }
-            else { ++seek; }
-            continue;
-        }
-        ++*nbyte;
+    case 's':
+        unit = 1;
+        ++p;
+        break;
+    case 'm':
+        unit = 60;
+        ++p;
+        break;
+    case 'h':
+        unit = 60 * 60;
+        ++p;
+        break;
+    case 'd':
+        ++p;
+        break;
+    default:
+        break;
     }
-    *pdata = malloc(*nbyte);
-    fseek(handle, seek, SEEK_SET);
-    *nbyte = fread(*pdata, 1, *nbyte, handle);
-    return fclose(handle);
+    /* the age is taken from the time of day, so it stays far from overflow */
+    if (*p || x * unit > (double)(A_I64_MAX >> 2)) { return -1; }
+    return (a_i64)(x * unit);
 }
 
-static A_INLINE void item_dtor(void *ctx)
+static int main_import_(char const *name)
 {
-    pg_item_dtor((pg_item *)ctx);
+    char **it = A_VEC_PUSH(char *, &local.import);
+    if (it == 0) { return A_FAILURE; }
+    *it = strdup(name);
+    if (*it == 0)
+    {
+        A_VEC_PULL(char *, &local.import);
+        return A_FAILURE;
+    }
+    return A_SUCCESS;
+}
+
+/* adds the files that a name matches, or the name itself when none does */
+static int main_import(char const *name)
+{
+#if !defined(_WIN32)
+    glob_t g;
+    if (glob(name, 0, 0, &g) == 0)
+    {
+        int ok = A_SUCCESS;
+        for (size_t i = 0; ok == A_SUCCESS && i != g.gl_pathc; ++i) { ok = main_import_(g.gl_pathv[i]); }
+        globfree(&g);
+        return ok;
+    }
+    globfree(&g);
+#endif /* _WIN32 */
+    return main_import_(name);
+}
+
+static void main_import_free(void)
+{
+    a_vec_foreach(char, **, it, &local.import) { free(*it); }
+    a_vec_setn(&local.import, 0, 0);
 }
 
 static void main_exit(void)
@@ -117,13 +177,14 @@ static void main_exit(void)
     local.self = 0;
     free(local.file);
     local.file = 0;
-    free(local.import);
-    local.import = 0;
+    main_import_free();
+    a_vec_dtor(&local.import, 0);
     free(local.export);
     local.export = 0;
     a_str_dtor(&local.rule);
     a_str_dtor(&local.code);
-    a_vec_dtor(&local.item, item_dtor);
+    a_vec_dtor(&local.item, 0);
+    pg_pool_dtor(&local.pool);
 }
 
 static void main_init(void)
@@ -133,7 +194,9 @@ static void main_init(void)
     atexit(main_exit);
     a_str_ctor(&local.rule);
     a_str_ctor(&local.code);
-    a_vec_ctor(&local.item, sizeof(pg_item));
+    a_vec_ctor(&local.item, sizeof(pg_view));
+    a_vec_ctor(&local.import, sizeof(char *));
+    pg_pool_ctor(&local.pool, 0);
     pg_view_ctor(&local.view);
     local.self = path_self();
 
@@ -141,35 +204,15 @@ static void main_init(void)
     if (env) { local.file = strdup(env); }
 
     env = getenv("PG_RULE");
-    if (env)
+    if (env && pg_io_getline(env, &local.rule))
     {
-        char *p = 0;
-        a_size n = 0;
-        if (io_getline(env, &p, &n) > ~0)
-        {
-            a_str_catn(&local.rule, p, n);
-        }
-        else
-        {
-            a_str_cats(&local.rule, env);
-        }
-        free(p);
+        a_str_cats(&local.rule, env);
     }
 
     env = getenv("PG_CODE");
-    if (env)
+    if (env && pg_io_getline(env, &local.code))
     {
-        char *p = 0;
-        a_size n = 0;
-        if (io_getline(env, &p, &n) > ~0)
-        {
-            a_str_catn(&local.code, p, n);
-        }
-        else
-        {
-            a_str_cats(&local.code, env);
-        }
-        free(p);
+        a_str_cats(&local.code, env);
     }
 }
 
@@ -189,9 +232,16 @@ option:\n\
   -m --misc      string\n\
   -h --hint      string\n\
   -l --length    number(0~128)\n\
-  -i --import    filename\n\
-  -o --export    filename\n\
+  -i --import    filename or pattern, repeatable\n\
+  -o --export    filename, .pgz packs JSON\n\
   -f --filename  filename\n\
+     --agent     keep the vault resident and serve\n\
+     --batch     answer NDJSON requests from stdin\n\
+     --shards    number(1~256) of files for a new vault directory\n\
+     --older-than days, or a number with s m h, oldest first\n\
+     --recent    number of records changed last, newest first\n\
+     --fuzzy     with -s, texts within =N typos, 2 by default\n\
+     --stats     print timings to stderr, =json,alloc\n\
 hash: MD5(default)\n\
      SHA1  SHA256  SHA224  BLAKE2S\n\
      SHA3  SHA512  SHA384  BLAKE2B\n\
@@ -200,8 +250,7 @@ Copyright (C) 2020-2024 tqfx, All rights reserved.";
     return EXIT_SUCCESS;
 }
 
-static int main_app(void);
-int main(int argc, char *argv[])
+static int main_parse(int argc, char *argv[])
 {
     char const *shortopts = "?12nscdvr:p:g::a:h:m:t:l:i:o:f:";
     static struct option const longopts[] = {
@@ -222,11 +271,16 @@ int main(int argc, char *argv[])
         {"import", required_argument, 0, 'i'},
         {"export", required_argument, 0, 'o'},
         {"filename", required_argument, 0, 'f'},
+        {"agent", no_argument, 0, 'A'},
+        {"batch", no_argument, 0, 'B'},
+        {"shards", required_argument, 0, 'N'},
+        {"older-than", required_argument, 0, 'O'},
+        {"recent", required_argument, 0, 'R'},
+        {"fuzzy", optional_argument, 0, 'F'},
+        {"stats", optional_argument, 0, 'S'},
         {0, 0, 0, 0},
     };
 
-    main_init();
-
     for (int ok; ((void)(ok = getopt_long(argc, argv, shortopts, longopts, &ok)), ok) != -1;)
     {
         switch (ok)
@@ -279,8 +333,11 @@ int main(int argc, char *argv[])
             local.view.size = (unsigned int)strtoul(optarg, 0, 0);
             break;
         case 'i':
-            if (local.import) { free(local.import); }
-            local.import = strdup(optarg);
+            if (main_import(optarg))
+            {
+                fprintf(stderr, "%s: out of memory\n", optarg);
+                return EXIT_FAILURE;
+            }
             break;
         case 'o':
             if (local.export) { free(local.export); }
@@ -290,22 +347,78 @@ int main(int argc, char *argv[])
             if (local.file) { free(local.file); }
             local.file = strdup(optarg);
             break;
+        case 'A':
+            OPTION_SET(OPTION_AGENT);
+            break;
+        case 'B':
+            OPTION_SET(OPTION_BATCH);
+            break;
+        case 'N':
+        {
+            long const num = main_num(optarg, 1, PG_SHARD_MAX);
+            if (num < 0)
+            {
+                fprintf(stderr, "%s: invalid number of shards\n", optarg);
+                return EXIT_FAILURE;
+            }
+            app_shards((unsigned int)num);
+            break;
+        }
+        case 'O':
+            OPTION_SET(OPTION_OLDER);
+            local.older = main_age(optarg);
+            if (local.older < 0)
+            {
+                fprintf(stderr, "%s: invalid age\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'R':
+        {
+            OPTION_SET(OPTION_RECENT);
+            long const num = main_num(optarg, 0, LONG_MAX);
+            if (num < 0)
+            {
+                fprintf(stderr, "%s: invalid number of records\n", optarg);
+                return EXIT_FAILURE;
+            }
+            local.recent = (a_size)num;
+            break;
+        }
+        case 'F':
+        {
+            OPTION_SET(OPTION_FUZZY);
+            long const num = optarg ? main_num(optarg, 0, LONG_MAX) : 2;
+            if (num < 0)
+            {
+                fprintf(stderr, "%s: invalid number of typos\n", optarg);
+                return EXIT_FAILURE;
+            }
+            local.fuzzy = (a_size)num;
+            break;
+        }
+        case 'S':
+            local.stats = optarg && strstr(optarg, "json") ? 2 : 1;
+#if defined(PG_STATS)
+            if (optarg && strstr(optarg, "alloc")) { pg_stats_alloc(); }
+#endif /* PG_STATS */
+            break;
         case 'v':
             printf("sqlite %s\n", SQLITE_VERSION);
             printf("cjson %s\n", cJSON_Version());
             printf("liba %s\n", A_VERSION);
             printf("pg 0.1.0\n");
-            exit(EXIT_SUCCESS);
+            return EXIT_SUCCESS;
         case '?':
         default:
-            exit(main_help());
+            return main_help();
         }
     }
 
     a_vec_forenum_reverse(i, &local.item)
     {
-        pg_item *it = A_VEC_AT_(pg_item, &local.item, i);
-        if (!OPTION_GET(OPTION_SEARCH) && a_str_len(it->text) == 0)
+        pg_view *it = A_VEC_AT_(pg_view, &local.item, i);
+        if (!OPTION_GET(OPTION_SEARCH) && (it->text == 0 || *it->text == 0))
         {
             a_vec_remove(&local.item, i);
         }
@@ -313,21 +426,21 @@ int main(int argc, char *argv[])
 
     if (a_vec_num(&local.item))
     {
-        pg_item *ctx = A_VEC_TOP_(pg_item, &local.item);
+        pg_view *ctx = A_VEC_TOP_(pg_view, &local.item);
         if (local.view.type == PG_TYPE_OTHER)
         {
-            pg_item_set_misc(ctx, local.view.misc);
+            ctx->misc = local.view.misc;
         }
         if (local.view.hash)
         {
-            pg_item_set_hash(ctx, local.view.hash);
+            ctx->hash = local.view.hash;
         }
         if (local.view.hint)
         {
-            pg_item_set_hint(ctx, local.view.hint);
+            ctx->hint = local.view.hint;
         }
-        pg_item_set_type(ctx, local.view.type);
-        pg_item_set_size(ctx, local.view.size);
+        ctx->type = local.view.type;
+        ctx->size = local.view.size;
     }
 
     for (int i = optind; i < argc; ++i)
@@ -337,18 +450,31 @@ int main(int argc, char *argv[])
     }
 
 #if defined(_WIN32)
-    a_vec_foreach(pg_item, *, it, &local.item)
+    a_vec_foreach(pg_view, *, it, &local.item)
     {
-        if (a_str_len(it->text))
+        if (it->text && *it->text)
         {
             char *text;
-            code_to_utf8(&text, a_str_ptr(it->text));
-            pg_item_set_text(it, text);
+            code_to_utf8(&text, it->text);
+            it->text = pg_pool_str(&local.pool, text);
             free(text);
         }
     }
 #endif /* _WIN32 */
 
+    return -1;
+}
+
+static int main_app(void);
+static int main_agent(void);
+static int main_call(int argc, char *argv[]);
+int main(int argc, char *argv[])
+{
+    main_init();
+
+    int ok = main_parse(argc, argv);
+    if (ok >= 0) { return ok; }
+
     if (local.file == 0)
     {
         a_str str = A_STR_INIT;
@@ -363,25 +489,45 @@ int main(int argc, char *argv[])
         local.file = a_str_exit(&str);
     }
 
+    if (OPTION_IS1(OPTION_AGENT))
+    {
+        return main_agent();
+    }
+    ok = main_call(argc, argv);
+    if (ok >= 0) { return ok; }
+
     return main_app();
 }
 
-static int main_app(void)
+static void main_run(void)
 {
-    app_init(local.file, &local.code, &local.rule, local.option);
-
-    if (local.import && local.export)
+    if (OPTION_IS1(OPTION_BATCH))
+    {
+        OPTION_CLR(OPTION_BATCH);
+        app_batch(0);
+    }
+    else if (a_vec_num(&local.import) && local.export)
     {
-        app_convert(local.import, local.export);
+        app_convert(A_VEC_PTR(char const *, &local.import), a_vec_num(&local.import), local.export);
     }
-    else if (local.import)
+    else if (a_vec_num(&local.import))
     {
-        app_import(local.import);
+        app_import(A_VEC_PTR(char const *, &local.import), a_vec_num(&local.import));
     }
     else if (local.export)
     {
         app_export(local.export);
     }
+    else if (OPTION_IS1(OPTION_OLDER))
+    {
+        OPTION_CLR(OPTION_OLDER);
+        app_older(local.older);
+    }
+    else if (OPTION_IS1(OPTION_RECENT))
+    {
+        OPTION_CLR(OPTION_RECENT);
+        app_recent(local.recent);
+    }
     else if (OPTION_IS1(OPTION_DELETE))
     {
         OPTION_CLR(OPTION_DELETE);
@@ -405,6 +551,11 @@ static int main_app(void)
         OPTION_CLR(OPTION_SEARCH | OPTION_NUMBER);
         app_search_n(&local.item);
     }
+    else if (OPTION_IS1(OPTION_SEARCH | OPTION_FUZZY))
+    {
+        OPTION_CLR(OPTION_SEARCH | OPTION_FUZZY);
+        app_search_fuzzy(&local.item, local.fuzzy);
+    }
     else if (OPTION_IS1(OPTION_SEARCH))
     {
         OPTION_CLR(OPTION_SEARCH);
@@ -419,6 +570,109 @@ static int main_app(void)
     {
         app_exec(&local.item);
     }
+}
+
+static void main_stats(void)
+{
+#if defined(PG_STATS)
+    a_str str = A_STR_INIT;
+    if (local.stats == 2 && pg_stats_json(&str) == 0)
+    {
+        fprintf(stderr, "%s\n", a_str_ptr(&str));
+    }
+    else if (local.stats == 1 && pg_stats_text(&str) == 0)
+    {
+        fputs(a_str_ptr(&str), stderr);
+    }
+    a_str_dtor(&str);
+#else /* !PG_STATS */
+    if (local.stats) { fputs("stats: disabled at build time\n", stderr); }
+#endif /* PG_STATS */
+}
 
-    return app_exit();
+/* a command on single texts needs no more of the vault than their records */
+static int main_lazy(void)
+{
+    if (OPTION_GET(OPTION_BATCH | OPTION_OLDER | OPTION_RECENT | OPTION_SEARCH)) { return 0; }
+    if (a_vec_num(&local.import) || local.export) { return 0; }
+    if (OPTION_GET(OPTION_CREATE) && !OPTION_GET(OPTION_DELETE)) { return 1; }
+    return !OPTION_GET(OPTION_NUMBER);
+}
+
+static int main_app(void)
+{
+    app_lazy(main_lazy());
+    app_init(local.file, &local.code, &local.rule, local.option);
+    main_run();
+    int ok = app_exit();
+    main_stats();
+    return ok;
+}
+
+/* hands the request to the agent of the vault, or returns -1 */
+static int main_call(int argc, char *argv[])
+{
+    int status = -1;
+    char const **args = (char const **)malloc(sizeof(char *) * (size_t)(argc + 4));
+    if (args == 0) { return status; }
+    int n = 0;
+    args[n++] = argv[0];
+    /* rule and code may come from the environment of this process */
+    if (a_str_len(&local.rule))
+    {
+        args[n++] = "-r";
+        args[n++] = a_str_ptr(&local.rule);
+    }
+    if (a_str_len(&local.code))
+    {
+        args[n++] = "-p";
+        args[n++] = a_str_ptr(&local.code);
+    }
+    for (int i = 1; i < argc; ++i) { args[n++] = argv[i]; }
+    int const ok = agent_call(local.file, n, args, &status);
+    if (ok < 0) { status = -1; }
+    else if (ok > 0) { status = EXIT_FAILURE; }
+    free(args);
+    return status;
+}
+
+static int main_serve(int argc, char *argv[])
+{
+    a_str_setn_(&local.rule, 0);
+    a_str_setn_(&local.code, 0);
+    a_vec_setn(&local.item, 0, 0);
+    pg_view_ctor(&local.view);
+    main_import_free();
+    free(local.export);
+    local.export = 0;
+    local.option = 0;
+    local.stats = 0;
+    pg_stats_reset();
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    optreset = 1;
+    optind = 1;
+#else /* !BSD */
+    optind = 0;
+#endif /* BSD */
+    int ok = main_parse(argc, argv);
+    if (ok >= 0) { return ok; }
+
+    app_conf(&local.code, &local.rule, local.option);
+    main_run();
+    /* the vault is saved after the reply, so SAVE is left out here */
+    main_stats();
+    return EXIT_SUCCESS;
+}
+
+static int main_agent(void)
+{
+    /* requests may replace local.file with -f */
+    char *fname = strdup(local.file);
+    app_resident(1);
+    app_init(fname, &local.code, &local.rule, local.option);
+    int ok = agent_serve(fname, main_serve, app_sync);
+    app_exit();
+    free(fname);
+    return ok ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,397 @@
+#include "pg/cow.h"
+#if !defined(_WIN32)
+#include <sched.h>
+#endif /* _WIN32 */
+
+typedef struct cow_retire
+{
+    pg_cow_node *node;
+    a_u64 epoch; /*!< epoch of the change that replaced the node */
+} cow_retire;
+
+/* readers load what the writer stores without a lock, every access is sequentially consistent */
+#if defined(__GNUC__) || defined(__clang__)
+#define cow_load(var) __atomic_load_n(&(var), __ATOMIC_SEQ_CST)
+#define cow_store(var, val) __atomic_store_n(&(var), val, __ATOMIC_SEQ_CST)
+static int cow_claim(a_u64 *var, a_u64 val)
+{
+    a_u64 idle = 0;
+    return __atomic_compare_exchange_n(var, &idle, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(_MSC_VER)
+#define cow_load(var) (MemoryBarrier(), (var))
+#define cow_store(var, val) (MemoryBarrier(), (var) = (val), MemoryBarrier())
+static int cow_claim(a_u64 *var, a_u64 val)
+{
+    return InterlockedCompareExchange64((LONG64 volatile *)var, (LONG64)val, 0) == 0;
+}
+#else /* !atomic */
+#define cow_load(var) (var)
+#define cow_store(var, val) ((var) = (val))
+static int cow_claim(a_u64 *var, a_u64 val)
+{
+    if (*var) { return 0; }
+    *var = val;
+    return 1;
+}
+#endif /* atomic */
+
+static void cow_yield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else /* !_WIN32 */
+    sched_yield();
+#endif /* _WIN32 */
+}
+
+static a_u32 cow_height(pg_cow_node *node) { return node ? node->height : 0; }
+
+/* sets n nodes aside and makes room to retire as many, so that a change cannot fail */
+static int cow_reserve(pg_cow *ctx, a_size n)
+{
+    if (a_vec_setm(&ctx->retire, a_vec_num(&ctx->retire) + n)) { return A_OMEMORY; }
+    for (; ctx->nspare < n; ++ctx->nspare)
+    {
+        pg_cow_node *node = (pg_cow_node *)a_alloc(A_NULL, sizeof(pg_cow_node));
+        if (!node) { return A_OMEMORY; }
+        node->left = ctx->spare;
+        ctx->spare = node;
+    }
+    return A_SUCCESS;
+}
+
+static pg_cow_node *cow_node(pg_cow *ctx, pg_cow_node *left, pg_item const *item, pg_cow_node *right)
+{
+    pg_cow_node *node = ctx->spare;
+    ctx->spare = node->left;
+    --ctx->nspare;
+    a_u32 const hl = cow_height(left), hr = cow_height(right);
+    node->left = left;
+    node->right = right;
+    node->count = pg_cow_count(left) + pg_cow_count(right) + 1;
+    node->epoch = ctx->epoch;
+    node->height = (hl > hr ? hl : hr) + 1;
+    node->item = *item;
+    a_zero(&node->item.node, sizeof(node->item.node));
+    return node;
+}
+
+/* a node that this change made was never seen and goes back at once, others wait for readers */
+static void cow_drop(pg_cow *ctx, pg_cow_node *node)
+{
+    if (node->epoch == ctx->epoch)
+    {
+        pg_cow_node *spare = node;
+        spare->left = ctx->spare;
+        ctx->spare = spare;
+        ++ctx->nspare;
+        return;
+    }
+    cow_retire *r = A_VEC_PUSH(cow_retire, &ctx->retire);
+    r->node = node;
+    r->epoch = ctx->epoch;
+}
+
+/* makes a node of two subtrees whose heights differ by at most 2, rotating them into balance */
+static pg_cow_node *cow_join(pg_cow *ctx, pg_cow_node *left, pg_item const *item, pg_cow_node *right)
+{
+    a_u32 const hl = cow_height(left), hr = cow_height(right);
+    pg_cow_node *node;
+    if (hl > hr + 1)
+    {
+        pg_cow_node *ll = left->left, *lr = left->right;
+        if (cow_height(ll) >= cow_height(lr))
+        {
+            node = cow_node(ctx, ll, &left->item, cow_node(ctx, lr, item, right));
+        }
+        else
+        {
+            node = cow_node(ctx, cow_node(ctx, ll, &left->item, lr->left), &lr->item,
+                            cow_node(ctx, lr->right, item, right));
+            cow_drop(ctx, lr);
+        }
+        cow_drop(ctx, left);
+    }
+    else if (hr > hl + 1)
+    {
+        pg_cow_node *rl = right->left, *rr = right->right;
+        if (cow_height(rr) >= cow_height(rl))
+        {
+            node = cow_node(ctx, cow_node(ctx, left, item, rl), &right->item, rr);
+        }
+        else
+        {
+            node = cow_node(ctx, cow_node(ctx, left, item, rl->left), &rl->item,
+                            cow_node(ctx, rl->right, &right->item, rr));
+            cow_drop(ctx, rl);
+        }
+        cow_drop(ctx, right);
+    }
+    else { node = cow_node(ctx, left, item, right); }
+    return node;
+}
+
+static pg_cow_node *cow_put(pg_cow *ctx, pg_cow_node *node, pg_item const *item)
+{
+    if (!node) { return cow_node(ctx, A_NULL, item, A_NULL); }
+    int const cmp = strcmp(item->text, node->item.text);
+    pg_cow_node *res;
+    if (cmp < 0) { res = cow_join(ctx, cow_put(ctx, node->left, item), &node->item, node->right); }
+    else if (cmp > 0) { res = cow_join(ctx, node->left, &node->item, cow_put(ctx, node->right, item)); }
+    else { res = cow_node(ctx, node->left, item, node->right); }
+    cow_drop(ctx, node);
+    return res;
+}
+
+/* takes the first node out of a subtree, the caller drops it once it has copied its record */
+static pg_cow_node *cow_pop(pg_cow *ctx, pg_cow_node *node, pg_cow_node **first)
+{
+    if (!node->left)
+    {
+        *first = node;
+        return node->right;
+    }
+    pg_cow_node *res = cow_join(ctx, cow_pop(ctx, node->left, first), &node->item, node->right);
+    cow_drop(ctx, node);
+    return res;
+}
+
+/* returns node itself when text is missing */
+static pg_cow_node *cow_del(pg_cow *ctx, pg_cow_node *node, char const *text)
+{
+    if (!node) { return A_NULL; }
+    int const cmp = strcmp(text, node->item.text);
+    pg_cow_node *res;
+    if (cmp < 0)
+    {
+        pg_cow_node *left = cow_del(ctx, node->left, text);
+        if (left == node->left) { return node; }
+        res = cow_join(ctx, left, &node->item, node->right);
+    }
+    else if (cmp > 0)
+    {
+        pg_cow_node *right = cow_del(ctx, node->right, text);
+        if (right == node->right) { return node; }
+        res = cow_join(ctx, node->left, &node->item, right);
+    }
+    else if (!node->left) { res = node->right; }
+    else if (!node->right) { res = node->left; }
+    else
+    {
+        pg_cow_node *first;
+        pg_cow_node *right = cow_pop(ctx, node->right, &first);
+        res = cow_join(ctx, node->left, &first->item, right);
+        cow_drop(ctx, first);
+    }
+    cow_drop(ctx, node);
+    return res;
+}
+
+/* copies the shape of a tree that is balanced already */
+static pg_cow_node *cow_copy(pg_cow *ctx, a_avl_node const *node)
+{
+    if (!node) { return A_NULL; }
+    pg_cow_node *left = cow_copy(ctx, node->left);
+    pg_cow_node *right = cow_copy(ctx, node->right);
+    return cow_node(ctx, left, pg_tree_entry(node), right);
+}
+
+static void cow_retire_all(pg_cow *ctx, pg_cow_node *node)
+{
+    if (!node) { return; }
+    cow_retire_all(ctx, node->left);
+    cow_retire_all(ctx, node->right);
+    cow_drop(ctx, node);
+}
+
+static void cow_free(pg_cow_node *node)
+{
+    if (!node) { return; }
+    cow_free(node->left);
+    cow_free(node->right);
+    a_die(node);
+}
+
+/* frees what no reader can reach any more, retired nodes are in the order of their epochs */
+static void cow_reclaim(pg_cow *ctx)
+{
+    a_u64 least = ~(a_u64)0;
+    for (unsigned int i = 0; i != PG_COW_READERS; ++i)
+    {
+        a_u64 const e = cow_load(ctx->reader[i]);
+        if (e && e < least) { least = e; }
+    }
+    cow_retire const *r = A_VEC_PTR(cow_retire, &ctx->retire);
+    a_size const num = a_vec_num(&ctx->retire);
+    a_size n = 0;
+    for (; n != num && r[n].epoch < least; ++n) { a_die(r[n].node); }
+    if (n) { a_vec_erase(&ctx->retire, 0, n, A_NULL); }
+}
+
+/* readers that enter from now on see the new root, those in an earlier epoch keep the old one */
+static void cow_publish(pg_cow *ctx, pg_cow_node *root)
+{
+    cow_store(ctx->root, root);
+    cow_store(ctx->epoch, ctx->epoch + 1);
+    cow_reclaim(ctx);
+}
+
+void pg_cow_ctor(pg_cow *ctx)
+{
+    ctx->root = A_NULL;
+    ctx->epoch = 1;
+    a_zero(ctx->reader, sizeof(ctx->reader));
+    a_vec_ctor(&ctx->retire, sizeof(cow_retire));
+    ctx->spare = A_NULL;
+    ctx->nspare = 0;
+    pg_mutex_ctor(&ctx->lock);
+}
+
+void pg_cow_dtor(pg_cow *ctx)
+{
+    cow_free(ctx->root);
+    ctx->root = A_NULL;
+    a_vec_foreach(cow_retire, *, r, &ctx->retire) { a_die(r->node); }
+    a_vec_dtor(&ctx->retire, A_NULL);
+    while (ctx->spare)
+    {
+        pg_cow_node *node = ctx->spare;
+        ctx->spare = node->left;
+        a_die(node);
+    }
+    ctx->nspare = 0;
+    pg_mutex_dtor(&ctx->lock);
+}
+
+int pg_cow_load(pg_cow *ctx, pg_tree const *tree)
+{
+    pg_mutex_lock(&ctx->lock);
+    int ok = cow_reserve(ctx, pg_cow_count(ctx->root) + tree->count);
+    if (ok == A_SUCCESS)
+    {
+        pg_cow_node *const root = ctx->root;
+        cow_retire_all(ctx, root);
+        cow_publish(ctx, cow_copy(ctx, tree->root.node));
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+int pg_cow_put(pg_cow *ctx, pg_item const *item)
+{
+    pg_mutex_lock(&ctx->lock);
+    pg_cow_node *const root = ctx->root;
+    int ok = cow_reserve(ctx, 3 * (a_size)cow_height(root) + 4);
+    if (ok == A_SUCCESS) { cow_publish(ctx, cow_put(ctx, root, item)); }
+    pg_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+int pg_cow_del(pg_cow *ctx, char const *text)
+{
+    pg_mutex_lock(&ctx->lock);
+    pg_cow_node *const root = ctx->root;
+    int ok = cow_reserve(ctx, 3 * (a_size)cow_height(root) + 4);
+    if (ok == A_SUCCESS)
+    {
+        pg_cow_node *const res = cow_del(ctx, root, text);
+        if (res != root) { cow_publish(ctx, res); }
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+void pg_cow_sync(pg_cow *ctx)
+{
+    pg_mutex_lock(&ctx->lock);
+    a_u64 const epoch = ctx->epoch + 1;
+    cow_store(ctx->epoch, epoch);
+    for (unsigned int i = 0; i != PG_COW_READERS; ++i)
+    {
+        /* a slot that is taken again meanwhile belongs to a reader of the new epoch */
+        for (a_u64 e = cow_load(ctx->reader[i]); e && e < epoch; e = cow_load(ctx->reader[i])) { cow_yield(); }
+    }
+    cow_reclaim(ctx);
+    pg_mutex_unlock(&ctx->lock);
+}
+
+a_u64 pg_cow_version(pg_cow *ctx)
+{
+    return cow_load(ctx->epoch) - 1;
+}
+
+void pg_cow_enter(pg_cow *ctx, pg_cow_snap *snap)
+{
+    for (;;)
+    {
+        for (unsigned int i = 0; i != PG_COW_READERS; ++i)
+        {
+            /* the epoch is announced before the root is loaded, so the writer keeps what it reaches */
+            a_u64 const epoch = cow_load(ctx->epoch);
+            if (!cow_claim(ctx->reader + i, epoch)) { continue; }
+            /* a writer that started an epoch before the claim may have scanned the slot while it was free */
+            if (cow_load(ctx->epoch) != epoch)
+            {
+                cow_store(ctx->reader[i], 0);
+                break;
+            }
+            snap->root = cow_load(ctx->root);
+            snap->version = epoch - 1;
+            snap->slot = i;
+            return;
+        }
+        cow_yield();
+    }
+}
+
+void pg_cow_leave(pg_cow *ctx, pg_cow_snap const *snap)
+{
+    cow_store(ctx->reader[snap->slot], 0);
+}
+
+pg_item const *pg_cow_get(pg_cow_node const *root, char const *text)
+{
+    while (root)
+    {
+        int const cmp = strcmp(text, root->item.text);
+        if (cmp == 0) { return &root->item; }
+        root = cmp < 0 ? root->left : root->right;
+    }
+    return A_NULL;
+}
+
+pg_item const *pg_cow_at(pg_cow_node const *root, a_size index)
+{
+    while (root)
+    {
+        a_size const left = pg_cow_count(root->left);
+        if (index == left) { return &root->item; }
+        if (index < left) { root = root->left; }
+        else
+        {
+            index -= left + 1;
+            root = root->right;
+        }
+    }
+    return A_NULL;
+}
+
+a_size pg_cow_count(pg_cow_node const *root)
+{
+    return root ? root->count : 0;
+}
+
+void pg_cow_iter_init(pg_cow_iter *ctx, pg_cow_node const *root)
+{
+    ctx->depth = 0;
+    for (; root; root = root->left) { ctx->stack[ctx->depth++] = root; }
+}
+
+pg_item const *pg_cow_iter_next(pg_cow_iter *ctx)
+{
+    if (ctx->depth == 0) { return A_NULL; }
+    pg_cow_node const *node = ctx->stack[--ctx->depth];
+    for (pg_cow_node const *cur = node->right; cur; cur = cur->left) { ctx->stack[ctx->depth++] = cur; }
+    return &node->item;
+}
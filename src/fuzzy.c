@@ -0,0 +1,290 @@
+#include "pg/fuzzy.h"
+
+/* bytes of a pattern that fit in one machine word */
+#define WORD 64
+#define NONE 0xFFFFFFFF
+/* records between two calls of stop */
+#define POLL 0x1000
+
+static unsigned int fuzzy_fold(unsigned int c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static unsigned int fuzzy_gram(unsigned char const *s)
+{
+    return fuzzy_fold(s[0]) << 8 | fuzzy_fold(s[1]);
+}
+
+int pg_fuzzy_init(pg_fuzzy *ctx, pg_tree const *tree)
+{
+    ctx->item = A_NULL;
+    ctx->head = A_NULL;
+    ctx->list = A_NULL;
+    ctx->count = 0;
+    if (tree->count >= NONE) { return A_FAILURE; }
+    /* last number that listed every bigram, then where the next one goes */
+    a_u32 *last = (a_u32 *)a_alloc(A_NULL, sizeof(a_u32) * 0x10000);
+    ctx->item = (pg_item **)a_alloc(A_NULL, sizeof(pg_item *) * (tree->count + 1));
+    ctx->head = (a_u32 *)a_alloc(A_NULL, sizeof(a_u32) * 0x10001);
+    if (!last || !ctx->item || !ctx->head) { goto fail; }
+    a_fill(last, sizeof(a_u32) * 0x10000, 0xFF);
+    a_zero(ctx->head, sizeof(a_u32) * 0x10001);
+
+    a_size total = 0;
+    pg_tree_foreach(cur, tree)
+    {
+        pg_item *it = pg_tree_entry(cur);
+        a_u32 const id = (a_u32)ctx->count;
+        ctx->item[ctx->count++] = it;
+        for (unsigned char const *s = (unsigned char const *)it->text; s[0] && s[1]; ++s)
+        {
+            unsigned int const g = fuzzy_gram(s);
+            if (last[g] == id) { continue; }
+            last[g] = id;
+            ++ctx->head[g + 1];
+            ++total;
+        }
+    }
+    if (total >= NONE) { goto fail; }
+    for (unsigned int g = 0; g != 0x10000; ++g)
+    {
+        ctx->head[g + 1] += ctx->head[g];
+        last[g] = ctx->head[g];
+    }
+    ctx->list = (a_u32 *)a_alloc(A_NULL, sizeof(a_u32) * (total + 1));
+    if (!ctx->list) { goto fail; }
+    for (a_u32 id = 0; id != ctx->count; ++id)
+    {
+        for (unsigned char const *s = (unsigned char const *)ctx->item[id]->text; s[0] && s[1]; ++s)
+        {
+            unsigned int const g = fuzzy_gram(s);
+            /* numbers go in ascending, so a repeat is at the end of its list */
+            if (last[g] != ctx->head[g] && ctx->list[last[g] - 1] == id) { continue; }
+            ctx->list[last[g]++] = id;
+        }
+    }
+    a_die(last);
+    return A_SUCCESS;
+
+fail:
+    a_die(last);
+    pg_fuzzy_exit(ctx);
+    return A_OMEMORY;
+}
+
+void pg_fuzzy_exit(pg_fuzzy *ctx)
+{
+    a_die(ctx->item);
+    a_die(ctx->head);
+    a_die(ctx->list);
+    ctx->item = A_NULL;
+    ctx->head = A_NULL;
+    ctx->list = A_NULL;
+    ctx->count = 0;
+}
+
+typedef struct fuzzy_pattern
+{
+    unsigned char const *text;
+    a_size *row; /*!< column of the table for a long pattern */
+    a_size size;
+    a_u64 peq[0x100]; /*!< positions of every byte in a short pattern */
+} fuzzy_pattern;
+
+static int fuzzy_pattern_ctor(fuzzy_pattern *ctx, char const *pattern)
+{
+    ctx->text = (unsigned char const *)pattern;
+    ctx->size = strlen(pattern);
+    ctx->row = A_NULL;
+    if (ctx->size > WORD)
+    {
+        ctx->row = (a_size *)a_alloc(A_NULL, sizeof(a_size) * (ctx->size + 1));
+        return ctx->row ? A_SUCCESS : A_OMEMORY;
+    }
+    a_zero(ctx->peq, sizeof(ctx->peq));
+    for (a_size i = 0; i != ctx->size; ++i)
+    {
+        unsigned int const c = fuzzy_fold(ctx->text[i]);
+        ctx->peq[c] |= (a_u64)1 << i;
+        if (c >= 'a' && c <= 'z') { ctx->peq[c ^ 0x20] |= (a_u64)1 << i; }
+    }
+    return A_SUCCESS;
+}
+
+static void fuzzy_pattern_dtor(fuzzy_pattern *ctx)
+{
+    a_die(ctx->row);
+}
+
+/* Myers, with a free start in the text so the score is of the best substring */
+static a_size fuzzy_myers(fuzzy_pattern const *ctx, unsigned char const *text)
+{
+    a_u64 const high = (a_u64)1 << (ctx->size - 1);
+    a_u64 pv = ~(a_u64)0, mv = 0;
+    a_size score = ctx->size, best = ctx->size;
+    for (; *text && best; ++text)
+    {
+        a_u64 const eq = ctx->peq[*text];
+        a_u64 const xv = eq | mv;
+        a_u64 const xh = (((eq & pv) + pv) ^ pv) | eq;
+        a_u64 ph = mv | ~(xh | pv);
+        a_u64 mh = pv & xh;
+        if (ph & high) { ++score; }
+        else if (mh & high) { --score; }
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score < best) { best = score; }
+    }
+    return best;
+}
+
+/* one column of the table at a time, for patterns longer than a word */
+static a_size fuzzy_table(fuzzy_pattern const *ctx, unsigned char const *text)
+{
+    a_size *row = ctx->row;
+    a_size const m = ctx->size;
+    for (a_size i = 0; i <= m; ++i) { row[i] = i; }
+    a_size best = m;
+    for (; *text && best; ++text)
+    {
+        unsigned int const c = fuzzy_fold(*text);
+        a_size diag = 0;
+        for (a_size i = 1; i <= m; ++i)
+        {
+            a_size const up = row[i];
+            a_size x = diag + (fuzzy_fold(ctx->text[i - 1]) != c);
+            if (up + 1 < x) { x = up + 1; }
+            if (row[i - 1] + 1 < x) { x = row[i - 1] + 1; }
+            diag = up;
+            row[i] = x;
+        }
+        if (row[m] < best) { best = row[m]; }
+    }
+    return best;
+}
+
+static a_size fuzzy_score(fuzzy_pattern const *ctx, char const *text)
+{
+    if (ctx->size == 0) { return 0; }
+    if (ctx->row) { return fuzzy_table(ctx, (unsigned char const *)text); }
+    return fuzzy_myers(ctx, (unsigned char const *)text);
+}
+
+a_size pg_fuzzy_dist(char const *pattern, char const *text)
+{
+    fuzzy_pattern pat;
+    if (fuzzy_pattern_ctor(&pat, pattern)) { return strlen(pattern); }
+    a_size const dist = fuzzy_score(&pat, text);
+    fuzzy_pattern_dtor(&pat);
+    return dist;
+}
+
+static int fuzzy_hit(a_vec *out, pg_item *item, a_size index, a_size dist)
+{
+    pg_fuzzy_hit *hit = A_VEC_PUSH(pg_fuzzy_hit, out);
+    if (!hit) { return A_OMEMORY; }
+    hit->item = item;
+    hit->index = index;
+    hit->dist = dist;
+    return A_SUCCESS;
+}
+
+int pg_fuzzy_find(pg_fuzzy const *ctx, char const *pattern, a_size k, a_vec const *in, a_vec *out,
+                  int (*stop)(void *), void *arg)
+{
+    fuzzy_pattern pat;
+    if (fuzzy_pattern_ctor(&pat, pattern)) { return A_OMEMORY; }
+    int ok = A_SUCCESS;
+    if (in)
+    {
+        a_vec_foreach(pg_fuzzy_hit, *, it, in)
+        {
+            if (stop && (it - A_VEC_PTR(pg_fuzzy_hit, in)) % POLL == 0 && stop(arg))
+            {
+                ok = A_FAILURE;
+                break;
+            }
+            a_size const dist = fuzzy_score(&pat, it->item->text);
+            if (dist <= k && (ok = fuzzy_hit(out, it->item, it->index, dist))) { break; }
+        }
+        goto exit;
+    }
+
+    /*
+     an edit breaks at most two bigrams of the pattern, so a substring within
+     k edits shares all but 2k of its distinct bigrams with the pattern
+    */
+    a_u32 gram[WORD];
+    a_size num = 0, need = 0;
+    if (pat.size > 1 && pat.size <= WORD)
+    {
+        for (a_size i = 0; i + 1 < pat.size; ++i)
+        {
+            a_u32 const g = fuzzy_gram(pat.text + i);
+            a_size j = 0;
+            while (j != num && gram[j] != g) { ++j; }
+            if (j == num) { gram[num++] = g; }
+        }
+        if (num > 2 * k) { need = num - 2 * k; }
+    }
+    if (need == 0)
+    {
+        for (a_size id = 0; id != ctx->count; ++id)
+        {
+            if (stop && id % POLL == 0 && stop(arg))
+            {
+                ok = A_FAILURE;
+                break;
+            }
+            a_size const dist = fuzzy_score(&pat, ctx->item[id]->text);
+            if (dist <= k && (ok = fuzzy_hit(out, ctx->item[id], id, dist))) { break; }
+        }
+        goto exit;
+    }
+
+    a_u32 *shared = (a_u32 *)a_alloc(A_NULL, sizeof(a_u32) * (ctx->count + 1));
+    if (!shared)
+    {
+        ok = A_OMEMORY;
+        goto exit;
+    }
+    a_zero(shared, sizeof(a_u32) * ctx->count);
+    for (a_size i = 0; i != num; ++i)
+    {
+        a_u32 const *p = ctx->list + ctx->head[gram[i]];
+        a_u32 const *const end = ctx->list + ctx->head[gram[i] + 1];
+        for (; p != end; ++p) { ++shared[*p]; }
+    }
+    for (a_size id = 0; id != ctx->count; ++id)
+    {
+        if (stop && id % POLL == 0 && stop(arg))
+        {
+            ok = A_FAILURE;
+            break;
+        }
+        if (shared[id] < need) { continue; }
+        a_size const dist = fuzzy_score(&pat, ctx->item[id]->text);
+        if (dist <= k && (ok = fuzzy_hit(out, ctx->item[id], id, dist))) { break; }
+    }
+    a_die(shared);
+
+exit:
+    fuzzy_pattern_dtor(&pat);
+    return ok;
+}
+
+static int fuzzy_cmp(void const *lhs, void const *rhs)
+{
+    pg_fuzzy_hit const *l = (pg_fuzzy_hit const *)lhs;
+    pg_fuzzy_hit const *r = (pg_fuzzy_hit const *)rhs;
+    if (l->dist != r->dist) { return l->dist < r->dist ? -1 : 1; }
+    return (l->index > r->index) - (l->index < r->index);
+}
+
+void pg_fuzzy_rank(a_vec *hits)
+{
+    a_vec_sort(hits, fuzzy_cmp);
+}
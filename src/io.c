@@ -1,4 +1,48 @@
-#include "pg/pg.h"
+#include "pg/io.h"
+#include "pg/lz.h"
+#include "pg/stats.h"
+#if defined(_WIN32)
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 5105)
+#endif /* _MSC_VER */
+#include <windows.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif /* _MSC_VER */
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else /* !_WIN32 */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#if defined(_WIN32)
+#define open _open
+#define close _close
+#define read _read
+#define write _write
+#define fstat _fstat
+#define stat _stat
+#define O_RDONLY (_O_RDONLY | _O_BINARY)
+#define O_WRONLY (_O_WRONLY | _O_BINARY)
+#define O_CREAT _O_CREAT
+#define O_TRUNC _O_TRUNC
+#define O_EXCL _O_EXCL
+#define O_CLOEXEC 0
+#define lstat _stat
+#define S_ISREG(mode) (((mode) & _S_IFMT) == _S_IFREG)
+#define S_ISLNK(mode) 0
+#endif /* _WIN32 */
+
+#define BLOCK (1 << 16)
 
 long pg_io_fsize(FILE *handle)
 {
@@ -20,33 +64,55 @@ long pg_io_fsize(FILE *handle)
 
 long pg_io_size(char const *fname)
 {
-    FILE *handle = fopen(fname, "rb");
-    if (handle == 0) { return ~0; }
-    long size = pg_io_fsize(handle);
-    fclose(handle);
-    return size;
+    struct stat st;
+    if (stat(fname, &st)) { return ~0; }
+    return (long)st.st_size;
 }
 
 int pg_io_fread(FILE *handle, char **pdata, size_t *nbyte)
 {
-    long size = pg_io_fsize(handle);
-    if (size < 0) { return ~0; }
-    *pdata = malloc((size_t)size);
-    if (*pdata == 0) { return ~0; }
-    *nbyte = fread(*pdata, 1, (size_t)size, handle);
+    size_t size = 0, cap = BLOCK;
+    char *data = A_NULL;
+    for (;;)
+    {
+        char *ptr = (char *)a_alloc(data, cap);
+        if (!ptr)
+        {
+            a_die(data);
+            return ~0;
+        }
+        data = ptr;
+        size += fread(data + size, 1, cap - size, handle);
+        if (size != cap) { break; }
+        cap <<= 1;
+    }
+    if (ferror(handle))
+    {
+        a_die(data);
+        return ~0;
+    }
+    PG_STATS_ADD(PG_STATS_BYTES, size);
+    *pdata = data;
+    *nbyte = size;
     return 0;
 }
 
 int pg_io_read(char const *fname, char **pdata, size_t *nbyte)
 {
-    int ret = ~0;
-    FILE *handle = fopen(fname, "rb");
-    if (handle)
+    pg_io_map map;
+    if (pg_io_map_open(&map, fname)) { return ~0; }
+    if (map.mapped)
     {
-        ret = pg_io_fread(handle, pdata, nbyte);
-        fclose(handle);
+        /* callers own the memory, so a mapping is copied */
+        char *data = (char *)a_alloc(A_NULL, map.size + !map.size);
+        if (data) { a_copy(data, map.data, map.size); }
+        pg_io_map_close(&map);
+        if (!data) { return ~0; }
+        map.data = data;
     }
-    return ret;
+    *pdata = map.data;
+    *nbyte = map.size;
+    return 0;
 }
 
 int pg_io_fwrite(FILE *handle, void const *pdata, size_t nbyte)
@@ -60,12 +126,346 @@ int pg_io_fwrite(FILE *handle, void const *pdata, size_t nbyte)
 
 int pg_io_write(char const *fname, void const *pdata, size_t nbyte)
 {
-    int ret = ~0;
-    FILE *handle = fopen(fname, "wb");
-    if (handle)
+    pg_io_writer ctx;
+    if (pg_io_writer_open(&ctx, fname)) { return ~0; }
+    int ok = pg_io_writer_put(&ctx, pdata, nbyte);
+    return pg_io_writer_close(&ctx, ok == A_SUCCESS) ? ~0 : 0;
+}
+
+static int io_slurp(pg_io_map *ctx, int fd)
+{
+    a_size cap = BLOCK;
+    for (;;)
+    {
+        if (ctx->size == cap || !ctx->data)
+        {
+            if (ctx->data) { cap <<= 1; }
+            char *ptr = (char *)a_alloc(ctx->data, cap);
+            if (!ptr) { return A_FAILURE; }
+            ctx->data = ptr;
+        }
+        long n = (long)read(fd, ctx->data + ctx->size, (unsigned int)(cap - ctx->size));
+        if (n < 0) { return A_FAILURE; }
+        if (n == 0) { return A_SUCCESS; }
+        ctx->size += (a_size)n;
+    }
+}
+
+int pg_io_map_open(pg_io_map *ctx, char const *fname)
+{
+    struct stat st;
+    ctx->data = A_NULL;
+    ctx->size = 0;
+    ctx->mapped = 0;
+    int fd = open(fname, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return A_FAILURE; }
+    int ok = fstat(fd, &st) ? A_FAILURE : A_SUCCESS;
+#if !defined(_WIN32)
+    if (ok == A_SUCCESS && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *data = mmap(A_NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            ctx->data = (char *)data;
+            ctx->size = (a_size)st.st_size;
+            ctx->mapped = 1;
+            close(fd);
+            PG_STATS_ADD(PG_STATS_BYTES, ctx->size);
+            return A_SUCCESS;
+        }
+    }
+#endif /* _WIN32 */
+    if (ok == A_SUCCESS) { ok = io_slurp(ctx, fd); }
+    close(fd);
+    if (ok != A_SUCCESS)
+    {
+        a_die(ctx->data);
+        ctx->data = A_NULL;
+        ctx->size = 0;
+        return ok;
+    }
+    PG_STATS_ADD(PG_STATS_BYTES, ctx->size);
+    return A_SUCCESS;
+}
+
+void pg_io_map_close(pg_io_map *ctx)
+{
+#if !defined(_WIN32)
+    if (ctx->mapped) { munmap(ctx->data, ctx->size); }
+    else
+#endif /* _WIN32 */
+    {
+        a_die(ctx->data);
+    }
+    ctx->data = A_NULL;
+    ctx->size = 0;
+    ctx->mapped = 0;
+}
+
+void pg_io_line_init(pg_io_line *ctx, void const *pdata, a_size nbyte)
+{
+    ctx->ptr = (char const *)pdata;
+    ctx->end = ctx->ptr + nbyte;
+}
+
+char const *pg_io_line_next(pg_io_line *ctx, a_size *nbyte)
+{
+    char const *line = ctx->ptr;
+    if (line == ctx->end) { return A_NULL; }
+    char const *eol = (char const *)memchr(line, '\n', (size_t)(ctx->end - line));
+    if (eol) { ctx->ptr = eol + 1; }
+    else { ctx->ptr = eol = ctx->end; }
+    if (eol != line && eol[-1] == '\r') { --eol; }
+    *nbyte = (a_size)(eol - line);
+    return line;
+}
+
+int pg_io_getline(char const *fname, a_str *out)
+{
+    pg_io_map map;
+    pg_io_line iter;
+    if (pg_io_map_open(&map, fname)) { return A_FAILURE; }
+    pg_io_line_init(&iter, map.data, map.size);
+    int ok = A_SUCCESS;
+    a_size n = 0;
+    for (char const *line; (line = pg_io_line_next(&iter, &n)) != A_NULL;)
+    {
+        if (n)
+        {
+            ok = a_str_catn(out, line, n) ? A_FAILURE : A_SUCCESS;
+            break;
+        }
+    }
+    pg_io_map_close(&map);
+    return ok;
+}
+
+static int io_sync(int fd)
+{
+#if defined(_WIN32)
+    return _commit(fd) ? A_FAILURE : A_SUCCESS;
+#else /* !_WIN32 */
+    return fsync(fd) ? A_FAILURE : A_SUCCESS;
+#endif /* _WIN32 */
+}
+
+static int io_rename(char const *src, char const *dst)
+{
+#if defined(_WIN32)
+    return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? A_SUCCESS : A_FAILURE;
+#else /* !_WIN32 */
+    if (rename(src, dst)) { return A_FAILURE; }
+    /* the rename itself is on the disk only once the directory is */
+    a_str dir = A_STR_INIT;
+    char const *slash = strrchr(dst, '/');
+    int ok = slash ? a_str_catn(&dir, dst, slash == dst ? 1 : (a_size)(slash - dst)) : a_str_cats(&dir, ".");
+    int const fd = ok == A_SUCCESS ? open(a_str_ptr(&dir), O_RDONLY | O_CLOEXEC) : -1;
+    a_str_dtor(&dir);
+    if (fd < 0) { return A_FAILURE; }
+    ok = io_sync(fd);
+    close(fd);
+    return ok;
+#endif /* _WIN32 */
+}
+
+/* creates a temporary file next to the target with a name nobody else has */
+static int io_temp(a_str *temp, char const *fname)
+{
+    if (a_str_cats(temp, fname) || a_str_cats(temp, ".XXXXXX")) { return -1; }
+#if defined(_WIN32)
+    if (_mktemp_s(temp->ptr_, a_str_len(temp) + 1)) { return -1; }
+    return open(a_str_ptr(temp), O_WRONLY | O_CREAT | O_EXCL, _S_IREAD | _S_IWRITE);
+#else /* !_WIN32 */
+    int const fd = mkstemp(temp->ptr_);
+    if (fd >= 0) { fcntl(fd, F_SETFD, FD_CLOEXEC); }
+    return fd;
+#endif /* _WIN32 */
+}
+
+/* writes the buffer followed by data, retrying short writes */
+static int io_flush(pg_io_writer *ctx, void const *pdata, a_size nbyte)
+{
+    char const *head = ctx->buf;
+    a_size nhead = ctx->len;
+    char const *tail = (char const *)pdata;
+    a_size ntail = nbyte;
+    ctx->len = 0;
+    while (nhead + ntail)
+    {
+        long n;
+#if defined(_WIN32)
+        if (nhead) { n = (long)write(ctx->fd, head, (unsigned int)nhead); }
+        else { n = (long)write(ctx->fd, tail, (unsigned int)ntail); }
+#else /* !_WIN32 */
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (nhead)
+        {
+            iov[iovcnt].iov_base = (void *)(a_uptr)head;
+            iov[iovcnt++].iov_len = nhead;
+        }
+        if (ntail)
+        {
+            iov[iovcnt].iov_base = (void *)(a_uptr)tail;
+            iov[iovcnt++].iov_len = ntail;
+        }
+        n = (long)writev(ctx->fd, iov, iovcnt);
+        if (n < 0 && errno == EINTR) { continue; }
+#endif /* _WIN32 */
+        if (n < 0) { return ctx->error = A_FAILURE; }
+        a_size m = (a_size)n;
+        if (m >= nhead)
+        {
+            m -= nhead;
+            head += nhead;
+            nhead = 0;
+            tail += m;
+            ntail -= m;
+        }
+        else
+        {
+            head += m;
+            nhead -= m;
+        }
+    }
+    return A_SUCCESS;
+}
+
+int pg_io_writer_open(pg_io_writer *ctx, char const *fname)
+{
+    ctx->pack = A_NULL;
+    ctx->len = 0;
+    ctx->cap = BLOCK;
+    ctx->error = A_SUCCESS;
+    a_str_ctor(&ctx->name);
+    a_str_ctor(&ctx->temp);
+    ctx->buf = (char *)a_alloc(A_NULL, ctx->cap);
+    if (!ctx->buf) { return A_FAILURE; }
+    struct stat st;
+    int found = lstat(fname, &st) == 0;
+#if !defined(_WIN32)
+    /*
+     the file a symbolic link leads to is replaced and the link stays,
+     but /dev/stdout leads to whatever the shell opened, which is written.
+    */
+    char real[PATH_MAX];
+    if (found && S_ISLNK(st.st_mode) && strncmp(fname, "/dev/", 5) && realpath(fname, real))
+    {
+        fname = real;
+        found = lstat(fname, &st) == 0;
+    }
+#endif /* _WIN32 */
+    if (a_str_cats(&ctx->name, fname)) { goto fail; }
+    /* a device or a pipe cannot be replaced */
+    if (found && !S_ISREG(st.st_mode)) { ctx->fd = open(fname, O_WRONLY | O_TRUNC | O_CLOEXEC); }
+    else { ctx->fd = io_temp(&ctx->temp, fname); }
+    if (ctx->fd < 0) { goto fail; }
+    return A_SUCCESS;
+
+fail:
+    a_str_dtor(&ctx->temp);
+    a_str_dtor(&ctx->name);
+    a_die(ctx->buf);
+    return A_FAILURE;
+}
+
+/* writes the buffer as one block, stored as it is when packing does not shrink it */
+static int io_pack(pg_io_writer *ctx)
+{
+    char *out = ctx->pack + 8;
+    a_size n = ctx->len ? pg_lz_pack(ctx->buf, ctx->len, out, ctx->len - 1) : 0;
+    if (n == 0)
+    {
+        a_copy(out, ctx->buf, ctx->len);
+        n = ctx->len;
+    }
+    a_u32_setl(ctx->pack, (a_u32)ctx->len);
+    a_u32_setl(ctx->pack + 4, (a_u32)n);
+    ctx->len = 0;
+    return io_flush(ctx, ctx->pack, 8 + n);
+}
+
+int pg_io_writer_pack(pg_io_writer *ctx)
+{
+    static char const header[8] = {'P', 'G', 'Z', 0, PG_LZ_VERSION, 0, 0, 0};
+    if (ctx->error || io_flush(ctx, header, sizeof(header))) { return A_FAILURE; }
+    ctx->pack = (char *)a_alloc(A_NULL, 8 + ctx->cap);
+    return ctx->pack ? A_SUCCESS : (ctx->error = A_FAILURE);
+}
+
+int pg_io_writer_put(pg_io_writer *ctx, void const *pdata, a_size nbyte)
+{
+    if (ctx->error) { return ctx->error; }
+    if (ctx->pack)
+    {
+        char const *p = (char const *)pdata;
+        while (nbyte > ctx->cap - ctx->len)
+        {
+            a_size const n = ctx->cap - ctx->len;
+            a_copy(ctx->buf + ctx->len, p, n);
+            ctx->len = ctx->cap;
+            if (io_pack(ctx)) { return A_FAILURE; }
+            p += n;
+            nbyte -= n;
+        }
+        a_copy(ctx->buf + ctx->len, p, nbyte);
+        ctx->len += nbyte;
+        return A_SUCCESS;
+    }
+    if (nbyte > ctx->cap - ctx->len) { return io_flush(ctx, pdata, nbyte); }
+    a_copy(ctx->buf + ctx->len, pdata, nbyte);
+    ctx->len += nbyte;
+    return A_SUCCESS;
+}
+
+int pg_io_writer_at(pg_io_writer *ctx, a_u64 offset, void const *pdata, a_size nbyte)
+{
+    if (ctx->error || ctx->pack || io_flush(ctx, A_NULL, 0)) { return A_FAILURE; }
+#if defined(_WIN32)
+    __int64 end = _lseeki64(ctx->fd, 0, SEEK_CUR);
+    if (end < 0 || _lseeki64(ctx->fd, (__int64)offset, SEEK_SET) < 0 ||
+        io_flush(ctx, pdata, nbyte) || _lseeki64(ctx->fd, end, SEEK_SET) < 0)
+    {
+        return ctx->error = A_FAILURE;
+    }
+#else /* !_WIN32 */
+    char const *p = (char const *)pdata;
+    while (nbyte)
+    {
+        long n = (long)pwrite(ctx->fd, p, nbyte, (off_t)offset);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0) { return ctx->error = A_FAILURE; }
+        p += n;
+        nbyte -= (a_size)n;
+        offset += (a_u64)n;
+    }
+#endif /* _WIN32 */
+    return A_SUCCESS;
+}
+
+int pg_io_writer_close(pg_io_writer *ctx, int commit)
+{
+    int const direct = a_str_len(&ctx->temp) == 0;
+    int ok = commit && !ctx->error ? A_SUCCESS : A_FAILURE;
+    if (ok == A_SUCCESS && ctx->pack)
+    {
+        static char const end[8] = {0};
+        if (ctx->len) { ok = io_pack(ctx); }
+        if (ok == A_SUCCESS) { ok = io_flush(ctx, end, sizeof(end)); }
+    }
+    if (ok == A_SUCCESS) { ok = io_flush(ctx, A_NULL, 0); }
+    if (ok == A_SUCCESS && !direct) { ok = io_sync(ctx->fd); }
+    if (close(ctx->fd)) { ok = A_FAILURE; }
+    if (!direct)
     {
-        ret = pg_io_fwrite(handle, pdata, nbyte);
-        fclose(handle);
+        if (ok == A_SUCCESS) { ok = io_rename(a_str_ptr(&ctx->temp), a_str_ptr(&ctx->name)); }
+        else { remove(a_str_ptr(&ctx->temp)); }
     }
-    return ret;
+    a_str_dtor(&ctx->temp);
+    a_str_dtor(&ctx->name);
+    a_die(ctx->buf);
+    a_die(ctx->pack);
+    ctx->buf = A_NULL;
+    ctx->pack = A_NULL;
+    return ok;
 }
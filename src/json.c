@@ -1,4 +1,7 @@
 #include "pg/json.h"
+#include "pg/lz.h"
+#include "pg/stats.h"
+#include "pg/thread.h"
 #include <time.h>
 
 cJSON *pg_json_new(void)
@@ -13,14 +16,15 @@ void pg_json_die(cJSON *json)
 
 cJSON *pg_json_load(char const *fname)
 {
-    char *pdata = 0;
-    size_t nbyte = 0;
+    pg_io_map map;
     cJSON *out = NULL;
-    if (pg_io_read(fname, &pdata, &nbyte) == 0)
+    PG_STATS_BEGIN(t);
+    if (pg_io_map_open(&map, fname) == A_SUCCESS)
     {
-        out = cJSON_ParseWithLength(pdata, nbyte);
-        free(pdata);
+        out = cJSON_ParseWithLength(map.data, map.size);
+        pg_io_map_close(&map);
     }
+    PG_STATS_END(PG_STATS_JSON, t);
     return out;
 }
 
@@ -44,14 +48,13 @@ int pg_json_export(cJSON const *json, pg_tree *tree)
 {
     pg_view view;
     cJSON *object;
-    int n = cJSON_GetArraySize(json);
-    for (int i = 0; i != n; ++i)
+    cJSON *item;
+    cJSON_ArrayForEach(item, json)
     {
 #if defined(__GNUC__) || defined(__clang__)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wbad-function-cast"
 #endif /* __GNUC__ || __clang__ */
-        cJSON *item = cJSON_GetArrayItem(json, i);
 
         object = cJSON_GetObjectItem(item, "text");
         if (object == 0) { continue; }
@@ -80,15 +83,12 @@ int pg_json_export(cJSON const *json, pg_tree *tree)
         view.hint = cJSON_GetStringValue(object);
 
         pg_item *ctx = pg_tree_add(tree, view.text);
+        if (ctx == 0) { return A_OMEMORY; }
 
         object = cJSON_GetObjectItem(item, "time");
-        ctx->time = object ? (a_i64)cJSON_GetNumberValue(object) : time(NULL) + A_I32_MIN;
+        pg_tree_time(tree, ctx, object ? (a_i64)cJSON_GetNumberValue(object) : time(NULL) + A_I32_MIN);
 
-        pg_item_set_hash(ctx, view.hash);
-        pg_item_set_hint(ctx, view.hint);
-        pg_item_set_misc(ctx, view.misc);
-        pg_item_set_size(ctx, view.size);
-        pg_item_set_type(ctx, view.type);
+        if (pg_tree_set(tree, ctx, &view)) { return A_OMEMORY; }
 #if defined(__GNUC__) || defined(__clang__)
 #pragma GCC diagnostic pop
 #endif /* __GNUC__ || __clang__ */
@@ -101,22 +101,653 @@ int pg_json_import(cJSON *json, pg_tree const *tree)
     pg_tree_foreach(cur, tree)
     {
         pg_item *it = pg_tree_entry(cur);
-        if (a_str_len(it->text) == 0) { continue; }
+        if (*it->text == 0) { continue; }
         cJSON *item = cJSON_CreateObject();
-        cJSON_AddStringToObject(item, "text", a_str_ptr(it->text));
-        cJSON_AddStringToObject(item, "hash", a_str_ptr(it->hash));
+        cJSON_AddStringToObject(item, "text", it->text);
+        cJSON_AddStringToObject(item, "hash", pg_hash_name(it->hash));
         cJSON_AddNumberToObject(item, "size", it->size);
         cJSON_AddNumberToObject(item, "type", it->type);
-        if (a_str_len(it->misc) && it->type == PG_TYPE_OTHER)
+        if (it->misc && it->type == PG_TYPE_OTHER)
         {
-            cJSON_AddStringToObject(item, "misc", a_str_ptr(it->misc));
+            cJSON_AddStringToObject(item, "misc", it->misc);
         }
-        if (a_str_len(it->hint))
+        if (it->hint)
         {
-            cJSON_AddStringToObject(item, "hint", a_str_ptr(it->hint));
+            cJSON_AddStringToObject(item, "hint", it->hint);
         }
         cJSON_AddNumberToObject(item, "time", (double)it->time);
         cJSON_AddItemToArray(json, item);
     }
     return 0;
 }
+
+#define FIELD_TEXT (1 << 0)
+#define FIELD_HASH (1 << 1)
+#define FIELD_SIZE (1 << 2)
+#define FIELD_TYPE (1 << 3)
+#define FIELD_MISC (1 << 4)
+#define FIELD_HINT (1 << 5)
+#define FIELD_TIME (1 << 6)
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct json_reader
+{
+    pg_io_map map;
+    char const *ptr;
+    char const *end;
+    a_str key;
+    a_str text;
+    a_str hash;
+    a_str misc;
+    a_str hint;
+    double size;
+    double type;
+    double time;
+    int field;
+} json_reader;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+/* the whole file is in memory, so its end is the end of input */
+static A_INLINE int json_peek(json_reader *ctx)
+{
+    if (ctx->ptr != ctx->end) { return (unsigned char)*ctx->ptr; }
+    return ~0;
+}
+
+static A_INLINE int json_getc(json_reader *ctx)
+{
+    int c = json_peek(ctx);
+    if (c > ~0) { ++ctx->ptr; }
+    return c;
+}
+
+static int json_space(json_reader *ctx)
+{
+    for (;;)
+    {
+        int c = json_peek(ctx);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') { return c; }
+        ++ctx->ptr;
+    }
+}
+
+static int json_hex4(json_reader *ctx, unsigned long *out)
+{
+    *out = 0;
+    for (int i = 0; i != 4; ++i)
+    {
+        int x = pg_xdigit(json_getc(ctx));
+        if (x < 0) { return A_FAILURE; }
+        *out = (*out << 4) | (unsigned long)x;
+    }
+    return A_SUCCESS;
+}
+
+static int json_utf8(a_str *out, unsigned long x)
+{
+    char buf[4];
+    a_size n;
+    if (x < 0x80)
+    {
+        buf[0] = (char)x;
+        n = 1;
+    }
+    else if (x < 0x800)
+    {
+        buf[0] = (char)(0xC0 | (x >> 6));
+        buf[1] = (char)(0x80 | (x & 0x3F));
+        n = 2;
+    }
+    else if (x < 0x10000)
+    {
+        buf[0] = (char)(0xE0 | (x >> 12));
+        buf[1] = (char)(0x80 | ((x >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (x & 0x3F));
+        n = 3;
+    }
+    else
+    {
+        buf[0] = (char)(0xF0 | (x >> 18));
+        buf[1] = (char)(0x80 | ((x >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((x >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (x & 0x3F));
+        n = 4;
+    }
+    return a_str_catn(out, buf, n);
+}
+
+/* reads a string after its opening quote, out may be null to discard it */
+static int json_string(json_reader *ctx, a_str *out)
+{
+    if (out) { a_str_setn_(out, 0); }
+    for (;;)
+    {
+        char const *p = ctx->ptr;
+        while (p != ctx->end && *p != '"' && *p != '\\') { ++p; }
+        if (out && p != ctx->ptr && a_str_catn(out, ctx->ptr, (a_size)(p - ctx->ptr)))
+        {
+            return A_FAILURE;
+        }
+        ctx->ptr = p;
+        if (p == ctx->end) { return A_FAILURE; }
+        if (*ctx->ptr++ == '"') { break; }
+        unsigned long x;
+        switch (json_getc(ctx))
+        {
+        case '"': x = '"'; break;
+        case '\\': x = '\\'; break;
+        case '/': x = '/'; break;
+        case 'b': x = '\b'; break;
+        case 'f': x = '\f'; break;
+        case 'n': x = '\n'; break;
+        case 'r': x = '\r'; break;
+        case 't': x = '\t'; break;
+        case 'u':
+        {
+            if (json_hex4(ctx, &x)) { return A_FAILURE; }
+            if (x >= 0xD800 && x < 0xDC00)
+            {
+                unsigned long y;
+                if (json_getc(ctx) != '\\' || json_getc(ctx) != 'u') { return A_FAILURE; }
+                if (json_hex4(ctx, &y) || y < 0xDC00 || y > 0xDFFF) { return A_FAILURE; }
+                x = 0x10000 + ((x - 0xD800) << 10) + (y - 0xDC00);
+            }
+            break;
+        }
+        default:
+            return A_FAILURE;
+        }
+        if (out && json_utf8(out, x)) { return A_FAILURE; }
+    }
+    return out ? a_str_catn(out, "", 0) : A_SUCCESS;
+}
+
+static int json_number(json_reader *ctx, double *out)
+{
+    char buf[0x40];
+    unsigned int n = 0;
+    for (int c = json_peek(ctx); c > ~0; c = json_peek(ctx))
+    {
+        if (!strchr("+-.0123456789eE", c)) { break; }
+        if (n == sizeof(buf) - 1) { return A_FAILURE; }
+        buf[n++] = (char)c;
+        ++ctx->ptr;
+    }
+    buf[n] = 0;
+    char *end = 0;
+    *out = strtod(buf, &end);
+    return n && end == buf + n ? A_SUCCESS : A_FAILURE;
+}
+
+static int json_literal(json_reader *ctx, char const *str)
+{
+    for (; *str; ++str)
+    {
+        if (json_getc(ctx) != *str) { return A_FAILURE; }
+    }
+    return A_SUCCESS;
+}
+
+/* skips any value, nested containers are tracked by depth */
+static int json_skip(json_reader *ctx)
+{
+    unsigned long depth = 0;
+    do
+    {
+        int c = json_space(ctx);
+        switch (c)
+        {
+        case '"':
+            ++ctx->ptr;
+            if (json_string(ctx, A_NULL)) { return A_FAILURE; }
+            break;
+        case '{':
+        case '[':
+            ++ctx->ptr;
+            ++depth;
+            continue;
+        case '}':
+        case ']':
+            if (depth == 0) { return A_FAILURE; }
+            ++ctx->ptr;
+            --depth;
+            break;
+        case 't':
+            if (json_literal(ctx, "true")) { return A_FAILURE; }
+            break;
+        case 'f':
+            if (json_literal(ctx, "false")) { return A_FAILURE; }
+            break;
+        case 'n':
+            if (json_literal(ctx, "null")) { return A_FAILURE; }
+            break;
+        default:
+        {
+            double x;
+            if (json_number(ctx, &x)) { return A_FAILURE; }
+            break;
+        }
+        }
+        if (depth)
+        {
+            c = json_space(ctx);
+            if (c == ',' || c == ':') { ++ctx->ptr; }
+        }
+    } while (depth);
+    return A_SUCCESS;
+}
+
+static int json_value(json_reader *ctx, int field, a_str *str, double *num)
+{
+    int c = json_space(ctx);
+    if (c == '"' && str)
+    {
+        ++ctx->ptr;
+        if (json_string(ctx, str)) { return A_FAILURE; }
+        ctx->field |= field;
+        return A_SUCCESS;
+    }
+    if ((c == '-' || (c >= '0' && c <= '9')) && num)
+    {
+        if (json_number(ctx, num)) { return A_FAILURE; }
+        ctx->field |= field;
+        return A_SUCCESS;
+    }
+    ctx->field &= ~field;
+    return json_skip(ctx);
+}
+
+static int json_object(json_reader *ctx)
+{
+    ctx->field = 0;
+    if (json_space(ctx) == '}')
+    {
+        ++ctx->ptr;
+        return A_SUCCESS;
+    }
+    for (;;)
+    {
+        if (json_getc(ctx) != '"' || json_string(ctx, &ctx->key)) { return A_FAILURE; }
+        if (json_space(ctx) != ':') { return A_FAILURE; }
+        ++ctx->ptr;
+        char const *key = a_str_ptr(&ctx->key);
+        int ok;
+        if (strcmp(key, "text") == 0) { ok = json_value(ctx, FIELD_TEXT, &ctx->text, A_NULL); }
+        else if (strcmp(key, "hash") == 0) { ok = json_value(ctx, FIELD_HASH, &ctx->hash, A_NULL); }
+        else if (strcmp(key, "size") == 0) { ok = json_value(ctx, FIELD_SIZE, A_NULL, &ctx->size); }
+        else if (strcmp(key, "type") == 0) { ok = json_value(ctx, FIELD_TYPE, A_NULL, &ctx->type); }
+        else if (strcmp(key, "misc") == 0) { ok = json_value(ctx, FIELD_MISC, &ctx->misc, A_NULL); }
+        else if (strcmp(key, "hint") == 0) { ok = json_value(ctx, FIELD_HINT, &ctx->hint, A_NULL); }
+        else if (strcmp(key, "time") == 0) { ok = json_value(ctx, FIELD_TIME, A_NULL, &ctx->time); }
+        else { ok = json_skip(ctx); }
+        if (ok) { return ok; }
+        int c = json_space(ctx);
+        ++ctx->ptr;
+        if (c == '}') { return A_SUCCESS; }
+        if (c != ',') { return A_FAILURE; }
+        json_space(ctx);
+    }
+}
+
+static int json_record(json_reader *ctx, pg_tree *tree)
+{
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wbad-function-cast"
+#endif /* __GNUC__ || __clang__ */
+    pg_view view;
+    int const need = FIELD_TEXT | FIELD_SIZE | FIELD_TYPE;
+    if ((ctx->field & need) != need) { return A_SUCCESS; }
+    view.text = a_str_ptr(&ctx->text);
+    view.hash = ctx->field & FIELD_HASH ? a_str_ptr(&ctx->hash) : "MD5";
+    view.size = (unsigned int)ctx->size;
+    view.type = (unsigned int)ctx->type;
+    view.misc = 0;
+    if (view.type == PG_TYPE_OTHER)
+    {
+        if (!(ctx->field & FIELD_MISC)) { return A_SUCCESS; }
+        view.misc = a_str_ptr(&ctx->misc);
+    }
+    view.hint = ctx->field & FIELD_HINT ? a_str_ptr(&ctx->hint) : 0;
+
+    pg_item *item = pg_tree_push(tree, view.text, strlen(view.text));
+    if (item == 0) { return A_OMEMORY; }
+    PG_STATS_ADD(PG_STATS_ROWS, 1);
+    pg_tree_time(tree, item, ctx->field & FIELD_TIME ? (a_i64)ctx->time : time(NULL) + A_I32_MIN);
+    return pg_tree_set(tree, item, &view);
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+}
+
+static int json_read(json_reader *ctx, pg_tree *tree)
+{
+    if (json_space(ctx) != '[') { return A_FAILURE; }
+    ++ctx->ptr;
+    if (json_space(ctx) == ']') { return A_SUCCESS; }
+    for (;;)
+    {
+        int ok;
+        if (json_peek(ctx) == '{')
+        {
+            ++ctx->ptr;
+            ok = json_object(ctx);
+            if (ok == A_SUCCESS) { ok = json_record(ctx, tree); }
+        }
+        else { ok = json_skip(ctx); }
+        if (ok) { return ok; }
+        int c = json_space(ctx);
+        ++ctx->ptr;
+        if (c == ']') { return A_SUCCESS; }
+        if (c != ',') { return A_FAILURE; }
+        json_space(ctx);
+    }
+}
+
+int pg_json_read(char const *fname, pg_tree *tree)
+{
+    int ok = A_FAILURE;
+    json_reader ctx;
+    PG_STATS_BEGIN(t);
+    if (pg_io_map_open(&ctx.map, fname)) { return ok; }
+    if (pg_lz_map(&ctx.map))
+    {
+        pg_io_map_close(&ctx.map);
+        return ok;
+    }
+    ctx.ptr = ctx.map.data;
+    ctx.end = ctx.map.data + ctx.map.size;
+    a_str_ctor(&ctx.key);
+    a_str_ctor(&ctx.text);
+    a_str_ctor(&ctx.hash);
+    a_str_ctor(&ctx.misc);
+    a_str_ctor(&ctx.hint);
+    ok = json_read(&ctx, tree);
+    a_str_dtor(&ctx.key);
+    a_str_dtor(&ctx.text);
+    a_str_dtor(&ctx.hash);
+    a_str_dtor(&ctx.misc);
+    a_str_dtor(&ctx.hint);
+    pg_io_map_close(&ctx.map);
+    PG_STATS_END(PG_STATS_JSON, t);
+    return ok;
+}
+
+int pg_json_quote(a_str *out, char const *str)
+{
+    char const *p = str;
+    if (a_str_catc(out, '"') < 0) { return A_FAILURE; }
+    for (;; ++p)
+    {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') { continue; }
+        if (p != str && a_str_catn(out, str, (size_t)(p - str))) { return A_FAILURE; }
+        str = p + 1;
+        if (c == 0) { break; }
+        char esc[8] = {'\\', 0, 0, 0, 0, 0, 0, 0};
+        size_t n = 2;
+        switch (c)
+        {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            n = 6;
+        }
+        if (a_str_catn(out, esc, n)) { return A_FAILURE; }
+    }
+    return a_str_catc(out, '"') < 0 ? A_FAILURE : A_SUCCESS;
+}
+
+int pg_json_item(a_str *out, pg_item const *item)
+{
+    if (a_str_cats(out, "{\"text\":") || pg_json_quote(out, item->text)) { return A_FAILURE; }
+    if (a_str_cats(out, ",\"hash\":") || pg_json_quote(out, pg_hash_name(item->hash))) { return A_FAILURE; }
+    if (a_str_catf(out, ",\"size\":%u,\"type\":%u", item->size, item->type) < 0) { return A_FAILURE; }
+    if (item->misc && item->type == PG_TYPE_OTHER)
+    {
+        if (a_str_cats(out, ",\"misc\":") || pg_json_quote(out, item->misc)) { return A_FAILURE; }
+    }
+    if (item->hint)
+    {
+        if (a_str_cats(out, ",\"hint\":") || pg_json_quote(out, item->hint)) { return A_FAILURE; }
+    }
+    return a_str_catf(out, ",\"time\":%lld}", (long long)item->time) < 0 ? A_FAILURE : A_SUCCESS;
+}
+
+static int json_write(pg_io_writer *out, pg_tree const *tree)
+{
+    int ok = A_SUCCESS;
+    a_str str = A_STR_INIT;
+    char sep = '[';
+    pg_tree_foreach(cur, tree)
+    {
+        pg_item *it = pg_tree_entry(cur);
+        if (*it->text == 0) { continue; }
+        a_str_setn_(&str, 0);
+        if (a_str_catc(&str, sep) < 0 || pg_json_item(&str, it) ||
+            pg_io_writer_put(out, a_str_ptr(&str), a_str_len(&str)))
+        {
+            ok = A_FAILURE;
+            break;
+        }
+        sep = ',';
+    }
+    a_str_dtor(&str);
+    if (ok) { return ok; }
+    if (sep == '[' && pg_io_writer_put(out, "[", 1)) { return A_FAILURE; }
+    return pg_io_writer_put(out, "]", 1);
+}
+
+/* records that a formatter takes at once */
+#define BATCH 0x400
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct json_batch
+{
+    pg_item const *item[BATCH];
+    a_str text; /*!< the records printed, owned by the writer once ready */
+    a_size num;
+    int ready;
+} json_batch;
+
+/*
+ batch i lives in slot i % slots, the walker fills it once the writer has
+ written batch i - slots, so at most slots batches are held at any time
+*/
+typedef struct json_pipe
+{
+    pg_mutex lock;
+    pg_cond cond;
+    pg_tree const *tree;
+    json_batch *slot;
+    a_size slots;
+    a_size cut; /*!< batches the walker has filled */
+    a_size taken; /*!< batches that formatters took */
+    a_size wrote; /*!< batches that the writer wrote */
+    int end; /*!< the walker reached the end of the tree */
+    int quit; /*!< a step failed, so every thread stops */
+} json_pipe;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+static void *json_walk(void *arg)
+{
+    json_pipe *ctx = (json_pipe *)arg;
+    a_avl_node *cur = a_avl_head(&ctx->tree->root);
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        while (!ctx->quit && ctx->cut - ctx->wrote == ctx->slots) { pg_cond_wait(&ctx->cond, &ctx->lock); }
+        json_batch *b = ctx->slot + ctx->cut % ctx->slots;
+        int const quit = ctx->quit;
+        pg_mutex_unlock(&ctx->lock);
+        if (quit) { break; }
+        for (b->num = 0; cur && b->num != BATCH; cur = a_avl_next(cur))
+        {
+            pg_item const *it = pg_tree_entry(cur);
+            if (*it->text) { b->item[b->num++] = it; }
+        }
+        pg_mutex_lock(&ctx->lock);
+        if (b->num) { ++ctx->cut; }
+        if (!cur) { ctx->end = 1; }
+        pg_cond_broadcast(&ctx->cond);
+        pg_mutex_unlock(&ctx->lock);
+        if (!cur) { break; }
+    }
+    return A_NULL;
+}
+
+static void *json_format(void *arg)
+{
+    json_pipe *ctx = (json_pipe *)arg;
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        while (!ctx->quit && !ctx->end && ctx->taken == ctx->cut) { pg_cond_wait(&ctx->cond, &ctx->lock); }
+        if (ctx->quit || ctx->taken == ctx->cut)
+        {
+            pg_mutex_unlock(&ctx->lock);
+            break;
+        }
+        a_size const i = ctx->taken++;
+        pg_mutex_unlock(&ctx->lock);
+        json_batch *b = ctx->slot + i % ctx->slots;
+        int ok = A_SUCCESS;
+        a_str_setn_(&b->text, 0);
+        for (a_size j = 0; ok == A_SUCCESS && j != b->num; ++j)
+        {
+            if (a_str_catc(&b->text, i || j ? ',' : '[') < 0 || pg_json_item(&b->text, b->item[j])) { ok = A_FAILURE; }
+        }
+        pg_mutex_lock(&ctx->lock);
+        if (ok) { ctx->quit = 1; }
+        else { b->ready = 1; }
+        pg_cond_broadcast(&ctx->cond);
+        pg_mutex_unlock(&ctx->lock);
+    }
+    return A_NULL;
+}
+
+/* the calling thread writes batches in order while others walk and print */
+static int json_pipe_write(json_pipe *ctx, pg_io_writer *out)
+{
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        json_batch *b = ctx->slot + ctx->wrote % ctx->slots;
+        while (!ctx->quit && !b->ready && !(ctx->end && ctx->wrote == ctx->cut)) { pg_cond_wait(&ctx->cond, &ctx->lock); }
+        int const quit = ctx->quit || !b->ready;
+        pg_mutex_unlock(&ctx->lock);
+        if (quit) { break; }
+        int const ok = pg_io_writer_put(out, a_str_ptr(&b->text), a_str_len(&b->text));
+        pg_mutex_lock(&ctx->lock);
+        b->ready = 0;
+        ++ctx->wrote;
+        if (ok) { ctx->quit = 1; }
+        pg_cond_broadcast(&ctx->cond);
+        pg_mutex_unlock(&ctx->lock);
+    }
+    pg_mutex_lock(&ctx->lock);
+    int const ok = ctx->quit ? A_FAILURE : A_SUCCESS;
+    ctx->quit = 1;
+    pg_cond_broadcast(&ctx->cond);
+    pg_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+/*
+ one thread walks the tree into batches, a formatter per processor prints
+ them and the calling thread writes them in order, so printing overlaps the
+ writes and memory is bounded by the batches in flight
+*/
+static int json_write_n(pg_io_writer *out, pg_tree const *tree)
+{
+    a_size jobs = pg_thread_cpus();
+    if (jobs * BATCH > tree->count) { jobs = tree->count / BATCH; }
+    if (jobs == 0) { return json_write(out, tree); }
+    json_pipe ctx;
+    ctx.tree = tree;
+    ctx.slots = jobs * 2 + 2;
+    ctx.slot = (json_batch *)a_alloc(A_NULL, sizeof(json_batch) * ctx.slots);
+    pg_thread *thread = (pg_thread *)a_alloc(A_NULL, sizeof(pg_thread) * (jobs + 1));
+    if (!ctx.slot || !thread)
+    {
+        a_die(ctx.slot);
+        a_die(thread);
+        return json_write(out, tree);
+    }
+    for (a_size i = 0; i != ctx.slots; ++i)
+    {
+        a_str_ctor(&ctx.slot[i].text);
+        ctx.slot[i].ready = 0;
+    }
+    pg_mutex_ctor(&ctx.lock);
+    pg_cond_ctor(&ctx.cond);
+    ctx.cut = 0;
+    ctx.taken = 0;
+    ctx.wrote = 0;
+    ctx.end = 0;
+    ctx.quit = 0;
+
+    a_size n = 0;
+    for (; n != jobs; ++n)
+    {
+        if (pg_thread_ctor(thread + n, json_format, &ctx)) { break; }
+    }
+    int ok = A_FAILURE, serial = 0;
+    if (n && pg_thread_ctor(thread + n, json_walk, &ctx) == A_SUCCESS)
+    {
+        ok = json_pipe_write(&ctx, out);
+        pg_thread_join(thread + n);
+    }
+    else
+    {
+        /* nothing was written yet, so the serial path starts over */
+        pg_mutex_lock(&ctx.lock);
+        ctx.quit = 1;
+        pg_cond_broadcast(&ctx.cond);
+        pg_mutex_unlock(&ctx.lock);
+        serial = 1;
+    }
+    while (n) { pg_thread_join(thread + --n); }
+    for (a_size i = 0; i != ctx.slots; ++i) { a_str_dtor(&ctx.slot[i].text); }
+    pg_cond_dtor(&ctx.cond);
+    pg_mutex_dtor(&ctx.lock);
+    a_die(ctx.slot);
+    a_die(thread);
+    if (serial) { return json_write(out, tree); }
+    if (ok) { return ok; }
+    if (ctx.wrote == 0 && pg_io_writer_put(out, "[", 1)) { return A_FAILURE; }
+    return pg_io_writer_put(out, "]", 1);
+}
+
+int pg_json_write(char const *fname, pg_tree const *tree)
+{
+    pg_io_writer out;
+    PG_STATS_BEGIN(t);
+    if (pg_io_writer_open(&out, fname)) { return A_FAILURE; }
+    a_size const n = strlen(fname);
+    int ok = n > 4 && strcmp(fname + n - 4, ".pgz") == 0 ? pg_io_writer_pack(&out) : A_SUCCESS;
+    if (ok == A_SUCCESS) { ok = json_write_n(&out, tree); }
+    ok = pg_io_writer_close(&out, ok == A_SUCCESS);
+    PG_STATS_END(PG_STATS_JSON, t);
+    return ok;
+}
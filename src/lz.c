@@ -0,0 +1,297 @@
+#include "pg/lz.h"
+#include "pg/stats.h"
+#include "pg/thread.h"
+#include "a/vec.h"
+
+#define HEADER 8
+/* shortest match */
+#define MATCH 4
+/* bytes at the end that are always literals */
+#define LAST 5
+/* a match starts at least this far from the end */
+#define LIMIT 12
+/* farthest offset */
+#define FAR 0xFFFF
+/* bits of the hash of 4 bytes */
+#define HASH 13
+/* the step of the search grows by one every 1 << SKIP literals */
+#define SKIP 6
+
+static unsigned char const magic[4] = {'P', 'G', 'Z', 0};
+
+static unsigned int lz_hash(unsigned char const *p)
+{
+    return (a_u32)(a_u32_getl(p) * 2654435761U) >> (32 - HASH);
+}
+
+/* number of bytes that are the same from p and q, up to end */
+static a_size lz_same(unsigned char const *p, unsigned char const *q, unsigned char const *end)
+{
+    unsigned char const *const start = p;
+    for (; p + 8 <= end; p += 8, q += 8)
+    {
+        a_u64 x = a_u64_getl(p) ^ a_u64_getl(q);
+        if (x == 0) { continue; }
+        for (; (x & 0xFF) == 0; x >>= 8) { ++p; }
+        return (a_size)(p - start);
+    }
+    for (; p < end && *p == *q; ++p, ++q) {}
+    return (a_size)(p - start);
+}
+
+/* writes what is left of a field of 15 in the token */
+static unsigned char *lz_put(unsigned char *op, a_size n)
+{
+    for (n -= 15; n >= 0xFF; n -= 0xFF) { *op++ = 0xFF; }
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+a_size pg_lz_bound(a_size nbyte)
+{
+    return nbyte + nbyte / 0xFF + 16;
+}
+
+a_size pg_lz_pack(void const *pdata, a_size nbyte, void *out, a_size cap)
+{
+    unsigned char const *const src = (unsigned char const *)pdata;
+    unsigned char const *const end = src + nbyte;
+    unsigned char const *ip = src, *anchor = src;
+    unsigned char *op = (unsigned char *)out;
+    unsigned char *const oend = op + cap;
+    PG_STATS_BEGIN(t);
+
+    if (nbyte > LIMIT)
+    {
+        /* positions of the last 4 bytes seen with every hash, the first is a fair guess */
+        a_u32 table[1 << HASH];
+        a_zero(table, sizeof(table));
+        unsigned char const *const limit = end - LIMIT;
+        unsigned char const *const mend = end - LAST;
+        while (ip <= limit)
+        {
+            unsigned int const h = lz_hash(ip);
+            unsigned char const *ref = src + table[h];
+            table[h] = (a_u32)(ip - src);
+            if ((a_size)(ip - ref) - 1 >= FAR || a_u32_getl(ref) != a_u32_getl(ip))
+            {
+                ip += 1 + ((a_size)(ip - anchor) >> SKIP);
+                continue;
+            }
+            for (; ip > anchor && ref > src && ip[-1] == ref[-1]; --ip, --ref) {}
+            a_size const len = MATCH + lz_same(ip + MATCH, ref + MATCH, mend);
+            a_size const lit = (a_size)(ip - anchor);
+            a_size const more = len - MATCH;
+            if ((a_size)(oend - op) < lit + lit / 0xFF + more / 0xFF + 5) { return 0; }
+            *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4 | (more < 15 ? more : 15));
+            if (lit >= 15) { op = lz_put(op, lit); }
+            memcpy(op, anchor, lit);
+            op += lit;
+            a_u16_setl(op, (a_u16)(ip - ref));
+            op += 2;
+            if (more >= 15) { op = lz_put(op, more); }
+            ip += len;
+            anchor = ip;
+            /* the bytes just before the next search often start a match again */
+            table[lz_hash(ip - 2)] = (a_u32)(ip - 2 - src);
+        }
+    }
+
+    a_size const lit = (a_size)(end - anchor);
+    if ((a_size)(oend - op) < lit + lit / 0xFF + 2) { return 0; }
+    *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) { op = lz_put(op, lit); }
+    memcpy(op, anchor, lit);
+    op += lit;
+    PG_STATS_END(PG_STATS_LZ, t);
+    PG_STATS_ADD(PG_STATS_LZ_BYTES, nbyte);
+    return (a_size)(op - (unsigned char *)out);
+}
+
+/* reads what is left of a field of 15 in the token, null when the block ends first */
+static unsigned char const *lz_get(unsigned char const *ip, unsigned char const *end, a_size *n)
+{
+    for (;;)
+    {
+        if (ip == end) { return A_NULL; }
+        unsigned int const c = *ip++;
+        *n += c;
+        if (c != 0xFF) { return ip; }
+    }
+}
+
+a_size pg_lz_unpack(void const *pdata, a_size nbyte, void *out, a_size cap)
+{
+    unsigned char const *ip = (unsigned char const *)pdata;
+    unsigned char const *const end = ip + nbyte;
+    unsigned char *const dst = (unsigned char *)out;
+    unsigned char *op = dst;
+    unsigned char *const oend = op + cap;
+    while (ip != end)
+    {
+        unsigned int const token = *ip++;
+        a_size lit = token >> 4;
+        if (lit == 15 && (ip = lz_get(ip, end, &lit)) == A_NULL) { return ~(a_size)0; }
+        if ((a_size)(end - ip) < lit || (a_size)(oend - op) < lit) { return ~(a_size)0; }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == end) { return (a_size)(op - dst); }
+        if (end - ip < 2) { return ~(a_size)0; }
+        a_size const off = a_u16_getl(ip);
+        ip += 2;
+        a_size len = token & 15;
+        if (len == 15 && (ip = lz_get(ip, end, &len)) == A_NULL) { return ~(a_size)0; }
+        len += MATCH;
+        if (off == 0 || off > (a_size)(op - dst) || (a_size)(oend - op) < len) { return ~(a_size)0; }
+        unsigned char const *ref = op - off;
+        if (off >= len) { memcpy(op, ref, len); }
+        else
+        {
+            /* the match overlaps what it writes, which repeats a short run */
+            for (a_size i = 0; i != len; ++i) { op[i] = ref[i]; }
+        }
+        op += len;
+    }
+    /* a block ends with literals, even none of them */
+    return ~(a_size)0;
+}
+
+int pg_lz_is(void const *pdata, a_size nbyte)
+{
+    return nbyte >= HEADER && memcmp(pdata, magic, sizeof(magic)) == 0;
+}
+
+typedef struct lz_block
+{
+    a_size src; /*!< offset of the block in the file */
+    a_size dst; /*!< offset of its data */
+    a_u32 size; /*!< size of the data */
+    a_u32 pack; /*!< size of the block */
+} lz_block;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+typedef struct lz_unpack
+{
+    pg_mutex lock;
+    lz_block const *block;
+    char const *src;
+    char *dst;
+    a_size num;
+    a_size next; /*!< next block to take */
+    int ok;
+} lz_unpack;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+static void *lz_unpack_(void *arg)
+{
+    lz_unpack *ctx = (lz_unpack *)arg;
+    for (;;)
+    {
+        pg_mutex_lock(&ctx->lock);
+        a_size const i = ctx->ok ? ctx->num : ctx->next++;
+        pg_mutex_unlock(&ctx->lock);
+        if (i >= ctx->num) { break; }
+        lz_block const *b = ctx->block + i;
+        int ok = A_SUCCESS;
+        if (b->pack == b->size) { a_copy(ctx->dst + b->dst, ctx->src + b->src, b->size); }
+        else if (pg_lz_unpack(ctx->src + b->src, b->pack, ctx->dst + b->dst, b->size) != b->size)
+        {
+            ok = A_FAILURE;
+        }
+        if (ok)
+        {
+            pg_mutex_lock(&ctx->lock);
+            ctx->ok = ok;
+            pg_mutex_unlock(&ctx->lock);
+        }
+    }
+    return A_NULL;
+}
+
+/* lists the blocks of a packed file, the file must end right after its end */
+static int lz_scan(char const *data, a_size size, a_vec *block, a_size *total)
+{
+    unsigned char const *p = (unsigned char const *)data;
+    if (a_u32_getl(p + 4) != PG_LZ_VERSION) { return A_FAILURE; }
+    a_size pos = HEADER;
+    *total = 0;
+    for (;;)
+    {
+        if (size - pos < HEADER) { return A_FAILURE; }
+        a_u32 const n = a_u32_getl(p + pos);
+        a_u32 const m = a_u32_getl(p + pos + 4);
+        pos += HEADER;
+        if (n == 0 && m == 0) { break; }
+        if (n > PG_LZ_BLOCK || m == 0 || m > n || size - pos < m) { return A_FAILURE; }
+        lz_block *b = A_VEC_PUSH(lz_block, block);
+        if (!b) { return A_OMEMORY; }
+        b->src = pos;
+        b->dst = *total;
+        b->size = n;
+        b->pack = m;
+        pos += m;
+        *total += n;
+    }
+    return pos == size ? A_SUCCESS : A_FAILURE;
+}
+
+int pg_lz_map(pg_io_map *ctx)
+{
+    if (!pg_lz_is(ctx->data, ctx->size)) { return A_SUCCESS; }
+    PG_STATS_BEGIN(t);
+    a_vec block;
+    a_vec_ctor(&block, sizeof(lz_block));
+    a_size total;
+    int ok = lz_scan(ctx->data, ctx->size, &block, &total);
+    char *dst = A_NULL;
+    if (ok == A_SUCCESS)
+    {
+        dst = (char *)a_alloc(A_NULL, total + 1);
+        if (!dst) { ok = A_OMEMORY; }
+    }
+    if (ok == A_SUCCESS)
+    {
+        lz_unpack job;
+        pg_mutex_ctor(&job.lock);
+        job.block = A_VEC_PTR(lz_block, &block);
+        job.src = ctx->data;
+        job.dst = dst;
+        job.num = a_vec_num(&block);
+        job.next = 0;
+        job.ok = A_SUCCESS;
+        a_size jobs = pg_thread_cpus();
+        if (jobs > job.num) { jobs = job.num; }
+        pg_thread *worker = jobs > 1 ? (pg_thread *)a_alloc(A_NULL, sizeof(pg_thread) * jobs) : A_NULL;
+        a_size n = 0;
+        /* the calling thread is one of the workers */
+        for (; worker && n + 1 < jobs; ++n)
+        {
+            if (pg_thread_ctor(worker + n, lz_unpack_, &job)) { break; }
+        }
+        lz_unpack_(&job);
+        while (n) { pg_thread_join(worker + --n); }
+        a_die(worker);
+        pg_mutex_dtor(&job.lock);
+        ok = job.ok;
+    }
+    a_vec_dtor(&block, A_NULL);
+    if (ok)
+    {
+        a_die(dst);
+        return ok;
+    }
+    pg_io_map_close(ctx);
+    ctx->data = dst;
+    ctx->size = total;
+    PG_STATS_END(PG_STATS_LZ, t);
+    PG_STATS_ADD(PG_STATS_LZ_BYTES, total);
+    return A_SUCCESS;
+}
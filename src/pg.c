@@ -1,51 +1,51 @@
 #include "pg/pg.h"
+#include "pg/stats.h"
 #include <stdlib.h>
 #include <ctype.h>
 #include "hmac.h"
 
-static hash_s const *tohash(char const *text)
+static char const *const hash_name[2][PG_HASH_TOTAL] = {
+    {"MD5", "SHA1", "SHA224", "SHA256", "SHA384", "SHA512", "SHA3", "BLAKE2S", "BLAKE2B"},
+    {"md5", "sha1", "sha224", "sha256", "sha384", "sha512", "sha3", "blake2s", "blake2b"},
+};
+
+static hash_s const *const hash_list[PG_HASH_TOTAL] = {
+    &hash_md5,
+    &hash_sha1,
+    &hash_sha224,
+    &hash_sha256,
+    &hash_sha384,
+    &hash_sha512,
+    &hash_sha3_512,
+    &hash_blake2s_256,
+    &hash_blake2b_512,
+};
+
+unsigned int pg_hash_id(char const *name)
 {
-    switch (text ? *text : 0)
+    if (name == 0) { return PG_HASH_MD5; }
+    unsigned int cases = (*name >= 'a' && *name <= 'z');
+    for (unsigned int id = 0; id != PG_HASH_TOTAL; ++id)
     {
-    case 'm':
-        if (strcmp(text, "md5") == 0) { return &hash_md5; }
-        break;
-    case 'M':
-        if (strcmp(text, "MD5") == 0) { return &hash_md5; }
-        break;
-    case 's':
-        if (strcmp(text, "sha1") == 0) { return &hash_sha1; }
-        if (strcmp(text, "sha256") == 0) { return &hash_sha256; }
-        if (strcmp(text, "sha224") == 0) { return &hash_sha224; }
-        if (strcmp(text, "sha512") == 0) { return &hash_sha512; }
-        if (strcmp(text, "sha384") == 0) { return &hash_sha384; }
-        if (strcmp(text, "sha3") == 0) { return &hash_sha3_512; }
-        break;
-    case 'S':
-        if (strcmp(text, "SHA1") == 0) { return &hash_sha1; }
-        if (strcmp(text, "SHA256") == 0) { return &hash_sha256; }
-        if (strcmp(text, "SHA224") == 0) { return &hash_sha224; }
-        if (strcmp(text, "SHA512") == 0) { return &hash_sha512; }
-        if (strcmp(text, "SHA384") == 0) { return &hash_sha384; }
-        if (strcmp(text, "SHA3") == 0) { return &hash_sha3_512; }
-        break;
-    case 'b':
-        if (strcmp(text, "blake2s") == 0) { return &hash_blake2s_256; }
-        if (strcmp(text, "blake2b") == 0) { return &hash_blake2b_512; }
-        break;
-    case 'B':
-        if (strcmp(text, "BLAKE2S") == 0) { return &hash_blake2s_256; }
-        if (strcmp(text, "BLAKE2B") == 0) { return &hash_blake2b_512; }
-        break;
-    default:
-        break;
+        if (strcmp(name, hash_name[cases][id]) == 0) { return id; }
     }
-    return &hash_md5;
+    return PG_HASH_MD5;
+}
+
+char const *pg_hash_name(unsigned int id)
+{
+    return hash_name[0][id < PG_HASH_TOTAL ? id : PG_HASH_MD5];
+}
+
+static hash_s const *tohash(char const *text)
+{
+    return hash_list[pg_hash_id(text)];
 }
 
 static char *hmac(void const *key, size_t keysiz, void const *msg, size_t msgsiz, hash_s const *hash, void *out)
 {
     hmac_s ctx;
+    PG_STATS_ADD(PG_STATS_HMAC, 1);
     hmac_init(&ctx, hash, key, keysiz);
     hmac_proc(&ctx, msg, msgsiz);
     hmac_done(&ctx, ctx.buf);
@@ -57,7 +57,7 @@ static char *hmac(void const *key, size_t keysiz, void const *msg, size_t msgsiz
     void *func(void const *pdata, size_t nbyte, void *out)   \
     {                                                        \
         char const *p = (char const *)pdata;                 \
-        if (out || ((void)(out = malloc(nbyte + 1)), out))   \
+        if (out || ((void)(out = a_alloc(A_NULL, nbyte + 1)), out))   \
         {                                                    \
             char *o = (char *)out;                           \
             pdata = (void const *)(p + nbyte);               \
@@ -87,7 +87,7 @@ void *pg_digest(void const *pdata, size_t nbyte, unsigned int cases, void *out)
 
     char const *hexit = hexits[cases % 2];
     unsigned char const *p = (unsigned char const *)pdata;
-    if (out || ((void)(out = malloc((nbyte << 1) + 1)), out))
+    if (out || ((void)(out = a_alloc(A_NULL, (nbyte << 1) + 1)), out))
     {
         char *o = (char *)out;
         pdata = (void const *)(p + nbyte);
@@ -210,6 +210,7 @@ int pg_gen1(pg_view const *ctx, char const *code, char **out)
     unsigned int ltext = (unsigned int)strlen(ctx->text);
     if (ctx->misc == 0 && ctx->type == PG_TYPE_OTHER) { return -2; }
     if ((ctx->size == 0) || (lcode == 0) || (ltext == 0)) { return -1; }
+    PG_STATS_BEGIN(t);
 
     unsigned char count = 0;
     unsigned char num[10] = {0};
@@ -225,7 +226,8 @@ int pg_gen1(pg_view const *ctx, char const *code, char **out)
     char *buf0 = hmac(kise, kise_n, msg, outsiz, hash, 0);
     char *buf1 = hmac(snow, snow_n, msg, outsiz, hash, 0);
 
-    *out = (char *)calloc(length + 1, sizeof(char));
+    *out = (char *)a_alloc(A_NULL, length + 1);
+    a_zero(*out, length + 1);
     for (unsigned int i = 0; i != length; ++i)
     {
         int x = pg_xdigit(buf0[i]) + pg_xdigit(buf1[i]);
@@ -287,10 +289,11 @@ int pg_gen1(pg_view const *ctx, char const *code, char **out)
         }
     }
 
-    free(buf1);
-    free(buf0);
-    free(msg);
+    a_die(buf1);
+    a_die(buf0);
+    a_die(msg);
 
+    PG_STATS_END(PG_STATS_GEN, t);
     return 0;
 }
 
@@ -302,6 +305,7 @@ int pg_gen2(pg_view const *ctx, char const *code, char **out)
     unsigned int ltext = (unsigned int)strlen(ctx->text);
     if (ctx->misc == 0 && ctx->type == PG_TYPE_OTHER) { return -2; }
     if ((ctx->size == 0) || (lword == 0) || (ltext == 0)) { return -1; }
+    PG_STATS_BEGIN(t);
 
     unsigned char count = 0;
     unsigned char num[N] = {0};
@@ -314,7 +318,8 @@ int pg_gen2(pg_view const *ctx, char const *code, char **out)
     char *buf2 = hmac(stat.r2, stat.l2, msg, outsiz, hash, 0);
     char *buf3 = hmac(stat.r3, stat.l3, msg, outsiz, hash, 0);
 
-    *out = (char *)calloc(length + 1, sizeof(char));
+    *out = (char *)a_alloc(A_NULL, length + 1);
+    a_zero(*out, length + 1);
     for (unsigned int i = 0; i != length; ++i)
     {
         int x = pg_xdigit(buf0[i]) + pg_xdigit(buf1[i]) + pg_xdigit(buf2[i]) + pg_xdigit(buf3[i]);
@@ -370,12 +375,13 @@ int pg_gen2(pg_view const *ctx, char const *code, char **out)
         }
     }
 
-    free(buf3);
-    free(buf2);
-    free(buf1);
-    free(buf0);
-    free(msg);
+    a_die(buf3);
+    a_die(buf2);
+    a_die(buf1);
+    a_die(buf0);
+    a_die(msg);
 
+    PG_STATS_END(PG_STATS_GEN, t);
     return 0;
 }
 
@@ -427,43 +433,14 @@ int pg_xdigit(int x)
     return ret;
 }
 
-pg_item *pg_item_new(void)
-{
-    pg_item *ctx = (pg_item *)malloc(sizeof(pg_item));
-    if (ctx) { pg_item_ctor(ctx); }
-    return ctx;
-}
-
-void pg_item_die(pg_item *ctx)
-{
-    if (ctx)
-    {
-        pg_item_dtor(ctx);
-        free(ctx);
-    }
-}
-
 void pg_item_ctor(pg_item *ctx)
 {
-    ctx->text = a_str_new();
-    ctx->hash = a_str_new();
-    ctx->hint = a_str_new();
-    ctx->misc = a_str_new();
-    ctx->type = PG_TYPE_EMAIL;
-    ctx->size = 16;
-}
-
-void pg_item_dtor(pg_item *ctx)
-{
-    a_str_die(ctx->text);
-    a_str_die(ctx->hash);
-    a_str_die(ctx->hint);
-    a_str_die(ctx->misc);
     ctx->text = 0;
-    ctx->hash = 0;
     ctx->hint = 0;
     ctx->misc = 0;
+    ctx->ltext = 0;
     ctx->type = PG_TYPE_EMAIL;
+    ctx->hash = PG_HASH_MD5;
     ctx->size = 16;
 }
 
@@ -479,63 +456,22 @@ void pg_view_ctor(pg_view *ctx)
 
 void pg_item_view(pg_item const *ctx, pg_view *out)
 {
-    out->text = a_str_ptr(ctx->text);
-    out->hash = a_str_ptr(ctx->hash);
-    out->hint = a_str_ptr(ctx->hint);
-    out->misc = a_str_ptr(ctx->misc);
+    out->text = ctx->text;
+    out->hash = pg_hash_name(ctx->hash);
+    out->hint = ctx->hint;
+    out->misc = ctx->misc;
     out->type = ctx->type;
     out->size = ctx->size;
 }
 
 void pg_item_set_type(pg_item *ctx, unsigned int type)
 {
-    ctx->type = type % PG_TYPE_TOTAL;
+    ctx->type = (type % PG_TYPE_TOTAL) & 0xFF;
 }
 
 void pg_item_set_size(pg_item *ctx, unsigned int size)
 {
-    hash_s const *hash = tohash(a_str_ptr(ctx->hash));
+    hash_s const *hash = hash_list[ctx->hash < PG_HASH_TOTAL ? ctx->hash : PG_HASH_MD5];
     unsigned int const outsiz = hash->outsiz << 1;
-    ctx->size = size < outsiz ? size : outsiz;
-}
-
-int pg_item_set_text(pg_item *ctx, void const *text)
-{
-    a_str_setn_(ctx->text, 0);
-    return a_str_cats(ctx->text, text ? text : "");
-}
-int pg_item_set_hash(pg_item *ctx, void const *hash)
-{
-    a_str_setn_(ctx->hash, 0);
-    return a_str_cats(ctx->hash, hash ? hash : "MD5");
-}
-int pg_item_set_hint(pg_item *ctx, void const *hint)
-{
-    a_str_setn_(ctx->hint, 0);
-    return a_str_cats(ctx->hint, hint ? hint : "");
-}
-int pg_item_set_misc(pg_item *ctx, void const *misc)
-{
-    a_str_setn_(ctx->misc, 0);
-    return a_str_cats(ctx->misc, misc ? misc : "");
-}
-int pg_item_set_text2(pg_item *ctx, a_str const *text)
-{
-    a_str_setn_(ctx->text, 0);
-    return a_str_cat(ctx->text, text);
-}
-int pg_item_set_hash2(pg_item *ctx, a_str const *hash)
-{
-    a_str_setn_(ctx->hash, 0);
-    return a_str_cat(ctx->hash, hash);
-}
-int pg_item_set_hint2(pg_item *ctx, a_str const *hint)
-{
-    a_str_setn_(ctx->hint, 0);
-    return a_str_cat(ctx->hint, hint);
-}
-int pg_item_set_misc2(pg_item *ctx, a_str const *misc)
-{
-    a_str_setn_(ctx->misc, 0);
-    return a_str_cat(ctx->misc, misc);
+    ctx->size = (size < outsiz ? size : outsiz) & 0xFFFF;
 }
@@ -0,0 +1,178 @@
+#include "pg/pgb.h"
+#include "pg/stats.h"
+#include "a/crc.h"
+
+#define HEADER 32
+#define RECORD 32
+#define NONE 0xFFFFFFFF
+#define POLY 0xEDB88320
+
+static unsigned char const magic[4] = {'P', 'G', 'B', 0};
+
+int pg_pgb_open(pg_pgb *ctx, char const *fname)
+{
+    ctx->count = 0;
+    ctx->npool = 0;
+    if (pg_io_map_open(&ctx->map, fname)) { return A_FAILURE; }
+
+    unsigned char const *p = (unsigned char const *)ctx->map.data;
+    if (ctx->map.size < HEADER || memcmp(p, magic, sizeof(magic)) ||
+        a_u32_getl(p + 4) != PG_PGB_VERSION)
+    {
+        goto fail;
+    }
+    ctx->count = a_u32_getl(p + 8);
+    ctx->npool = (a_size)a_u64_getl(p + 16);
+    if (ctx->map.size != HEADER + ctx->count * RECORD + ctx->npool) { goto fail; }
+    ctx->table = p + HEADER;
+    ctx->pool = (char const *)ctx->table + ctx->count * RECORD;
+    if (ctx->npool && ctx->pool[ctx->npool - 1]) { goto fail; }
+
+    a_u32 table[0x100];
+    a_crc32l_init(table, POLY);
+    if (~a_crc32l(table, ctx->table, ctx->map.size - HEADER, ~(a_u32)0) != a_u32_getl(p + 24))
+    {
+        goto fail;
+    }
+    return A_SUCCESS;
+
+fail:
+    pg_pgb_close(ctx);
+    return A_FAILURE;
+}
+
+void pg_pgb_close(pg_pgb *ctx)
+{
+    pg_io_map_close(&ctx->map);
+    ctx->count = 0;
+    ctx->npool = 0;
+}
+
+static A_INLINE char const *pgb_str(pg_pgb const *ctx, unsigned char const *p)
+{
+    a_u32 off = a_u32_getl(p);
+    return off < ctx->npool ? ctx->pool + off : A_NULL;
+}
+
+a_size pg_pgb_find(pg_pgb const *ctx, char const *text)
+{
+    a_size lo = 0, hi = ctx->count;
+    while (lo < hi)
+    {
+        a_size mid = lo + ((hi - lo) >> 1);
+        char const *str = pgb_str(ctx, ctx->table + mid * RECORD + 8);
+        int res = strcmp(text, str ? str : "");
+        if (res < 0) { hi = mid; }
+        else if (res > 0) { lo = mid + 1; }
+        else { return mid; }
+    }
+    return ctx->count;
+}
+
+a_i64 pg_pgb_view(pg_pgb const *ctx, a_size idx, pg_view *out)
+{
+    unsigned char const *p = ctx->table + idx * RECORD;
+    a_u32 info = a_u32_getl(p + 24);
+    out->text = pgb_str(ctx, p + 8);
+    if (out->text == 0) { out->text = ""; }
+    out->hint = pgb_str(ctx, p + 16);
+    out->misc = pgb_str(ctx, p + 20);
+    out->type = info & 0xFF;
+    out->hash = pg_hash_name((info >> 8) & 0xFF);
+    out->size = info >> 16;
+    return (a_i64)a_u64_getl(p);
+}
+
+int pg_pgb_out(pg_pgb const *ctx, pg_tree *tree)
+{
+    PG_STATS_BEGIN(t);
+    for (a_size idx = 0; idx != ctx->count; ++idx)
+    {
+        unsigned char const *p = ctx->table + idx * RECORD;
+        char const *text = pgb_str(ctx, p + 8);
+        a_u32 ltext = a_u32_getl(p + 12);
+        if (text == 0 || ltext > ctx->npool - (a_size)(text - ctx->pool)) { return A_FAILURE; }
+        pg_item *item = pg_tree_push(tree, text, ltext);
+        if (item == 0) { return A_OMEMORY; }
+        char const *hint = pgb_str(ctx, p + 16);
+        char const *misc = pgb_str(ctx, p + 20);
+        a_u32 info = a_u32_getl(p + 24);
+        item->hint = hint ? pg_pool_str(&tree->data, hint) : A_NULL;
+        item->misc = misc ? pg_pool_str(&tree->data, misc) : A_NULL;
+        if ((hint && !item->hint) || (misc && !item->misc)) { return A_OMEMORY; }
+        item->type = (info & 0xFF) % PG_TYPE_TOTAL;
+        item->hash = ((info >> 8) & 0xFF) < PG_HASH_TOTAL ? (info >> 8) & 0xFF : PG_HASH_MD5;
+        item->size = (a_u16)(info >> 16);
+        pg_tree_time(tree, item, (a_i64)a_u64_getl(p));
+    }
+    PG_STATS_ADD(PG_STATS_ROWS, ctx->count);
+    PG_STATS_END(PG_STATS_LOAD, t);
+    return A_SUCCESS;
+}
+
+static a_u32 pgb_off(a_u64 *pool, char const *str)
+{
+    if (str == 0) { return NONE; }
+    a_u32 off = (a_u32)*pool;
+    *pool += strlen(str) + 1;
+    return off;
+}
+
+static int pgb_write(pg_io_writer *out, pg_tree const *tree)
+{
+    unsigned char buf[HEADER > RECORD ? HEADER : RECORD] = {0};
+    a_u32 table[0x100];
+    a_u32 crc = ~(a_u32)0;
+    a_u64 pool = 0;
+    a_u32 count = 0;
+
+    a_crc32l_init(table, POLY);
+    if (pg_io_writer_put(out, buf, HEADER)) { return A_FAILURE; }
+    pg_tree_foreach(cur, tree)
+    {
+        pg_item const *it = pg_tree_entry(cur);
+        if (*it->text == 0) { continue; }
+        a_u64_setl(buf, (a_u64)it->time);
+        a_u32_setl(buf + 8, pgb_off(&pool, it->text));
+        a_u32_setl(buf + 12, it->ltext);
+        a_u32_setl(buf + 16, pgb_off(&pool, it->hint));
+        a_u32_setl(buf + 20, pgb_off(&pool, it->type == PG_TYPE_OTHER ? it->misc : A_NULL));
+        a_u32_setl(buf + 24, it->type | (a_u32)it->hash << 8 | (a_u32)it->size << 16);
+        a_u32_setl(buf + 28, 0);
+        if (pool >= NONE || pg_io_writer_put(out, buf, RECORD)) { return A_FAILURE; }
+        crc = a_crc32l(table, buf, RECORD, crc);
+        ++count;
+    }
+    pg_tree_foreach(cur, tree)
+    {
+        pg_item const *it = pg_tree_entry(cur);
+        char const *str[3];
+        if (*it->text == 0) { continue; }
+        str[0] = it->text;
+        str[1] = it->hint;
+        str[2] = it->type == PG_TYPE_OTHER ? it->misc : A_NULL;
+        for (unsigned int i = 0; i != 3; ++i)
+        {
+            if (str[i] == 0) { continue; }
+            size_t n = strlen(str[i]) + 1;
+            if (pg_io_writer_put(out, str[i], n)) { return A_FAILURE; }
+            crc = a_crc32l(table, str[i], n, crc);
+        }
+    }
+
+    a_zero(buf, HEADER);
+    a_copy(buf, magic, sizeof(magic));
+    a_u32_setl(buf + 4, PG_PGB_VERSION);
+    a_u32_setl(buf + 8, count);
+    a_u64_setl(buf + 16, pool);
+    a_u32_setl(buf + 24, ~crc);
+    return pg_io_writer_at(out, 0, buf, HEADER);
+}
+
+int pg_pgb_dump(char const *fname, pg_tree const *tree)
+{
+    pg_io_writer out;
+    if (pg_io_writer_open(&out, fname)) { return A_FAILURE; }
+    int ok = pgb_write(&out, tree);
+    return pg_io_writer_close(&out, ok == A_SUCCESS);
+}
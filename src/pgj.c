@@ -0,0 +1,363 @@
+#include "pg/pgj.h"
+#include "pg/stats.h"
+#include "a/crc.h"
+#include <time.h>
+#if defined(_WIN32)
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 5105)
+#endif /* _MSC_VER */
+#include <windows.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif /* _MSC_VER */
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#define open _open
+#define close _close
+#define write _write
+#define ftruncate _chsize_s
+#define O_RDWR (_O_RDWR | _O_BINARY)
+#define O_CREAT _O_CREAT
+#define O_APPEND _O_APPEND
+#define O_CLOEXEC 0
+#else /* !_WIN32 */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif /* _WIN32 */
+
+#define HEADER 8
+#define RECORD 28
+#define NONE 0xFFFFFFFF
+#define POLY 0xEDB88320
+
+#define OP_PUT 1
+#define OP_DEL 2
+
+static unsigned char const magic[4] = {'P', 'G', 'J', 0};
+
+static int pgj_string(pg_pool *pool, char const **out, unsigned char const **p, unsigned char const *end, a_u32 n)
+{
+    *out = A_NULL;
+    if (n == NONE) { return A_SUCCESS; }
+    if (n > (a_size)(end - *p)) { return A_FAILURE; }
+    *out = pg_pool_strn(pool, *p, n);
+    *p += n;
+    return *out ? A_SUCCESS : A_OMEMORY;
+}
+
+/* applies one payload, the strings of put go to the pool of put */
+static int pgj_apply(unsigned char const *p, a_size n, pg_tree *put, pg_tree *del, a_str *text)
+{
+    unsigned char const *end = p + n;
+    if (n < RECORD) { return A_FAILURE; }
+    unsigned int const op = p[0];
+    a_u32 const ltext = a_u32_getl(p + 16);
+    if (ltext == NONE || ltext > n - RECORD) { return A_FAILURE; }
+    a_str_setn_(text, 0);
+    if (a_str_catn(text, p + RECORD, ltext)) { return A_OMEMORY; }
+    if (op == OP_DEL)
+    {
+        pg_item *it = pg_tree_del(put, a_str_ptr(text));
+        if (it) { pg_tree_free(put, it); }
+        if (del && !pg_tree_add(del, a_str_ptr(text))) { return A_OMEMORY; }
+        return A_SUCCESS;
+    }
+    if (op != OP_PUT) { return A_FAILURE; }
+    if (del)
+    {
+        pg_item *it = pg_tree_del(del, a_str_ptr(text));
+        if (it) { pg_tree_free(del, it); }
+    }
+    pg_item *item = pg_tree_add(put, a_str_ptr(text));
+    if (!item) { return A_OMEMORY; }
+    unsigned char const *s = p + RECORD + ltext;
+    if (pgj_string(&put->data, &item->hint, &s, end, a_u32_getl(p + 20)) ||
+        pgj_string(&put->data, &item->misc, &s, end, a_u32_getl(p + 24)))
+    {
+        return A_FAILURE;
+    }
+    item->type = p[1] % PG_TYPE_TOTAL;
+    item->hash = p[2] < PG_HASH_TOTAL ? p[2] : PG_HASH_MD5;
+    item->size = (a_u16)a_u32_getl(p + 4);
+    pg_tree_time(put, item, (a_i64)a_u64_getl(p + 8));
+    return A_SUCCESS;
+}
+
+/* size of the payload of the whole record at off, NONE when it is torn or corrupt */
+static a_u32 pgj_next(a_u32 const *table, unsigned char const *base, a_size off, a_size stop)
+{
+    if (stop - off < 8) { return NONE; }
+    a_u32 const n = a_u32_getl(base + off);
+    if (n > stop - off - 8) { return NONE; }
+    if (~a_crc32l(table, base + off + 8, n, ~(a_u32)0) != a_u32_getl(base + off + 4)) { return NONE; }
+    return n;
+}
+
+int pg_pgj_replay(char const *fname, pg_tree *put, pg_tree *del, a_u64 upto, a_u64 *end)
+{
+    pg_io_map map;
+    if (end) { *end = 0; }
+    if (pg_io_map_open(&map, fname)) { return A_SUCCESS; }
+    unsigned char const *base = (unsigned char const *)map.data;
+    if (map.size < HEADER || memcmp(base, magic, sizeof(magic)) || a_u32_getl(base + 4) != PG_PGJ_VERSION)
+    {
+        /* an empty journal is one whose header was never written */
+        int ok = map.size ? A_FAILURE : A_SUCCESS;
+        pg_io_map_close(&map);
+        return ok;
+    }
+
+    int ok = A_SUCCESS;
+    a_u32 table[0x100];
+    a_str text = A_STR_INIT;
+    a_size off = HEADER;
+    a_size const stop = upto < map.size ? (a_size)upto : map.size;
+    a_crc32l_init(table, POLY);
+    for (a_u32 n; (n = pgj_next(table, base, off, stop)) != NONE;)
+    {
+        unsigned char const *p = base + off + 8;
+        ok = pgj_apply(p, n, put, del, &text);
+        if (ok) { break; }
+        PG_STATS_ADD(PG_STATS_ROWS, 1);
+        off += 8 + n;
+    }
+    if (end) { *end = off; }
+    a_str_dtor(&text);
+    pg_io_map_close(&map);
+    return ok;
+}
+
+static int pgj_write(int fd, void const *pdata, a_size nbyte)
+{
+    char const *p = (char const *)pdata;
+    while (nbyte)
+    {
+        long n = (long)write(fd, p, (unsigned int)nbyte);
+        if (n <= 0) { return A_FAILURE; }
+        p += n;
+        nbyte -= (a_size)n;
+    }
+    return A_SUCCESS;
+}
+
+static int pgj_flock(int fd, int lock)
+{
+#if defined(_WIN32)
+    OVERLAPPED ov;
+    HANDLE const h = (HANDLE)_get_osfhandle(fd);
+    a_zero(&ov, sizeof(ov));
+    if (lock) { return LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &ov) ? A_SUCCESS : A_FAILURE; }
+    return UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &ov) ? A_SUCCESS : A_FAILURE;
+#else /* !_WIN32 */
+    int ok;
+    while ((ok = flock(fd, lock ? LOCK_EX : LOCK_UN)) != 0 && errno == EINTR) {}
+    return ok ? A_FAILURE : A_SUCCESS;
+#endif /* _WIN32 */
+}
+
+/* whether the name still leads to the file that is open, a rewrite by pg_pgj_drop replaces it */
+static int pgj_same(pg_pgj const *ctx)
+{
+#if defined(_WIN32)
+    (void)ctx;
+    return 1;
+#else /* !_WIN32 */
+    struct stat a, b;
+    if (fstat(ctx->fd, &a) || stat(a_str_ptr(&ctx->name), &b)) { return 0; }
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+#endif /* _WIN32 */
+}
+
+/* finds the end of the whole records and cuts off a record that a crash tore, the lock is held */
+static int pgj_tail(pg_pgj *ctx)
+{
+    struct stat st;
+    pg_io_map map;
+    /* nobody appended since the last lock, the records were checked then */
+    if (fstat(ctx->fd, &st) == 0 && ctx->size >= HEADER && (a_u64)st.st_size == ctx->size) { return A_SUCCESS; }
+    if (pg_io_map_open(&map, a_str_ptr(&ctx->name))) { return A_FAILURE; }
+    unsigned char const *base = (unsigned char const *)map.data;
+    int ok = A_SUCCESS;
+    if (map.size == 0)
+    {
+        unsigned char head[HEADER];
+        a_copy(head, magic, sizeof(magic));
+        a_u32_setl(head + 4, PG_PGJ_VERSION);
+        ok = pgj_write(ctx->fd, head, HEADER);
+        ctx->size = HEADER;
+    }
+    else if (map.size < HEADER || memcmp(base, magic, sizeof(magic)) || a_u32_getl(base + 4) != PG_PGJ_VERSION)
+    {
+        /* not a journal of this version, nothing of it is thrown away */
+        ok = A_FAILURE;
+    }
+    else
+    {
+        /* records before the end seen last were checked then, the lock kept them whole since */
+        a_size off = ctx->size >= HEADER && ctx->size <= map.size ? (a_size)ctx->size : HEADER;
+        for (a_u32 n; (n = pgj_next(ctx->crc, base, off, map.size)) != NONE;) { off += 8 + n; }
+        if (off != map.size && ftruncate(ctx->fd, (long)off)) { ok = A_FAILURE; }
+        ctx->size = off;
+    }
+    pg_io_map_close(&map);
+    return ok;
+}
+
+int pg_pgj_lock(pg_pgj *ctx)
+{
+    pg_mutex_lock(&ctx->lock);
+    while (ctx->fd >= 0 && pgj_flock(ctx->fd, 1) == A_SUCCESS)
+    {
+        if (pgj_same(ctx))
+        {
+            if (pgj_tail(ctx) == A_SUCCESS) { return A_SUCCESS; }
+            pgj_flock(ctx->fd, 0);
+            break;
+        }
+        /* another process replaced the journal, the one under the name is the one to append to */
+        close(ctx->fd);
+        ctx->fd = open(a_str_ptr(&ctx->name), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        ctx->size = 0;
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return A_FAILURE;
+}
+
+void pg_pgj_unlock(pg_pgj *ctx)
+{
+    if (ctx->fd >= 0) { pgj_flock(ctx->fd, 0); }
+    pg_mutex_unlock(&ctx->lock);
+}
+
+int pg_pgj_open(pg_pgj *ctx, char const *fname, int create)
+{
+    a_str_ctor(&ctx->name);
+    if (a_str_cats(&ctx->name, fname))
+    {
+        a_str_dtor(&ctx->name);
+        return A_FAILURE;
+    }
+    a_crc32l_init(ctx->crc, POLY);
+    ctx->size = 0;
+    ctx->fd = open(fname, O_RDWR | O_APPEND | O_CLOEXEC | (create ? O_CREAT : 0), 0600);
+    pg_mutex_ctor(&ctx->lock);
+    if (ctx->fd >= 0 && pg_pgj_lock(ctx) == A_SUCCESS)
+    {
+        pg_pgj_unlock(ctx);
+        return A_SUCCESS;
+    }
+    pg_pgj_close(ctx);
+    return A_FAILURE;
+}
+
+void pg_pgj_close(pg_pgj *ctx)
+{
+    if (ctx->fd >= 0) { close(ctx->fd); }
+    ctx->fd = -1;
+    pg_mutex_dtor(&ctx->lock);
+    a_str_dtor(&ctx->name);
+}
+
+static int pgj_append(pg_pgj *ctx, unsigned int op, pg_item const *item, char const *text)
+{
+    char const *hint = item ? item->hint : A_NULL;
+    char const *misc = item ? item->misc : A_NULL;
+    a_size const ltext = strlen(text);
+    a_size const lhint = hint ? strlen(hint) : 0;
+    a_size const lmisc = misc ? strlen(misc) : 0;
+    a_size const n = RECORD + ltext + lhint + lmisc;
+    if (n > NONE - 8) { return A_FAILURE; }
+
+    unsigned char *buf = (unsigned char *)a_alloc(A_NULL, 8 + n);
+    if (!buf) { return A_OMEMORY; }
+    unsigned char *p = buf + 8;
+    a_zero(p, RECORD);
+    p[0] = (unsigned char)op;
+    if (item)
+    {
+        p[1] = (unsigned char)item->type;
+        p[2] = (unsigned char)item->hash;
+        a_u32_setl(p + 4, item->size);
+        a_u64_setl(p + 8, (a_u64)item->time);
+    }
+    else { a_u64_setl(p + 8, (a_u64)(time(NULL) + A_I32_MIN)); }
+    a_u32_setl(p + 16, (a_u32)ltext);
+    a_u32_setl(p + 20, hint ? (a_u32)lhint : NONE);
+    a_u32_setl(p + 24, misc ? (a_u32)lmisc : NONE);
+    a_copy(p + RECORD, text, ltext);
+    if (lhint) { a_copy(p + RECORD + ltext, hint, lhint); }
+    if (lmisc) { a_copy(p + RECORD + ltext + lhint, misc, lmisc); }
+    a_u32_setl(buf, (a_u32)n);
+    a_u32_setl(buf + 4, ~a_crc32l(ctx->crc, p, n, ~(a_u32)0));
+
+    /* other processes append to the same journal, the lock keeps every record whole */
+    int ok = pg_pgj_lock(ctx);
+    if (ok == A_SUCCESS)
+    {
+        ok = pgj_write(ctx->fd, buf, 8 + n);
+        if (ok == A_SUCCESS) { ctx->size += 8 + n; }
+        pg_pgj_unlock(ctx);
+    }
+    a_die(buf);
+    return ok;
+}
+
+int pg_pgj_put(pg_pgj *ctx, pg_item const *item)
+{
+    return pgj_append(ctx, OP_PUT, item, item->text);
+}
+
+int pg_pgj_del(pg_pgj *ctx, char const *text)
+{
+    return pgj_append(ctx, OP_DEL, A_NULL, text);
+}
+
+int pg_pgj_sync(pg_pgj *ctx)
+{
+    pg_mutex_lock(&ctx->lock);
+#if defined(_WIN32)
+    int ok = ctx->fd < 0 || _commit(ctx->fd) ? A_FAILURE : A_SUCCESS;
+#else /* !_WIN32 */
+    int ok = ctx->fd < 0 || fsync(ctx->fd) ? A_FAILURE : A_SUCCESS;
+#endif /* _WIN32 */
+    pg_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+int pg_pgj_drop(pg_pgj *ctx, a_u64 upto)
+{
+    pg_io_map map;
+    pg_io_writer out;
+    int ok = A_FAILURE;
+    if (upto <= HEADER) { return A_SUCCESS; }
+    /* everything is in the vault, the file stays where other processes have it open */
+    if (upto >= ctx->size)
+    {
+        if (ftruncate(ctx->fd, HEADER)) { return A_FAILURE; }
+        ctx->size = HEADER;
+        return A_SUCCESS;
+    }
+    if (pg_io_map_open(&map, a_str_ptr(&ctx->name))) { return A_FAILURE; }
+    if (upto <= map.size && pg_io_writer_open(&out, a_str_ptr(&ctx->name)) == A_SUCCESS)
+    {
+        ok = pg_io_writer_put(&out, map.data, HEADER);
+        if (ok == A_SUCCESS) { ok = pg_io_writer_put(&out, map.data + upto, map.size - (a_size)upto); }
+        ok = pg_io_writer_close(&out, ok == A_SUCCESS);
+    }
+    pg_io_map_close(&map);
+    if (ok == A_SUCCESS)
+    {
+        /* the old file was replaced, the lock moves to the new one and appends go to it */
+        pgj_flock(ctx->fd, 0);
+        close(ctx->fd);
+        ctx->fd = open(a_str_ptr(&ctx->name), O_RDWR | O_APPEND | O_CLOEXEC);
+        ctx->size = 0;
+        if (ctx->fd < 0 || pgj_flock(ctx->fd, 1) || pgj_tail(ctx)) { ok = A_FAILURE; }
+    }
+    return ok;
+}
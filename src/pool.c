@@ -0,0 +1,131 @@
+#include "pg/pg.h"
+#include "pg/stats.h"
+
+#undef ALIGN
+#define ALIGN 8
+
+typedef struct pg_pool_chunk
+{
+    struct pg_pool_chunk *next;
+} pg_pool_chunk;
+
+#define CHUNK a_size_up(ALIGN, sizeof(pg_pool_chunk))
+
+void pg_pool_ctor(pg_pool *ctx, a_size mem)
+{
+    ctx->head = A_NULL;
+    ctx->ptr = A_NULL;
+    ctx->end = A_NULL;
+    ctx->mem = mem ? mem : (a_size)1 << 16;
+    ctx->size = 0;
+}
+
+void pg_pool_dtor(pg_pool *ctx)
+{
+    pg_pool_chunk *cur = (pg_pool_chunk *)ctx->head;
+    while (cur)
+    {
+        pg_pool_chunk *next = cur->next;
+        a_die(cur);
+        cur = next;
+    }
+    ctx->head = A_NULL;
+    ctx->ptr = A_NULL;
+    ctx->end = A_NULL;
+    ctx->size = 0;
+}
+
+void pg_pool_merge(pg_pool *ctx, pg_pool *src)
+{
+    pg_pool_chunk *head = (pg_pool_chunk *)ctx->head;
+    pg_pool_chunk *tail = (pg_pool_chunk *)src->head;
+    if (!tail) { return; }
+    if (head)
+    {
+        /* the current chunk of ctx stays in front and keeps its free space */
+        while (tail->next) { tail = tail->next; }
+        tail->next = head->next;
+        head->next = (pg_pool_chunk *)src->head;
+    }
+    else
+    {
+        ctx->head = src->head;
+        ctx->ptr = src->ptr;
+        ctx->end = src->end;
+    }
+    ctx->size += src->size;
+    src->head = A_NULL;
+    src->ptr = A_NULL;
+    src->end = A_NULL;
+    src->size = 0;
+}
+
+static char *pg_pool_chunk_new(pg_pool *ctx, a_size size)
+{
+    pg_pool_chunk *head = (pg_pool_chunk *)ctx->head;
+    pg_pool_chunk *chunk;
+    /* a large block gets a chunk of its own and keeps the current chunk */
+    if (size > (ctx->mem >> 2))
+    {
+        chunk = (pg_pool_chunk *)a_alloc(A_NULL, CHUNK + size);
+        if (!chunk) { return A_NULL; }
+        PG_STATS_ADD(PG_STATS_ALLOC, 1);
+        PG_STATS_ADD(PG_STATS_ALLOC_BYTES, CHUNK + size);
+        ctx->size += CHUNK + size;
+        if (head)
+        {
+            chunk->next = head->next;
+            head->next = chunk;
+        }
+        else
+        {
+            chunk->next = A_NULL;
+            ctx->head = chunk;
+        }
+        return (char *)chunk + CHUNK;
+    }
+    chunk = (pg_pool_chunk *)a_alloc(A_NULL, CHUNK + ctx->mem);
+    if (!chunk) { return A_NULL; }
+    PG_STATS_ADD(PG_STATS_ALLOC, 1);
+    PG_STATS_ADD(PG_STATS_ALLOC_BYTES, CHUNK + ctx->mem);
+    ctx->size += CHUNK + ctx->mem;
+    chunk->next = head;
+    ctx->head = chunk;
+    ctx->ptr = (char *)chunk + CHUNK + size;
+    ctx->end = (char *)chunk + CHUNK + ctx->mem;
+    return (char *)chunk + CHUNK;
+}
+
+void *pg_pool_alloc(pg_pool *ctx, a_size size)
+{
+    char *ptr = ctx->ptr;
+    if (ptr)
+    {
+        ptr += (ALIGN - (a_uptr)ptr % ALIGN) % ALIGN;
+        if (size <= (a_size)(ctx->end - ptr))
+        {
+            ctx->ptr = ptr + size;
+            return ptr;
+        }
+    }
+    return pg_pool_chunk_new(ctx, a_size_up(ALIGN, size));
+}
+
+char *pg_pool_strn(pg_pool *ctx, void const *pdata, a_size nbyte)
+{
+    char *str = ctx->ptr;
+    if (!str || nbyte + 1 > (a_size)(ctx->end - str))
+    {
+        str = pg_pool_chunk_new(ctx, nbyte + 1);
+        if (!str) { return str; }
+    }
+    else { ctx->ptr = str + nbyte + 1; }
+    if (nbyte) { a_copy(str, pdata, nbyte); }
+    str[nbyte] = 0;
+    return str;
+}
+
+char *pg_pool_str(pg_pool *ctx, void const *str)
+{
+    return pg_pool_strn(ctx, str, strlen((char const *)str));
+}
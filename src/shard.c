@@ -0,0 +1,237 @@
+#include "pg/shard.h"
+#include "pg/io.h"
+#include "pg/sqlite.h"
+#include "pg/thread.h"
+#include <errno.h>
+#include <stdio.h>
+#if defined(_WIN32)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else /* !_WIN32 */
+#include <sys/stat.h>
+#endif /* _WIN32 */
+
+/* time that a shard waits for the lock of another connection */
+#define BUSY 5000
+
+typedef struct pg_shard_job
+{
+    pg_thread thread;
+    pg_shard const *ctx;
+    pg_tree *tree;
+    pg_tree const *put;
+    pg_tree const *del;
+    unsigned int idx;
+    int ok;
+} pg_shard_job;
+
+/* reads the number of shards that the vault was made with, 0 when it is not stored */
+static unsigned int pg_shard_load(char const *fname)
+{
+    unsigned int num = 0;
+    FILE *handle = fopen(fname, "r");
+    if (handle == A_NULL) { return 0; }
+    if (fscanf(handle, "%u", &num) != 1 || num > PG_SHARD_MAX) { num = PG_SHARD_MAX + 1; }
+    fclose(handle);
+    return num;
+}
+
+static int pg_shard_store(char const *fname, unsigned int num)
+{
+    pg_io_writer out;
+    char buf[16];
+    int const n = snprintf(buf, sizeof(buf), "%u\n", num);
+    if (pg_io_writer_open(&out, fname)) { return A_FAILURE; }
+    int ok = pg_io_writer_put(&out, buf, (a_size)n);
+    return pg_io_writer_close(&out, ok == A_SUCCESS);
+}
+
+int pg_shard_open(pg_shard *ctx, char const *dir, unsigned int num)
+{
+    a_str name = A_STR_INIT;
+    unsigned int n = 0;
+    for (; n != PG_SHARD_MAX; ++n)
+    {
+        a_str_setn_(&name, 0);
+        if (a_str_catf(&name, "%s/%u.db", dir, n) < 0)
+        {
+            a_str_dtor(&name);
+            return A_OMEMORY;
+        }
+        if (pg_io_size(a_str_ptr(&name)) < 0) { break; }
+    }
+    a_str_setn_(&name, 0);
+    if (a_str_catf(&name, "%s/%s", dir, PG_SHARD_FILE) < 0)
+    {
+        a_str_dtor(&name);
+        return A_OMEMORY;
+    }
+    /* a text goes to its hash modulo the count, so a vault opened with another count would lose records */
+    unsigned int const stored = pg_shard_load(a_str_ptr(&name));
+    int ok = A_SUCCESS;
+    if (stored)
+    {
+        if (stored > PG_SHARD_MAX || (n && n != stored)) { ok = A_INVALID; }
+        n = stored;
+    }
+    /* a vault from before the count was stored keeps the shards it has, a read-only one counts them each time */
+    else if (n) { pg_shard_store(a_str_ptr(&name), n); }
+    else if (num == 0) { ok = A_FAILURE; }
+    else
+    {
+        n = num < PG_SHARD_MAX ? num : PG_SHARD_MAX;
+        if (mkdir(dir, 0700) && errno != EEXIST) { ok = A_INVALID; }
+        else { ok = pg_shard_store(a_str_ptr(&name), n) == A_SUCCESS ? A_SUCCESS : A_INVALID; }
+    }
+    a_str_dtor(&name);
+    if (ok != A_SUCCESS) { return ok; }
+
+    ctx->fname = (a_str *)a_alloc(A_NULL, sizeof(a_str) * n);
+    if (!ctx->fname) { return A_OMEMORY; }
+    for (ctx->num = 0; ctx->num != n; ++ctx->num)
+    {
+        a_str *it = ctx->fname + ctx->num;
+        a_str_ctor(it);
+        if (a_str_catf(it, "%s/%u.db", dir, ctx->num) < 0)
+        {
+            ++ctx->num;
+            pg_shard_close(ctx);
+            return A_OMEMORY;
+        }
+    }
+    return A_SUCCESS;
+}
+
+void pg_shard_close(pg_shard *ctx)
+{
+    for (unsigned int i = 0; i != ctx->num; ++i) { a_str_dtor(ctx->fname + i); }
+    a_die(ctx->fname);
+    ctx->fname = A_NULL;
+    ctx->num = 0;
+}
+
+unsigned int pg_shard_index(pg_shard const *ctx, char const *text)
+{
+    /* the index of a tree mixes the hash, so a shard does not crowd its slots */
+    return pg_tree_hash(text, A_NULL) % ctx->num;
+}
+
+static sqlite3 *pg_shard_db(pg_shard_job const *job)
+{
+    sqlite3 *db = A_NULL;
+    if (sqlite3_open(a_str_ptr(job->ctx->fname + job->idx), &db) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return A_NULL;
+    }
+    sqlite3_busy_timeout(db, BUSY);
+    pg_sqlite_create(db);
+    return db;
+}
+
+static void *pg_shard_out_(void *arg)
+{
+    pg_shard_job *job = (pg_shard_job *)arg;
+    sqlite3 *db = pg_shard_db(job);
+    job->ok = db ? pg_sqlite_out(db, job->tree) : A_FAILURE;
+    sqlite3_close(db);
+    return A_NULL;
+}
+
+static int pg_shard_keep(void *arg, pg_item const *item)
+{
+    pg_shard_job const *job = (pg_shard_job const *)arg;
+    return pg_shard_index(job->ctx, item->text) == job->idx;
+}
+
+static void *pg_shard_save_(void *arg)
+{
+    pg_shard_job *job = (pg_shard_job *)arg;
+    sqlite3 *db = pg_shard_db(job);
+    job->ok = db ? sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) : A_FAILURE;
+    if (job->ok == SQLITE_OK)
+    {
+        if (job->del)
+        {
+            /* an update is a delete and an insert, like the journal */
+            job->ok = pg_sqlite_del_if(db, job->del, pg_shard_keep, job);
+            if (job->ok == SQLITE_OK) { job->ok = pg_sqlite_del_if(db, job->put, pg_shard_keep, job); }
+        }
+        else
+        {
+            pg_sqlite_delete(db);
+            job->ok = pg_sqlite_create(db);
+        }
+        if (job->ok == SQLITE_OK) { job->ok = pg_sqlite_add_if(db, job->put, pg_shard_keep, job); }
+        if (job->ok == SQLITE_OK) { job->ok = sqlite3_exec(db, "COMMIT;", 0, 0, 0); }
+        else { sqlite3_exec(db, "ROLLBACK;", 0, 0, 0); }
+    }
+    sqlite3_close(db);
+    return A_NULL;
+}
+
+/* runs one job per shard, the last one on the calling thread */
+static int pg_shard_run(pg_shard_job *job, unsigned int num, void *(*func)(void *))
+{
+    int ok = A_SUCCESS;
+    for (unsigned int i = 0; i != num; ++i)
+    {
+        if (i + 1 == num || pg_thread_ctor(&job[i].thread, func, job + i) != A_SUCCESS)
+        {
+            func(job + i);
+            job[i].thread.func = A_NULL;
+        }
+    }
+    for (unsigned int i = 0; i != num; ++i)
+    {
+        if (job[i].thread.func) { pg_thread_join(&job[i].thread); }
+        if (job[i].ok) { ok = A_FAILURE; }
+    }
+    return ok;
+}
+
+static pg_shard_job *pg_shard_jobs(pg_shard const *ctx, pg_tree const *put, pg_tree const *del)
+{
+    pg_shard_job *job = (pg_shard_job *)a_alloc(A_NULL, sizeof(pg_shard_job) * ctx->num);
+    if (!job) { return job; }
+    for (unsigned int i = 0; i != ctx->num; ++i)
+    {
+        job[i].ctx = ctx;
+        job[i].tree = A_NULL;
+        job[i].put = put;
+        job[i].del = del;
+        job[i].idx = i;
+        job[i].ok = A_SUCCESS;
+    }
+    return job;
+}
+
+int pg_shard_out(pg_shard const *ctx, pg_tree *tree)
+{
+    pg_shard_job *job = pg_shard_jobs(ctx, A_NULL, A_NULL);
+    pg_tree *trees = (pg_tree *)a_alloc(A_NULL, sizeof(pg_tree) * ctx->num);
+    int ok = A_OMEMORY;
+    if (job && trees)
+    {
+        for (unsigned int i = 0; i != ctx->num; ++i)
+        {
+            pg_tree_ctor(trees + i);
+            job[i].tree = trees + i;
+        }
+        ok = pg_shard_run(job, ctx->num, pg_shard_out_);
+        if (ok == A_SUCCESS) { ok = pg_tree_merge_n(tree, trees, ctx->num); }
+        for (unsigned int i = 0; i != ctx->num; ++i) { pg_tree_dtor(trees + i); }
+    }
+    a_die(trees);
+    a_die(job);
+    return ok;
+}
+
+int pg_shard_save(pg_shard const *ctx, pg_tree const *put, pg_tree const *del)
+{
+    pg_shard_job *job = pg_shard_jobs(ctx, put, del);
+    if (!job) { return A_OMEMORY; }
+    int ok = pg_shard_run(job, ctx->num, pg_shard_save_);
+    a_die(job);
+    return ok;
+}
@@ -1,4 +1,8 @@
 #include "pg/sqlite.h"
+#include "pg/stats.h"
+#include <stdarg.h>
+
+#define COLUMNS "text,hash,size,type,misc,hint,time"
 
 int pg_sqlite_begin(sqlite3 *db)
 {
@@ -26,12 +30,41 @@ int pg_sqlite_create(sqlite3 *db)
                              "%s TEXT DEFAULT MD5,"
                              "%s INTEGER DEFAULT 16,"
                              "%s INTEGER DEFAULT 0,"
-                             "%s TEXT,%s TEXT,%s INTEGER DEFAULT -2147483648);",
-                        PG_SQLITE_TABLE, "text", "hash", "size", "type", "misc", "hint", "time");
+                             "%s TEXT,%s TEXT,%s INTEGER DEFAULT -2147483648,"
+                             "%s INTEGER NOT NULL DEFAULT 0);",
+                        PG_SQLITE_TABLE, "text", "hash", "size", "type", "misc", "hint", "time", "version");
     char *sql = sqlite3_str_finish(str);
     sqlite3_prepare(db, sql, -1, &stmt, 0);
     sqlite3_free(sql);
     sqlite3_step(stmt);
+    int ok = sqlite3_finalize(stmt);
+    if (ok != SQLITE_OK) { return ok; }
+
+    /* a vault from before rows had versions gets the column, every row starts at 0 */
+    str = sqlite3_str_new(db);
+    sqlite3_str_appendf(str, "SELECT %s FROM %s LIMIT 0;", "version", PG_SQLITE_TABLE);
+    sql = sqlite3_str_finish(str);
+    ok = sqlite3_prepare(db, sql, -1, &stmt, 0);
+    sqlite3_free(sql);
+    sqlite3_finalize(stmt);
+    if (ok != SQLITE_OK)
+    {
+        str = sqlite3_str_new(db);
+        sqlite3_str_appendf(str, "ALTER TABLE %s ADD COLUMN %s INTEGER NOT NULL DEFAULT 0;", PG_SQLITE_TABLE, "version");
+        sql = sqlite3_str_finish(str);
+        ok = sqlite3_exec(db, sql, 0, 0, 0);
+        sqlite3_free(sql);
+        if (ok != SQLITE_OK) { return ok; }
+    }
+
+    /* recency and rotation queries read the vault by time */
+    str = sqlite3_str_new(db);
+    sqlite3_str_appendf(str, "CREATE INDEX IF NOT EXISTS %s_%s ON %s(%s);",
+                        PG_SQLITE_TABLE, "time", PG_SQLITE_TABLE, "time");
+    sql = sqlite3_str_finish(str);
+    sqlite3_prepare(db, sql, -1, &stmt, 0);
+    sqlite3_free(sql);
+    sqlite3_step(stmt);
 
     return sqlite3_finalize(stmt);
 }
@@ -50,6 +83,12 @@ int pg_sqlite_delete(sqlite3 *db)
     return sqlite3_finalize(stmt);
 }
 
+int pg_sqlite_wal(sqlite3 *db)
+{
+    /* readers go on while a writer commits, and writers wait for each other only to commit */
+    return sqlite3_exec(db, "PRAGMA journal_mode=WAL;", 0, 0, 0);
+}
+
 int pg_sqlite_init(sqlite3 *db)
 {
     pg_sqlite_create(db);
@@ -61,51 +100,77 @@ int pg_sqlite_exit(sqlite3 *db)
     return pg_sqlite_commit(db);
 }
 
+/* sets a record from the columns of a row that was selected with all of them */
+static int pg_sqlite_row(pg_tree *tree, pg_item *item, sqlite3_stmt *stmt)
+{
+    pg_view view;
+    char const *text = (char const *)sqlite3_column_text(stmt, 1);
+    view.hash = text ? text : "MD5";
+    view.size = (unsigned int)sqlite3_column_int(stmt, 2);
+    view.type = (unsigned int)sqlite3_column_int(stmt, 3);
+    view.misc = (char const *)sqlite3_column_text(stmt, 4);
+    view.hint = (char const *)sqlite3_column_text(stmt, 5);
+    if (pg_tree_set(tree, item, &view)) { return A_FAILURE; }
+    pg_tree_time(tree, item, sqlite3_column_int64(stmt, 6));
+    return A_SUCCESS;
+}
+
 int pg_sqlite_out(sqlite3 *db, pg_tree *tree)
 {
     sqlite3_stmt *stmt = 0;
+    PG_STATS_BEGIN(t);
 
     sqlite3_str *str = sqlite3_str_new(db);
     sqlite3_str_appendf(str, "SELECT * FROM %s ORDER BY %s ASC;", PG_SQLITE_TABLE, "text");
     char *sql = sqlite3_str_finish(str);
-    sqlite3_prepare(db, sql, -1, &stmt, 0);
+    int ok = sqlite3_prepare(db, sql, -1, &stmt, 0);
     sqlite3_free(sql);
+    if (ok != SQLITE_OK) { return ok; }
 
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        unsigned char const *text = sqlite3_column_text(stmt, 0);
+        char const *text = (char const *)sqlite3_column_text(stmt, 0);
         if (text == 0) { continue; }
-        pg_item *item = pg_tree_add(tree, text);
-        if (((void)(text = sqlite3_column_text(stmt, 1)), text))
-        {
-            pg_item_set_hash(item, text);
-        }
-        else
-        {
-            pg_item_set_hash(item, "MD5");
-        }
-        pg_item_set_size(item, (unsigned int)sqlite3_column_int(stmt, 2));
-        pg_item_set_type(item, (unsigned int)sqlite3_column_int(stmt, 3));
-        if (((void)(text = sqlite3_column_text(stmt, 4)), text) && item->type == PG_TYPE_OTHER)
-        {
-            pg_item_set_misc(item, text);
-        }
-        if (((void)(text = sqlite3_column_text(stmt, 5)), text))
-        {
-            pg_item_set_hint(item, text);
-        }
-        item->time = sqlite3_column_int64(stmt, 6);
+        pg_item *item = pg_tree_push(tree, text, strlen(text));
+        if (item == 0 || pg_sqlite_row(tree, item, stmt)) { break; }
+        PG_STATS_ADD(PG_STATS_ROWS, 1);
     }
 
+    PG_STATS_END(PG_STATS_LOAD, t);
     return sqlite3_finalize(stmt);
 }
 
 int pg_sqlite_add(sqlite3 *db, pg_tree const *tree)
+{
+    return pg_sqlite_add_if(db, tree, A_NULL, A_NULL);
+}
+
+/* binds the fields of a record to parameters 1 to 7, in the order of COLUMNS */
+static void pg_sqlite_bind(sqlite3_stmt *stmt, pg_item const *it)
+{
+    sqlite3_bind_text(stmt, 1, it->text, (int)it->ltext, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, pg_hash_name(it->hash), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, (int)it->size);
+    sqlite3_bind_int(stmt, 4, (int)it->type);
+    if (it->misc && it->type == PG_TYPE_OTHER)
+    {
+        sqlite3_bind_text(stmt, 5, it->misc, -1, SQLITE_STATIC);
+    }
+    else { sqlite3_bind_null(stmt, 5); }
+    if (it->hint)
+    {
+        sqlite3_bind_text(stmt, 6, it->hint, -1, SQLITE_STATIC);
+    }
+    else { sqlite3_bind_null(stmt, 6); }
+    sqlite3_bind_int64(stmt, 7, it->time);
+}
+
+int pg_sqlite_add_if(sqlite3 *db, pg_tree const *tree, int (*keep)(void *, pg_item const *), void *arg)
 {
     sqlite3_stmt *stmt = 0;
 
     sqlite3_str *str = sqlite3_str_new(db);
-    sqlite3_str_appendf(str, "INSERT INTO %s VALUES(?,?,?,?,?,?,?);", PG_SQLITE_TABLE);
+    sqlite3_str_appendf(str, "INSERT INTO %s(%s) VALUES(?,?,?,?,?,?,?);", PG_SQLITE_TABLE, COLUMNS);
     char *sql = sqlite3_str_finish(str);
     sqlite3_prepare(db, sql, -1, &stmt, 0);
     sqlite3_free(sql);
@@ -113,29 +178,10 @@ int pg_sqlite_add(sqlite3 *db, pg_tree const *tree)
     pg_tree_foreach(cur, tree)
     {
         pg_item *it = pg_tree_entry(cur);
-        if (a_str_len(it->text))
+        if (*it->text && (!keep || keep(arg, it)))
         {
             sqlite3_reset(stmt);
-            {
-                int size = (int)a_str_len(it->text);
-                sqlite3_bind_text(stmt, 1, a_str_ptr(it->text), size, SQLITE_STATIC);
-            }
-            {
-                int size = (int)a_str_len(it->hash);
-                sqlite3_bind_text(stmt, 2, a_str_ptr(it->hash), size, SQLITE_STATIC);
-            }
-            sqlite3_bind_int(stmt, 3, (int)it->size);
-            sqlite3_bind_int(stmt, 4, (int)it->type);
-            {
-                int size = (int)a_str_len(it->misc);
-                if (it->type != PG_TYPE_OTHER) { size = 0; }
-                sqlite3_bind_text(stmt, 5, a_str_ptr(it->misc), size, SQLITE_STATIC);
-            }
-            {
-                int size = (int)a_str_len(it->hint);
-                sqlite3_bind_text(stmt, 6, a_str_ptr(it->hint), size, SQLITE_STATIC);
-            }
-            sqlite3_bind_int64(stmt, 7, it->time);
+            pg_sqlite_bind(stmt, it);
             sqlite3_step(stmt);
         }
     }
@@ -144,6 +190,11 @@ int pg_sqlite_add(sqlite3 *db, pg_tree const *tree)
 }
 
 int pg_sqlite_del(sqlite3 *db, pg_tree const *tree)
+{
+    return pg_sqlite_del_if(db, tree, A_NULL, A_NULL);
+}
+
+int pg_sqlite_del_if(sqlite3 *db, pg_tree const *tree, int (*keep)(void *, pg_item const *), void *arg)
 {
     sqlite3_stmt *stmt = 0;
 
@@ -156,16 +207,158 @@ int pg_sqlite_del(sqlite3 *db, pg_tree const *tree)
     pg_tree_foreach(cur, tree)
     {
         pg_item *it = pg_tree_entry(cur);
-        if (a_str_len(it->text))
+        if (*it->text && (!keep || keep(arg, it)))
         {
             sqlite3_reset(stmt);
-            {
-                int size = (int)a_str_len(it->text);
-                sqlite3_bind_text(stmt, 1, a_str_ptr(it->text), size, SQLITE_STATIC);
-            }
+            sqlite3_bind_text(stmt, 1, it->text, (int)it->ltext, SQLITE_STATIC);
             sqlite3_step(stmt);
         }
     }
 
     return sqlite3_finalize(stmt);
 }
+
+int pg_sqlite_version(sqlite3 *db, pg_tree *version)
+{
+    sqlite3_stmt *stmt = 0;
+
+    sqlite3_str *str = sqlite3_str_new(db);
+    sqlite3_str_appendf(str, "SELECT %s,%s FROM %s WHERE %s != 0;", "text", "version", PG_SQLITE_TABLE, "version");
+    char *sql = sqlite3_str_finish(str);
+    int ok = sqlite3_prepare(db, sql, -1, &stmt, 0);
+    sqlite3_free(sql);
+    if (ok != SQLITE_OK) { return ok; }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        char const *text = (char const *)sqlite3_column_text(stmt, 0);
+        if (text == 0) { continue; }
+        pg_item *item = pg_tree_add(version, text);
+        if (item == 0) { break; }
+        item->time = sqlite3_column_int64(stmt, 1);
+    }
+
+    return sqlite3_finalize(stmt);
+}
+
+static sqlite3_stmt *pg_sqlite_prepare(sqlite3 *db, int *ok, char const *fmt, ...)
+{
+    sqlite3_stmt *stmt = 0;
+    va_list va;
+    va_start(va, fmt);
+    sqlite3_str *str = sqlite3_str_new(db);
+    sqlite3_str_vappendf(str, fmt, va);
+    va_end(va);
+    char *sql = sqlite3_str_finish(str);
+    if (*ok == SQLITE_OK) { *ok = sqlite3_prepare_v2(db, sql, -1, &stmt, 0); }
+    sqlite3_free(sql);
+    return stmt;
+}
+
+int pg_sqlite_rows_ctor(pg_sqlite_rows *ctx, sqlite3 *db)
+{
+    int ok = SQLITE_OK;
+    ctx->db = db;
+    ctx->get = pg_sqlite_prepare(db, &ok, "SELECT %s,%s FROM %s WHERE %s = ?;", COLUMNS, "version", PG_SQLITE_TABLE, "text");
+    /* the row is written only when nobody wrote it since it was read */
+    ctx->put = pg_sqlite_prepare(db, &ok,
+                                 "INSERT INTO %s(%s,%s) VALUES(?1,?2,?3,?4,?5,?6,?7,?8 + 1) "
+                                 "ON CONFLICT(%s) DO UPDATE SET %s=excluded.%s,%s=excluded.%s,%s=excluded.%s,"
+                                 "%s=excluded.%s,%s=excluded.%s,%s=excluded.%s,%s=excluded.%s WHERE %s = ?8;",
+                                 PG_SQLITE_TABLE, COLUMNS, "version", "text", "hash", "hash", "size", "size", "type", "type",
+                                 "misc", "misc", "hint", "hint", "time", "time", "version", "version", "version");
+    ctx->drop = pg_sqlite_prepare(db, &ok, "DELETE FROM %s WHERE %s = ?1 AND %s = ?2;", PG_SQLITE_TABLE, "text", "version");
+    ctx->probe = pg_sqlite_prepare(db, &ok, "SELECT 1 FROM %s WHERE %s = ?;", PG_SQLITE_TABLE, "text");
+    if (ok != SQLITE_OK) { pg_sqlite_rows_dtor(ctx); }
+    return ok;
+}
+
+void pg_sqlite_rows_dtor(pg_sqlite_rows *ctx)
+{
+    sqlite3_finalize(ctx->get);
+    sqlite3_finalize(ctx->put);
+    sqlite3_finalize(ctx->drop);
+    sqlite3_finalize(ctx->probe);
+    ctx->get = ctx->put = ctx->drop = ctx->probe = 0;
+}
+
+/* runs a statement once, then makes it ready for the next row */
+static int pg_sqlite_step(sqlite3_stmt *stmt)
+{
+    int const rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc;
+}
+
+int pg_sqlite_get(pg_sqlite_rows *ctx, pg_tree *tree, char const *text, a_i64 *version)
+{
+    sqlite3_stmt *stmt = ctx->get;
+    sqlite3_bind_text(stmt, 1, text, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW)
+    {
+        pg_item *item = pg_tree_add(tree, text);
+        if (item == 0 || pg_sqlite_row(tree, item, stmt)) { rc = SQLITE_NOMEM; }
+        else { *version = sqlite3_column_int64(stmt, 7); }
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc == SQLITE_DONE) { return SQLITE_NOTFOUND; }
+    return rc == SQLITE_ROW ? SQLITE_OK : rc;
+}
+
+int pg_sqlite_put(pg_sqlite_rows *ctx, pg_item const *item, a_i64 *version)
+{
+    pg_sqlite_bind(ctx->put, item);
+    sqlite3_bind_int64(ctx->put, 8, *version);
+    int const rc = pg_sqlite_step(ctx->put);
+    if (rc != SQLITE_DONE) { return rc; }
+    if (sqlite3_changes(ctx->db) == 0) { return SQLITE_CONSTRAINT; }
+    ++*version;
+    return SQLITE_OK;
+}
+
+int pg_sqlite_drop(pg_sqlite_rows *ctx, char const *text, a_i64 version)
+{
+    sqlite3_bind_text(ctx->drop, 1, text, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(ctx->drop, 2, version);
+    int rc = pg_sqlite_step(ctx->drop);
+    if (rc != SQLITE_DONE) { return rc; }
+    if (sqlite3_changes(ctx->db)) { return SQLITE_OK; }
+
+    /* nothing to delete is fine, a row of another version is not */
+    sqlite3_bind_text(ctx->probe, 1, text, -1, SQLITE_STATIC);
+    rc = pg_sqlite_step(ctx->probe);
+    if (rc == SQLITE_ROW) { return SQLITE_CONSTRAINT; }
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+int pg_sqlite_rewrite(sqlite3 *db, pg_tree const *tree)
+{
+    /* every row ends newer than any version another connection may have read */
+    sqlite3_str *str = sqlite3_str_new(db);
+    sqlite3_str_appendf(str, "DROP TABLE IF EXISTS temp.%s_%s;"
+                             "CREATE TEMP TABLE %s_%s(%s TEXT PRIMARY KEY, %s INTEGER);"
+                             "INSERT INTO temp.%s_%s SELECT %s,%s FROM %s;",
+                        PG_SQLITE_TABLE, "version", PG_SQLITE_TABLE, "version", "text", "version",
+                        PG_SQLITE_TABLE, "version", "text", "version", PG_SQLITE_TABLE);
+    char *sql = sqlite3_str_finish(str);
+    int ok = sqlite3_exec(db, sql, 0, 0, 0);
+    sqlite3_free(sql);
+    if (ok == SQLITE_OK) { ok = pg_sqlite_delete(db); }
+    if (ok == SQLITE_OK) { ok = pg_sqlite_create(db); }
+    if (ok == SQLITE_OK) { ok = pg_sqlite_add(db, tree); }
+    if (ok == SQLITE_OK)
+    {
+        str = sqlite3_str_new(db);
+        sqlite3_str_appendf(str, "UPDATE %s SET %s = 1 + IFNULL((SELECT %s FROM temp.%s_%s AS old WHERE old.%s = %s.%s), 0);"
+                                 "DROP TABLE temp.%s_%s;",
+                            PG_SQLITE_TABLE, "version", "version", PG_SQLITE_TABLE, "version", "text", PG_SQLITE_TABLE, "text",
+                            PG_SQLITE_TABLE, "version");
+        sql = sqlite3_str_finish(str);
+        ok = sqlite3_exec(db, sql, 0, 0, 0);
+        sqlite3_free(sql);
+    }
+    return ok;
+}
@@ -0,0 +1,376 @@
+#if !defined _GNU_SOURCE && defined(__linux__)
+#define _GNU_SOURCE /* NOLINT */
+#endif /* _GNU_SOURCE */
+#include "pg/stats.h"
+#include "pg/thread.h"
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#include <dlfcn.h>
+#endif /* __GLIBC__ || __APPLE__ */
+#if defined(_WIN32)
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 5105)
+#endif /* _MSC_VER */
+#include <windows.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif /* _MSC_VER */
+#else /* !_WIN32 */
+#include <time.h>
+#endif /* _WIN32 */
+
+static char const *const stats_span[PG_STATS_SPAN] = {
+    "open", "load", "tree", "gen", "save", "json", "lz"};
+static char const *const stats_count[PG_STATS_COUNT] = {
+    "rows", "bytes", "hmac", "alloc", "alloc_bytes", "insert", "remove", "lz_bytes", "cache"};
+
+static struct
+{
+    a_u64 span[PG_STATS_SPAN][2]; /* passes, nanoseconds */
+    a_u64 count[PG_STATS_COUNT];
+} stats;
+
+/* workers of the batch mode generate concurrently */
+#if defined(__GNUC__) || defined(__clang__)
+#define stats_inc(var, n) __atomic_fetch_add(&(var), n, __ATOMIC_RELAXED)
+#elif defined(_MSC_VER)
+#define stats_inc(var, n) InterlockedExchangeAdd64((LONG64 volatile *)&(var), (LONG64)(n))
+#else /* !atomic */
+#define stats_inc(var, n) ((var) += (n))
+#endif /* atomic */
+
+a_u64 pg_stats_clock(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, tick;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&tick);
+    return (a_u64)tick.QuadPart / (a_u64)freq.QuadPart * 1000000000 +
+           (a_u64)tick.QuadPart % (a_u64)freq.QuadPart * 1000000000 / (a_u64)freq.QuadPart;
+#else /* !_WIN32 */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (a_u64)ts.tv_sec * 1000000000 + (a_u64)ts.tv_nsec;
+#endif /* _WIN32 */
+}
+
+void pg_stats_time(unsigned int id, a_u64 ns)
+{
+    if (id >= PG_STATS_SPAN) { return; }
+    stats_inc(stats.span[id][0], 1);
+    stats_inc(stats.span[id][1], ns);
+}
+
+void pg_stats_add(unsigned int id, a_u64 n)
+{
+    if (id >= PG_STATS_COUNT) { return; }
+    stats_inc(stats.count[id], n);
+}
+
+#define SITES 0x100
+#define TOP 10
+/* frames of a call site, most allocations go through a string, vector or pool helper first */
+#define DEPTH 4
+
+typedef struct stats_block
+{
+    void *addr;
+    void *site;
+    a_size size;
+} stats_block;
+
+typedef struct stats_site
+{
+    void *site[DEPTH]; /* caller of a_alloc first, null past the last frame */
+    a_u64 calls;
+    a_u64 bytes;
+} stats_site;
+
+/* live blocks are found by address, blocks from before the hook pass through */
+static struct
+{
+    void *(*next)(void *, a_size);
+    stats_block *block;
+    a_size mask; /* capacity of block minus one */
+    a_size count; /* blocks in use */
+    stats_site site[SITES]; /* the last slot collects sites that do not fit */
+    a_u64 calls;
+    a_u64 frees;
+    a_u64 bytes;
+    a_u64 live;
+    a_u64 peak;
+    pg_mutex lock;
+} prof;
+
+static A_INLINE a_size prof_hash(void const *addr)
+{
+    a_uptr x = (a_uptr)addr >> 4;
+    return (a_size)(x ^ (x >> 15) ^ (x >> 31));
+}
+
+static int prof_grow(void)
+{
+    a_size mask = prof.mask ? (prof.mask << 1) | 1 : 0x3FF;
+    stats_block *block = (stats_block *)calloc(mask + 1, sizeof(stats_block));
+    if (!block) { return ~0; }
+    for (a_size i = 0; prof.block && i <= prof.mask; ++i)
+    {
+        if (!prof.block[i].addr) { continue; }
+        a_size j = prof_hash(prof.block[i].addr) & mask;
+        while (block[j].addr) { j = (j + 1) & mask; }
+        block[j] = prof.block[i];
+    }
+    free(prof.block);
+    prof.block = block;
+    prof.mask = mask;
+    return 0;
+}
+
+static void prof_insert(void *addr, a_size size, void *site)
+{
+    if ((prof.count + 1) * 4 > prof.mask * 3 && prof_grow()) { return; }
+    a_size i = prof_hash(addr) & prof.mask;
+    while (prof.block[i].addr) { i = (i + 1) & prof.mask; }
+    prof.block[i].addr = addr;
+    prof.block[i].site = site;
+    prof.block[i].size = size;
+    ++prof.count;
+    prof.live += size;
+    if (prof.live > prof.peak) { prof.peak = prof.live; }
+}
+
+/* linear probing removes with a backward shift so no tombstones are left, the removed entry goes to out */
+static void prof_remove(void *addr, stats_block *out)
+{
+    if (!prof.block) { return; }
+    a_size i = prof_hash(addr) & prof.mask;
+    while (prof.block[i].addr != addr)
+    {
+        if (!prof.block[i].addr) { return; }
+        i = (i + 1) & prof.mask;
+    }
+    *out = prof.block[i];
+    prof.live -= prof.block[i].size;
+    --prof.count;
+    for (a_size j = (i + 1) & prof.mask; prof.block[j].addr; j = (j + 1) & prof.mask)
+    {
+        a_size k = prof_hash(prof.block[j].addr) & prof.mask;
+        if (((j - k) & prof.mask) >= ((j - i) & prof.mask))
+        {
+            prof.block[i] = prof.block[j];
+            i = j;
+        }
+    }
+    prof.block[i].addr = A_NULL;
+}
+
+static void prof_site(void *const *site, a_size size)
+{
+    a_size h = 0;
+    for (unsigned int k = 0; k != DEPTH; ++k) { h = h * 31 + prof_hash(site[k]); }
+    a_size i = h % (SITES - 1);
+    for (a_size n = 0; memcmp(prof.site[i].site, site, sizeof(prof.site[i].site)); i = (i + 1) % (SITES - 1))
+    {
+        if (!prof.site[i].site[0])
+        {
+            memcpy(prof.site[i].site, site, sizeof(prof.site[i].site));
+            break;
+        }
+        if (++n == SITES - 1)
+        {
+            i = SITES - 1;
+            break;
+        }
+    }
+    ++prof.site[i].calls;
+    prof.site[i].bytes += size;
+}
+
+static void *prof_alloc(void *addr, a_size size)
+{
+    void *site[DEPTH] = {A_NULL};
+    if (size)
+    {
+#if defined(__GLIBC__) || defined(__APPLE__)
+        /* the first frame is this function */
+        void *frame[DEPTH + 1];
+        int const n = backtrace(frame, DEPTH + 1);
+        for (int k = 1; k < n; ++k) { site[k - 1] = frame[k]; }
+#elif defined(__GNUC__) || defined(__clang__)
+        site[0] = __builtin_return_address(0);
+#endif /* __GLIBC__ || __APPLE__ */
+    }
+    stats_block old = {A_NULL, A_NULL, 0};
+    if (addr)
+    {
+        /* the block leaves the table before it is given back, so no other thread that gets its address loses the entry */
+        pg_mutex_lock(&prof.lock);
+        if (!size) { ++prof.frees; }
+        prof_remove(addr, &old);
+        pg_mutex_unlock(&prof.lock);
+    }
+    void *ptr = prof.next(addr, size);
+    if (!size) { return ptr; }
+    pg_mutex_lock(&prof.lock);
+    if (ptr)
+    {
+        ++prof.calls;
+        prof.bytes += size;
+        prof_site(site, size);
+        prof_insert(ptr, size, site[0]);
+    }
+    /* a failed realloc keeps the old block */
+    else if (old.addr) { prof_insert(old.addr, old.size, old.site); }
+    pg_mutex_unlock(&prof.lock);
+    return ptr;
+}
+
+void pg_stats_alloc(void)
+{
+    if (prof.next) { return; }
+    pg_mutex_ctor(&prof.lock);
+    prof.next = a_alloc;
+    a_alloc = prof_alloc;
+}
+
+static void prof_reset(void)
+{
+    if (!prof.next) { return; }
+    pg_mutex_lock(&prof.lock);
+    memset(prof.site, 0, sizeof(prof.site));
+    prof.calls = 0;
+    prof.frees = 0;
+    prof.bytes = 0;
+    prof.peak = prof.live;
+    pg_mutex_unlock(&prof.lock);
+}
+
+/* copies the sites with the most bytes, largest first */
+static unsigned int prof_top(stats_site *top)
+{
+    unsigned int n = 0;
+    pg_mutex_lock(&prof.lock);
+    for (unsigned int i = 0; i != SITES; ++i)
+    {
+        if (!prof.site[i].calls) { continue; }
+        unsigned int j = n < TOP ? n++ : TOP;
+        for (; j && top[j - 1].bytes < prof.site[i].bytes; --j)
+        {
+            if (j < TOP) { top[j] = top[j - 1]; }
+        }
+        if (j < TOP) { top[j] = prof.site[i]; }
+    }
+    pg_mutex_unlock(&prof.lock);
+    return n;
+}
+
+/* names a frame as symbol+offset or module+offset when it can */
+static int prof_frame(a_str *out, void *site)
+{
+    if (!site) { return a_str_cats(out, "?"); }
+#if defined(__GLIBC__) || defined(__APPLE__)
+    Dl_info info;
+    if (dladdr(site, &info))
+    {
+        if (info.dli_sname)
+        {
+            return a_str_catf(out, "%s+0x%lx", info.dli_sname,
+                              (unsigned long)((char *)site - (char *)info.dli_saddr)) < 0;
+        }
+        if (info.dli_fname)
+        {
+            char const *name = strrchr(info.dli_fname, '/');
+            return a_str_catf(out, "%s+0x%lx", name ? name + 1 : info.dli_fname,
+                              (unsigned long)((char *)site - (char *)info.dli_fbase)) < 0;
+        }
+    }
+#endif /* __GLIBC__ || __APPLE__ */
+    return a_str_catf(out, "%p", site) < 0;
+}
+
+/* names the frames of a call site from the caller of a_alloc outwards */
+static int prof_name(a_str *out, stats_site const *site)
+{
+    if (prof_frame(out, site->site[0])) { return ~0; }
+    for (unsigned int k = 1; k != DEPTH && site->site[k]; ++k)
+    {
+        if (a_str_cats(out, " < ") < 0 || prof_frame(out, site->site[k])) { return ~0; }
+    }
+    return 0;
+}
+
+void pg_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    prof_reset();
+}
+
+int pg_stats_text(a_str *out)
+{
+    for (unsigned int i = 0; i != PG_STATS_SPAN; ++i)
+    {
+        if (a_str_catf(out, "%-12s%10llu%14.3f ms\n", stats_span[i], (unsigned long long)stats.span[i][0],
+                       (double)stats.span[i][1] / 1e6) < 0) { return ~0; }
+    }
+    for (unsigned int i = 0; i != PG_STATS_COUNT; ++i)
+    {
+        if (a_str_catf(out, "%-12s%10llu\n", stats_count[i], (unsigned long long)stats.count[i]) < 0) { return ~0; }
+    }
+    if (!prof.next) { return 0; }
+
+    stats_site top[TOP];
+    unsigned int n = prof_top(top);
+    pg_mutex_lock(&prof.lock);
+    a_u64 const value[] = {prof.calls, prof.frees, prof.bytes, prof.live, prof.peak};
+    pg_mutex_unlock(&prof.lock);
+    static char const *const name[] = {"a_alloc", "a_die", "a_bytes", "a_live", "a_peak"};
+    for (unsigned int i = 0; i != sizeof(value) / sizeof(*value); ++i)
+    {
+        if (a_str_catf(out, "%-12s%10llu\n", name[i], (unsigned long long)value[i]) < 0) { return ~0; }
+    }
+    for (unsigned int i = 0; i != n; ++i)
+    {
+        if (a_str_catf(out, "%10llu%14llu  ", (unsigned long long)top[i].calls,
+                       (unsigned long long)top[i].bytes) < 0 ||
+            prof_name(out, top + i) || a_str_catc(out, '\n') < 0) { return ~0; }
+    }
+    return 0;
+}
+
+int pg_stats_json(a_str *out)
+{
+    char const *sep = "{\"span\":{";
+    for (unsigned int i = 0; i != PG_STATS_SPAN; ++i)
+    {
+        if (a_str_catf(out, "%s\"%s\":{\"count\":%llu,\"ns\":%llu}", sep, stats_span[i],
+                       (unsigned long long)stats.span[i][0], (unsigned long long)stats.span[i][1]) < 0) { return ~0; }
+        sep = ",";
+    }
+    sep = "},\"count\":{";
+    for (unsigned int i = 0; i != PG_STATS_COUNT; ++i)
+    {
+        if (a_str_catf(out, "%s\"%s\":%llu", sep, stats_count[i], (unsigned long long)stats.count[i]) < 0) { return ~0; }
+        sep = ",";
+    }
+    if (!prof.next) { return a_str_cats(out, "}}") < 0 ? ~0 : 0; }
+
+    stats_site top[TOP];
+    unsigned int n = prof_top(top);
+    pg_mutex_lock(&prof.lock);
+    a_u64 const value[] = {prof.calls, prof.frees, prof.bytes, prof.live, prof.peak};
+    pg_mutex_unlock(&prof.lock);
+    if (a_str_catf(out, "},\"alloc\":{\"calls\":%llu,\"frees\":%llu,\"bytes\":%llu,\"live\":%llu,\"peak\":%llu",
+                   (unsigned long long)value[0], (unsigned long long)value[1], (unsigned long long)value[2],
+                   (unsigned long long)value[3], (unsigned long long)value[4]) < 0) { return ~0; }
+    sep = ",\"sites\":[";
+    for (unsigned int i = 0; i != n; ++i)
+    {
+        if (a_str_catf(out, "%s{\"calls\":%llu,\"bytes\":%llu,\"site\":\"", sep,
+                       (unsigned long long)top[i].calls, (unsigned long long)top[i].bytes) < 0 ||
+            prof_name(out, top + i) || a_str_cats(out, "\"}") < 0) { return ~0; }
+        sep = ",";
+    }
+    if (n == 0 && a_str_cats(out, sep) < 0) { return ~0; }
+    return a_str_cats(out, "]}}") < 0 ? ~0 : 0;
+}
@@ -0,0 +1,83 @@
+#include "pg/thread.h"
+#if defined(_WIN32)
+#include <process.h>
+#else /* !_WIN32 */
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#if defined(_WIN32)
+
+static unsigned int __stdcall pg_thread_main(void *arg)
+{
+    pg_thread *ctx = (pg_thread *)arg;
+    ctx->arg = ctx->func(ctx->arg);
+    return 0;
+}
+
+int pg_thread_ctor(pg_thread *ctx, void *(*func)(void *), void *arg)
+{
+    ctx->func = func;
+    ctx->arg = arg;
+    ctx->handle = (HANDLE)_beginthreadex(NULL, 0, pg_thread_main, ctx, 0, NULL);
+    return ctx->handle ? A_SUCCESS : A_FAILURE;
+}
+
+void *pg_thread_join(pg_thread *ctx)
+{
+    WaitForSingleObject(ctx->handle, INFINITE);
+    CloseHandle(ctx->handle);
+    return ctx->arg;
+}
+
+unsigned int pg_thread_cpus(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (unsigned int)info.dwNumberOfProcessors : 1;
+}
+
+void pg_mutex_ctor(pg_mutex *ctx) { InitializeCriticalSection(&ctx->lock); }
+void pg_mutex_dtor(pg_mutex *ctx) { DeleteCriticalSection(&ctx->lock); }
+void pg_mutex_lock(pg_mutex *ctx) { EnterCriticalSection(&ctx->lock); }
+void pg_mutex_unlock(pg_mutex *ctx) { LeaveCriticalSection(&ctx->lock); }
+
+void pg_cond_ctor(pg_cond *ctx) { InitializeConditionVariable(&ctx->cond); }
+void pg_cond_dtor(pg_cond *ctx) { (void)ctx; }
+void pg_cond_wait(pg_cond *ctx, pg_mutex *mutex) { SleepConditionVariableCS(&ctx->cond, &mutex->lock, INFINITE); }
+void pg_cond_signal(pg_cond *ctx) { WakeConditionVariable(&ctx->cond); }
+void pg_cond_broadcast(pg_cond *ctx) { WakeAllConditionVariable(&ctx->cond); }
+
+#else /* !_WIN32 */
+
+int pg_thread_ctor(pg_thread *ctx, void *(*func)(void *), void *arg)
+{
+    ctx->func = func;
+    ctx->arg = arg;
+    return pthread_create(&ctx->handle, NULL, func, arg) ? A_FAILURE : A_SUCCESS;
+}
+
+void *pg_thread_join(pg_thread *ctx)
+{
+    void *ret = A_NULL;
+    pthread_join(ctx->handle, &ret);
+    return ret;
+}
+
+unsigned int pg_thread_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+void pg_mutex_ctor(pg_mutex *ctx) { pthread_mutex_init(&ctx->lock, NULL); }
+void pg_mutex_dtor(pg_mutex *ctx) { pthread_mutex_destroy(&ctx->lock); }
+void pg_mutex_lock(pg_mutex *ctx) { pthread_mutex_lock(&ctx->lock); }
+void pg_mutex_unlock(pg_mutex *ctx) { pthread_mutex_unlock(&ctx->lock); }
+
+void pg_cond_ctor(pg_cond *ctx) { pthread_cond_init(&ctx->cond, NULL); }
+void pg_cond_dtor(pg_cond *ctx) { pthread_cond_destroy(&ctx->cond); }
+void pg_cond_wait(pg_cond *ctx, pg_mutex *mutex) { pthread_cond_wait(&ctx->cond, &mutex->lock); }
+void pg_cond_signal(pg_cond *ctx) { pthread_cond_signal(&ctx->cond); }
+void pg_cond_broadcast(pg_cond *ctx) { pthread_cond_broadcast(&ctx->cond); }
+
+#endif /* _WIN32 */
@@ -1,19 +1,207 @@
 #include "pg/pg.h"
+#include "pg/stats.h"
+
+a_u32 pg_tree_hash(void const *text, a_size *ltext)
+{
+    /* FNV-1a, the length comes out of the same pass */
+    a_u32 x = 0x811C9DC5;
+    unsigned char const *p = (unsigned char const *)text;
+    for (; *p; ++p) { x = (x ^ *p) * 0x01000193; }
+    if (ltext) { *ltext = (a_size)(p - (unsigned char const *)text); }
+    return x;
+}
+
+/* home slot of a hash, the high bits of the product reach the low bits */
+static a_size pg_tree_home(a_u32 hash, a_size mask)
+{
+    a_u32 x = hash * 0x9E3779B9;
+    return (x ^ (x >> 16)) & mask;
+}
+
+/* finds the slot of a text, or the empty slot that ends its probe sequence */
+static pg_slot *pg_tree_find(pg_tree const *ctx, void const *text, a_size ltext, a_u32 hash)
+{
+    for (a_size i = pg_tree_home(hash, ctx->mask);; i = (i + 1) & ctx->mask)
+    {
+        pg_slot *const slot = ctx->slot + i;
+        if (!slot->item) { return slot; }
+        if (slot->hash == hash && slot->ltext == ltext && memcmp(slot->item->text, text, ltext) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+/* empties a slot, later slots of the same probe sequence move back into it */
+static void pg_tree_unset(pg_tree *ctx, pg_slot *slot)
+{
+    a_size i = (a_size)(slot - ctx->slot);
+    for (a_size j = i;;)
+    {
+        j = (j + 1) & ctx->mask;
+        if (!ctx->slot[j].item) { break; }
+        a_size const k = pg_tree_home(ctx->slot[j].hash, ctx->mask);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) { continue; }
+        ctx->slot[i] = ctx->slot[j];
+        i = j;
+    }
+    ctx->slot[i].item = A_NULL;
+}
+
+static void pg_tree_put(pg_tree *ctx, pg_item *item, a_u32 hash)
+{
+    a_size i = pg_tree_home(hash, ctx->mask);
+    while (ctx->slot[i].item) { i = (i + 1) & ctx->mask; }
+    ctx->slot[i].item = item;
+    ctx->slot[i].hash = hash;
+    ctx->slot[i].ltext = item->ltext;
+}
+
+/* rebuilds the index with room for count records, or turns it off */
+static void pg_tree_index(pg_tree *ctx, a_size count)
+{
+    a_size mask = 0xF;
+    while (mask >> 1 < count) { mask = (mask << 1) | 1; }
+    pg_slot *slot = (pg_slot *)a_alloc(A_NULL, sizeof(pg_slot) * (mask + 1));
+    if (slot) { a_zero(slot, sizeof(pg_slot) * (mask + 1)); }
+    pg_slot *const old = ctx->slot;
+    a_size const end = ctx->mask + 1;
+    ctx->slot = slot;
+    ctx->mask = mask;
+    if (slot && old)
+    {
+        for (a_size i = 0; i != end; ++i)
+        {
+            if (old[i].item) { pg_tree_put(ctx, old[i].item, old[i].hash); }
+        }
+    }
+    else if (slot)
+    {
+        pg_tree_foreach(cur, ctx)
+        {
+            pg_item *const it = pg_tree_entry(cur);
+            pg_tree_put(ctx, it, pg_tree_hash(it->text, A_NULL));
+        }
+    }
+    a_die(old);
+    if (!slot) { ctx->mask = 0; }
+}
+
+/* adds a record that was just linked into the tree to the index */
+static void pg_tree_hook(pg_tree *ctx, pg_item *item, a_u32 hash)
+{
+    if (!ctx->slot)
+    {
+        /* the index starts with the first record and stays off once dropped */
+        if (ctx->count != 1) { return; }
+        pg_tree_index(ctx, 1);
+        if (!ctx->slot) { return; }
+    }
+    else if (ctx->count > (ctx->mask + 1) >> 1)
+    {
+        pg_tree_index(ctx, ctx->count);
+        if (!ctx->slot) { return; }
+    }
+    pg_tree_put(ctx, item, hash);
+}
+
+/* orders entries of the index by time, then by text like the tree */
+static int pg_tree_mark_cmp(void const *_lhs, void const *_rhs)
+{
+    pg_item const *lhs = a_rbt_entry(_lhs, pg_mark, node)->item;
+    pg_item const *rhs = a_rbt_entry(_rhs, pg_mark, node)->item;
+    if (lhs->time != rhs->time) { return lhs->time < rhs->time ? -1 : 1; }
+    return strcmp(lhs->text, rhs->text);
+}
+
+static void pg_tree_when_off(pg_tree *ctx)
+{
+    pg_pool_dtor(&ctx->when->pool);
+    a_die(ctx->when);
+    ctx->when = A_NULL;
+}
+
+/* adds a record to the index by time, or turns the index off */
+static void pg_tree_mark(pg_tree *ctx, pg_item *item)
+{
+    pg_when *const when = ctx->when;
+    pg_mark *mark = when->spare;
+    if (mark) { when->spare = (pg_mark *)mark->node.left; }
+    else
+    {
+        mark = (pg_mark *)pg_pool_alloc(&when->pool, sizeof(pg_mark));
+        if (!mark)
+        {
+            pg_tree_when_off(ctx);
+            return;
+        }
+    }
+    mark->item = item;
+    a_rbt_insert(&when->root, &mark->node, pg_tree_mark_cmp);
+}
+
+/* removes a record from the index by time, it is found by its current time */
+static void pg_tree_unmark(pg_tree *ctx, pg_item *item)
+{
+    pg_when *const when = ctx->when;
+    pg_mark key;
+    key.item = item;
+    a_rbt_node *node = a_rbt_search(&when->root, &key.node, pg_tree_mark_cmp);
+    if (!node) { return; }
+    a_rbt_remove(&when->root, node);
+    node->left = (a_rbt_node *)when->spare;
+    when->spare = a_rbt_entry(node, pg_mark, node);
+}
+
+int pg_tree_when(pg_tree *ctx)
+{
+    if (ctx->when) { return A_SUCCESS; }
+    ctx->when = (pg_when *)a_alloc(A_NULL, sizeof(pg_when));
+    if (!ctx->when) { return A_OMEMORY; }
+    a_rbt_root(&ctx->when->root);
+    ctx->when->spare = A_NULL;
+    pg_pool_ctor(&ctx->when->pool, sizeof(pg_mark) << 10);
+    pg_tree_foreach(cur, ctx)
+    {
+        pg_tree_mark(ctx, pg_tree_entry(cur));
+        if (!ctx->when) { return A_OMEMORY; }
+    }
+    return A_SUCCESS;
+}
+
+void pg_tree_time(pg_tree *ctx, pg_item *item, a_i64 time)
+{
+    if (ctx->when && item->time != time)
+    {
+        pg_tree_unmark(ctx, item);
+        item->time = time;
+        pg_tree_mark(ctx, item);
+    }
+    else { item->time = time; }
+}
 
 void pg_tree_ctor(pg_tree *ctx)
 {
     a_avl_root(&ctx->root);
     ctx->count = 0;
+    ctx->spare = A_NULL;
+    ctx->slot = A_NULL;
+    ctx->mask = 0;
+    ctx->when = A_NULL;
+    pg_pool_ctor(&ctx->node, sizeof(pg_item) << 10);
+    pg_pool_ctor(&ctx->data, 0);
 }
 
 void pg_tree_dtor(pg_tree *ctx)
 {
-    a_avl_fortear(cur, next, &ctx->root)
-    {
-        pg_item *const it = pg_tree_entry(cur);
-        pg_item_dtor(it);
-        a_die(it);
-    }
+    pg_pool_dtor(&ctx->node);
+    pg_pool_dtor(&ctx->data);
+    a_avl_root(&ctx->root);
+    a_die(ctx->slot);
+    ctx->slot = A_NULL;
+    ctx->mask = 0;
+    if (ctx->when) { pg_tree_when_off(ctx); }
+    ctx->spare = A_NULL;
     ctx->count = 0;
 }
 
@@ -21,46 +209,141 @@ static int pg_tree_cmp(void const *_lhs, void const *_rhs)
 {
     pg_item const *lhs = pg_tree_entry(_lhs);
     pg_item const *rhs = pg_tree_entry(_rhs);
-    return a_str_cmp(lhs->text, rhs->text);
+    return strcmp(lhs->text, rhs->text);
 }
 
 void pg_tree_insert(pg_tree *ctx, pg_item *item)
 {
-    a_avl_insert(&ctx->root, &item->node, pg_tree_cmp);
+    if (a_avl_insert(&ctx->root, &item->node, pg_tree_cmp)) { return; }
     ++ctx->count;
+    pg_tree_hook(ctx, item, pg_tree_hash(item->text, A_NULL));
+    if (ctx->when) { pg_tree_mark(ctx, item); }
 }
 
 void pg_tree_remove(pg_tree *ctx, pg_item *item)
 {
+    if (ctx->slot)
+    {
+        a_u32 const hash = pg_tree_hash(item->text, A_NULL);
+        pg_tree_unset(ctx, pg_tree_find(ctx, item->text, item->ltext, hash));
+    }
+    if (ctx->when) { pg_tree_unmark(ctx, item); }
     a_avl_remove(&ctx->root, &item->node);
+    PG_STATS_ADD(PG_STATS_REMOVE, 1);
     --ctx->count;
 }
 
+static pg_item *pg_tree_new(pg_tree *ctx, void const *text, a_size ltext)
+{
+    pg_item *it = ctx->spare;
+    if (it) { ctx->spare = (pg_item *)it->node.left; }
+    else
+    {
+        it = (pg_item *)pg_pool_alloc(&ctx->node, sizeof(pg_item));
+        if (!it) { return it; }
+    }
+    pg_item_ctor(it);
+    it->ltext = (a_u32)ltext;
+    it->text = pg_pool_strn(&ctx->data, text, ltext);
+    if (!it->text)
+    {
+        pg_tree_free(ctx, it);
+        return A_NULL;
+    }
+    it->time = A_I32_MIN;
+    return it;
+}
+
 pg_item *pg_tree_add(pg_tree *ctx, void const *text)
 {
+    a_size ltext;
+    a_u32 const hash = pg_tree_hash(text, &ltext);
+    if (ctx->slot)
+    {
+        /* an existing record is found without walking the tree */
+        pg_slot *const slot = pg_tree_find(ctx, text, ltext, hash);
+        if (slot->item) { return slot->item; }
+    }
+    a_avl_node *parent = A_NULL;
+    a_avl_node **link = &ctx->root.node;
+    while (*link)
+    {
+        pg_item *const it = pg_tree_entry(*link);
+        int const res = strcmp((char const *)text, it->text);
+        parent = *link;
+        if (res < 0) { link = &parent->left; }
+        else if (res > 0) { link = &parent->right; }
+        else { return it; }
+    }
+    pg_item *it = pg_tree_new(ctx, text, ltext);
+    if (!it) { return it; }
+    *link = a_avl_init(&it->node, parent);
+    a_avl_insert_adjust(&ctx->root, &it->node);
+    PG_STATS_ADD(PG_STATS_INSERT, 1);
+    ++ctx->count;
+    pg_tree_hook(ctx, it, hash);
+    if (ctx->when) { pg_tree_mark(ctx, it); }
+    return it;
+}
+
+pg_item *pg_tree_push(pg_tree *ctx, void const *text, a_size ltext)
+{
+    a_avl_node *tail = a_avl_tail(&ctx->root);
+    if (tail && strcmp((char const *)text, pg_tree_entry(tail)->text) <= 0)
+    {
+        return pg_tree_add(ctx, text);
+    }
+    pg_item *it = pg_tree_new(ctx, text, ltext);
+    if (!it) { return it; }
+    if (tail) { tail->right = a_avl_init(&it->node, tail); }
+    else { ctx->root.node = a_avl_init(&it->node, A_NULL); }
+    a_avl_insert_adjust(&ctx->root, &it->node);
+    PG_STATS_ADD(PG_STATS_INSERT, 1);
+    ++ctx->count;
+    pg_tree_hook(ctx, it, pg_tree_hash(it->text, A_NULL));
+    if (ctx->when) { pg_tree_mark(ctx, it); }
+    return it;
+}
+
+pg_item *pg_tree_get(pg_tree const *ctx, void const *text)
+{
+    if (ctx->slot)
+    {
+        a_size ltext;
+        a_u32 const hash = pg_tree_hash(text, &ltext);
+        return pg_tree_find(ctx, text, ltext, hash)->item;
+    }
     for (a_avl_node *cur = ctx->root.node; cur;)
     {
         pg_item *const it = pg_tree_entry(cur);
-        int const res = a_str_cmps(it->text, text);
+        int const res = strcmp((char const *)text, it->text);
         if (res < 0) { cur = cur->left; }
         else if (res > 0) { cur = cur->right; }
         else { return it; }
     }
-    pg_item *it = pg_item_new();
-    if (!it) { return it; }
-    pg_item_ctor(it);
-    it->time = A_I32_MIN;
-    pg_item_set_text(it, text);
-    pg_tree_insert(ctx, it);
-    return it;
+    return A_NULL;
 }
 
 pg_item *pg_tree_del(pg_tree *ctx, void const *text)
 {
+    if (ctx->slot)
+    {
+        a_size ltext;
+        a_u32 const hash = pg_tree_hash(text, &ltext);
+        pg_slot *const slot = pg_tree_find(ctx, text, ltext, hash);
+        pg_item *const it = slot->item;
+        if (!it) { return it; }
+        pg_tree_unset(ctx, slot);
+        if (ctx->when) { pg_tree_unmark(ctx, it); }
+        a_avl_remove(&ctx->root, &it->node);
+        PG_STATS_ADD(PG_STATS_REMOVE, 1);
+        --ctx->count;
+        return it;
+    }
     for (a_avl_node *cur = ctx->root.node; cur;)
     {
         pg_item *const it = pg_tree_entry(cur);
-        int const res = a_str_cmps(it->text, text);
+        int const res = strcmp((char const *)text, it->text);
         if (res < 0) { cur = cur->left; }
         else if (res > 0) { cur = cur->right; }
         else
@@ -71,3 +354,361 @@ pg_item *pg_tree_del(pg_tree *ctx, void const *text)
     }
     return A_NULL;
 }
+
+void pg_tree_free(pg_tree *ctx, pg_item *item)
+{
+    item->node.left = (a_avl_node *)ctx->spare;
+    ctx->spare = item;
+}
+
+int pg_tree_set(pg_tree *ctx, pg_item *item, pg_view const *view)
+{
+    item->hash = pg_hash_id(view->hash) & 0xFF;
+    pg_item_set_type(item, view->type);
+    item->hint = A_NULL;
+    if (view->hint && *view->hint)
+    {
+        item->hint = pg_pool_str(&ctx->data, view->hint);
+        if (!item->hint) { return A_OMEMORY; }
+    }
+    item->misc = A_NULL;
+    if (view->misc && *view->misc && item->type == PG_TYPE_OTHER)
+    {
+        item->misc = pg_pool_str(&ctx->data, view->misc);
+        if (!item->misc) { return A_OMEMORY; }
+    }
+    pg_item_set_size(item, view->size);
+    return A_SUCCESS;
+}
+
+int pg_tree_pack(pg_tree *ctx)
+{
+    pg_pool data;
+    pg_pool_ctor(&data, ctx->data.mem);
+    pg_tree_foreach(cur, ctx)
+    {
+        pg_item *it = pg_tree_entry(cur);
+        char const *text = pg_pool_strn(&data, it->text, it->ltext);
+        char const *hint = text && it->hint ? pg_pool_str(&data, it->hint) : A_NULL;
+        char const *misc = text && it->misc ? pg_pool_str(&data, it->misc) : A_NULL;
+        if (!text || !hint != !it->hint || !misc != !it->misc)
+        {
+            /* the strings copied so far are in use, so the new pool joins the old one */
+            pg_pool_merge(&ctx->data, &data);
+            return A_OMEMORY;
+        }
+        it->text = text;
+        it->hint = hint;
+        it->misc = misc;
+    }
+    pg_pool_dtor(&ctx->data);
+    ctx->data = data;
+    return A_SUCCESS;
+}
+
+/* links the nodes of a subtree in order through their left pointers */
+static a_avl_node **pg_tree_list(a_avl_node *node, a_avl_node **tail)
+{
+    for (; node; node = node->right)
+    {
+        tail = pg_tree_list(node->left, tail);
+        *tail = node;
+        tail = &node->left;
+    }
+    return tail;
+}
+
+static int pg_tree_height(a_size n)
+{
+    int h = 0;
+    for (; n; n >>= 1) { ++h; }
+    return h;
+}
+
+/* same encoding of parent and balance factor as a_avl_node */
+static void pg_tree_link(a_avl_node *node, a_avl_node *parent, a_size n)
+{
+    a_size const nl = (n - 1) >> 1;
+    int const factor = pg_tree_height(n - 1 - nl) - pg_tree_height(nl);
+#if defined(A_SIZE_POINTER) && (A_SIZE_POINTER + 0 > 3)
+    node->parent_ = (a_uptr)parent | (a_uptr)(factor + 1);
+#else /* !A_SIZE_POINTER */
+    node->parent = parent;
+    node->factor = factor;
+#endif /* A_SIZE_POINTER */
+}
+
+/* moves the slots and strings of src into ctx, src is left empty */
+static void pg_tree_take(pg_tree *ctx, pg_tree *src)
+{
+    while (src->spare)
+    {
+        pg_item *it = src->spare;
+        src->spare = (pg_item *)it->node.left;
+        pg_tree_free(ctx, it);
+    }
+    pg_pool_merge(&ctx->node, &src->node);
+    pg_pool_merge(&ctx->data, &src->data);
+    a_avl_root(&src->root);
+    a_die(src->slot);
+    src->slot = A_NULL;
+    src->mask = 0;
+    if (src->when) { pg_tree_when_off(src); }
+    src->count = 0;
+}
+
+/* builds a balanced subtree from the next n nodes of the list */
+static a_avl_node *pg_tree_build(a_avl_node **list, a_size n, a_avl_node *parent)
+{
+    a_size const nl = (n - 1) >> 1;
+    a_size const nr = n - 1 - nl;
+    a_avl_node *left = nl ? pg_tree_build(list, nl, A_NULL) : A_NULL;
+    a_avl_node *node = *list;
+    *list = node->left;
+    node->left = left;
+    if (left) { pg_tree_link(left, node, nl); }
+    node->right = nr ? pg_tree_build(list, nr, node) : A_NULL;
+    pg_tree_link(node, parent, n);
+    return node;
+}
+
+void pg_tree_merge(pg_tree *ctx, pg_tree *src)
+{
+    a_avl_node *lhs = A_NULL, *rhs = A_NULL;
+    a_avl_node *list = A_NULL, **tail = &list;
+    a_size count = 0;
+    PG_STATS_BEGIN(t);
+
+    *pg_tree_list(ctx->root.node, &lhs) = A_NULL;
+    *pg_tree_list(src->root.node, &rhs) = A_NULL;
+    while (lhs || rhs)
+    {
+        a_avl_node *node;
+        int res = !lhs ? 1 : !rhs ? -1 : strcmp(pg_tree_entry(lhs)->text, pg_tree_entry(rhs)->text);
+        if (res < 0)
+        {
+            node = lhs;
+            lhs = lhs->left;
+        }
+        else if (res > 0)
+        {
+            node = rhs;
+            rhs = rhs->left;
+        }
+        else
+        {
+            pg_item *it = pg_tree_entry(lhs);
+            pg_item *item = pg_tree_entry(rhs);
+            node = lhs;
+            lhs = lhs->left;
+            rhs = rhs->left;
+            if (item->time >= it->time)
+            {
+                it->hint = item->hint;
+                it->misc = item->misc;
+                it->type = item->type;
+                it->hash = item->hash;
+                it->size = item->size;
+                it->time = item->time;
+            }
+            pg_tree_free(ctx, item);
+        }
+        *tail = node;
+        tail = &node->left;
+        ++count;
+    }
+    *tail = A_NULL;
+
+    pg_tree_take(ctx, src);
+    ctx->root.node = count ? pg_tree_build(&list, count, A_NULL) : A_NULL;
+    ctx->count = count;
+    /* records of src and freed duplicates make a fresh index cheaper */
+    a_die(ctx->slot);
+    ctx->slot = A_NULL;
+    if (count) { pg_tree_index(ctx, count); }
+    if (ctx->when)
+    {
+        /* times were copied from src, the index is built again */
+        pg_tree_when_off(ctx);
+        pg_tree_when(ctx);
+    }
+    PG_STATS_END(PG_STATS_TREE, t);
+}
+
+typedef struct pg_tree_run
+{
+    a_avl_node *node; /* head of the list */
+    a_size src; /* position of its tree, ctx first */
+} pg_tree_run;
+
+/* equal texts come out in the order of their trees */
+static int pg_tree_less(pg_tree_run const *lhs, pg_tree_run const *rhs)
+{
+    int const res = strcmp(pg_tree_entry(lhs->node)->text, pg_tree_entry(rhs->node)->text);
+    return res < 0 || (res == 0 && lhs->src < rhs->src);
+}
+
+/* sifts the list at i down a min-heap of lists ordered by their heads */
+static void pg_tree_sift(pg_tree_run *heap, a_size n, a_size i)
+{
+    pg_tree_run const run = heap[i];
+    for (a_size c; (c = 2 * i + 1) < n; i = c)
+    {
+        if (c + 1 < n && pg_tree_less(heap + c + 1, heap + c)) { ++c; }
+        if (!pg_tree_less(heap + c, &run)) { break; }
+        heap[i] = heap[c];
+    }
+    heap[i] = run;
+}
+
+int pg_tree_merge_n(pg_tree *ctx, pg_tree *src, a_size num)
+{
+    a_avl_node *list = A_NULL, **tail = &list;
+    a_size count = 0, n = 0;
+    pg_item *last = A_NULL;
+    pg_tree_run *heap = (pg_tree_run *)a_alloc(A_NULL, sizeof(pg_tree_run) * (num + 1));
+    if (!heap) { return A_OMEMORY; }
+    PG_STATS_BEGIN(t);
+
+    for (a_size i = 0; i <= num; ++i)
+    {
+        pg_tree *tree = i ? src + i - 1 : ctx;
+        *pg_tree_list(tree->root.node, &heap[n].node) = A_NULL;
+        heap[n].src = i;
+        if (heap[n].node) { ++n; }
+    }
+    for (a_size i = n >> 1; i--;) { pg_tree_sift(heap, n, i); }
+    while (n)
+    {
+        a_avl_node *node = heap[0].node;
+        pg_item *item = pg_tree_entry(node);
+        heap[0].node = node->left;
+        if (!heap[0].node) { heap[0] = heap[--n]; }
+        if (n) { pg_tree_sift(heap, n, 0); }
+        if (last && strcmp(last->text, item->text) == 0)
+        {
+            /* like pg_tree_merge, a later tree wins a tie */
+            if (item->time >= last->time)
+            {
+                last->hint = item->hint;
+                last->misc = item->misc;
+                last->type = item->type;
+                last->hash = item->hash;
+                last->size = item->size;
+                last->time = item->time;
+            }
+            pg_tree_free(ctx, item);
+            continue;
+        }
+        *tail = node;
+        tail = &node->left;
+        last = item;
+        ++count;
+    }
+    *tail = A_NULL;
+    a_die(heap);
+
+    for (a_size i = 0; i != num; ++i) { pg_tree_take(ctx, src + i); }
+    ctx->root.node = count ? pg_tree_build(&list, count, A_NULL) : A_NULL;
+    ctx->count = count;
+    /* records of src and freed duplicates make a fresh index cheaper */
+    a_die(ctx->slot);
+    ctx->slot = A_NULL;
+    if (count) { pg_tree_index(ctx, count); }
+    if (ctx->when)
+    {
+        /* times were copied from src, the index is built again */
+        pg_tree_when_off(ctx);
+        pg_tree_when(ctx);
+    }
+    PG_STATS_END(PG_STATS_TREE, t);
+    return A_SUCCESS;
+}
+
+/* mirrors the private a_avl_factor of liba, which a/avl.h does not export */
+static A_INLINE int pg_tree_factor(a_avl_node const *node)
+{
+#if defined(A_SIZE_POINTER) && (A_SIZE_POINTER + 0 > 3)
+    return (int)(node->parent_ & 3) - 1;
+#else /* !A_SIZE_POINTER */
+    return node->factor;
+#endif /* A_SIZE_POINTER */
+}
+
+/* height of a subtree, one path down the taller side of every node */
+static unsigned int pg_tree_tall(a_avl_node const *node)
+{
+    unsigned int h = 0;
+    for (; node; ++h) { node = pg_tree_factor(node) < 0 ? node->left : node->right; }
+    return h;
+}
+
+typedef struct pg_tree_cut
+{
+    pg_span *span; /*!< null while the weights are only added up */
+    a_size num; /*!< ranges started */
+    a_size max;
+    a_u64 sum; /*!< weight of the pieces so far */
+    a_u64 step; /*!< weight of a range */
+} pg_tree_cut;
+
+/* a piece starts a range once the ranges before it have their weight */
+static void pg_tree_piece(pg_tree_cut *cut, a_avl_node *head, a_u64 weight)
+{
+    if (cut->span && (cut->num == 0 || (cut->num != cut->max && cut->sum >= cut->step * cut->num)))
+    {
+        if (cut->num) { cut->span[cut->num - 1].tail = head; }
+        cut->span[cut->num].head = head;
+        cut->span[cut->num].count = 0;
+        ++cut->num;
+    }
+    if (cut->span) { cut->span[cut->num - 1].count += weight; }
+    cut->sum += weight;
+}
+
+/* visits the subtrees at a depth and the nodes above them, in order */
+static void pg_tree_cut_(pg_tree_cut *cut, a_avl_node *node, unsigned int depth)
+{
+    if (!node) { return; }
+    if (depth == 0)
+    {
+        a_avl_node *head = node;
+        while (head->left) { head = head->left; }
+        /* weighed as a full subtree of its height, which an AVL subtree may fill only in part */
+        pg_tree_piece(cut, head, ((a_u64)1 << pg_tree_tall(node)) - 1);
+        return;
+    }
+    pg_tree_cut_(cut, node->left, depth - 1);
+    pg_tree_piece(cut, node, 1);
+    pg_tree_cut_(cut, node->right, depth - 1);
+}
+
+a_size pg_tree_split(pg_tree const *ctx, pg_span *span, a_size num)
+{
+    if (num == 0 || !ctx->root.node) { return 0; }
+    /* four pieces or more for every range even out the estimates */
+    unsigned int depth = 2;
+    for (a_size n = 1; n < num; n <<= 1) { ++depth; }
+    pg_tree_cut cut;
+    cut.span = A_NULL;
+    cut.num = 0;
+    cut.max = num;
+    cut.sum = 0;
+    cut.step = 0;
+    pg_tree_cut_(&cut, ctx->root.node, depth);
+    cut.step = (cut.sum + num - 1) / num;
+    cut.span = span;
+    cut.sum = 0;
+    pg_tree_cut_(&cut, ctx->root.node, depth);
+    span[cut.num - 1].tail = A_NULL;
+    /* the weights become shares of the real count */
+    a_size left = ctx->count;
+    for (a_size i = 0; i != cut.num; ++i)
+    {
+        a_size n = (a_size)((double)span[i].count * (double)ctx->count / (double)cut.sum);
+        if (n > left || i + 1 == cut.num) { n = left; }
+        span[i].count = n;
+        left -= n;
+    }
+    return cut.num;
+}
@@ -0,0 +1,207 @@
+#if !defined _GNU_SOURCE && defined(__linux__)
+#define _GNU_SOURCE /* NOLINT */
+#endif /* _GNU_SOURCE */
+#include "list.h"
+#include <wchar.h>
+
+static a_size list_rows(list const *ctx)
+{
+    int const rows = getmaxy(ctx->win);
+    return rows > 0 ? (a_size)rows : 0;
+}
+
+void list_init(list *ctx, WINDOW *win, pg_tree const *tree)
+{
+    ctx->win = win;
+    ctx->tree = tree;
+    ctx->hits = A_NULL;
+    ctx->top = a_avl_head(&tree->root);
+    ctx->first = 0;
+    ctx->focus = 0;
+    ctx->drawn_first = 0;
+    ctx->drawn_focus = 0;
+    ctx->full = 1;
+    /* wscrl moves the rows that stay, with the scrolling of the terminal if it has one */
+    idlok(win, TRUE);
+    keypad(win, TRUE);
+}
+
+a_size list_count(list const *ctx)
+{
+    return ctx->hits ? a_vec_num(ctx->hits) : ctx->tree->count;
+}
+
+void list_show(list *ctx, a_vec const *hits)
+{
+    ctx->hits = hits;
+    ctx->top = a_avl_head(&ctx->tree->root);
+    ctx->first = 0;
+    ctx->focus = 0;
+    ctx->full = 1;
+}
+
+/* walks to a row from the head, the tail or top, whichever is nearest */
+static void list_seek(list *ctx, a_size first)
+{
+    a_size const count = ctx->tree->count;
+    if (ctx->hits)
+    {
+        ctx->first = first;
+        return;
+    }
+    a_size const away = first > ctx->first ? first - ctx->first : ctx->first - first;
+    if (first < away)
+    {
+        ctx->top = a_avl_head(&ctx->tree->root);
+        ctx->first = 0;
+    }
+    else if (count - 1 - first < away)
+    {
+        ctx->top = a_avl_tail(&ctx->tree->root);
+        ctx->first = count - 1;
+    }
+    for (; ctx->first < first; ++ctx->first) { ctx->top = a_avl_next(ctx->top); }
+    for (; ctx->first > first; --ctx->first) { ctx->top = a_avl_prev(ctx->top); }
+}
+
+/* scrolls as little as it takes to show the focus, without blank rows at the end */
+static void list_fit(list *ctx)
+{
+    a_size const count = list_count(ctx);
+    a_size const rows = list_rows(ctx);
+    if (count == 0 || rows == 0) { return; }
+    a_size first = ctx->first;
+    if (ctx->focus < first) { first = ctx->focus; }
+    else if (ctx->focus - first >= rows) { first = ctx->focus - rows + 1; }
+    if (count <= rows) { first = 0; }
+    else if (first > count - rows) { first = count - rows; }
+    list_seek(ctx, first);
+}
+
+void list_move(list *ctx, long delta)
+{
+    a_size const count = list_count(ctx);
+    if (count == 0) { return; }
+    if (delta < 0)
+    {
+        a_size const n = (a_size)-delta;
+        ctx->focus = ctx->focus > n ? ctx->focus - n : 0;
+    }
+    else
+    {
+        a_size const n = (a_size)delta;
+        ctx->focus = count - 1 - ctx->focus > n ? ctx->focus + n : count - 1;
+    }
+    list_fit(ctx);
+}
+
+void list_home(list *ctx)
+{
+    ctx->focus = 0;
+    list_fit(ctx);
+}
+
+void list_end(list *ctx)
+{
+    a_size const count = list_count(ctx);
+    ctx->focus = count ? count - 1 : 0;
+    list_fit(ctx);
+}
+
+void list_resize(list *ctx)
+{
+    ctx->full = 1;
+    list_fit(ctx);
+}
+
+/* adds the text up to a width in columns, control characters become ? */
+static int list_text(WINDOW *win, char const *text, int width)
+{
+    mbstate_t state;
+    a_zero(&state, sizeof(state));
+    while (*text && width > 0)
+    {
+        wchar_t wc = 0;
+        size_t n = mbrtowc(&wc, text, MB_CUR_MAX, &state);
+        int w = 1;
+        if (n == (size_t)-1 || n == (size_t)-2)
+        {
+            a_zero(&state, sizeof(state));
+            n = 0;
+        }
+#if !defined(_WIN32)
+        else if (wc >= 0x20) { w = wcwidth(wc); }
+#endif /* _WIN32 */
+        if (wc < 0x20 || w < 0)
+        {
+            n = 0;
+            w = 1;
+        }
+        if (w > width) { break; }
+        if (n) { waddnstr(win, text, (int)n); }
+        else { waddch(win, '?'); }
+        text += n ? n : 1;
+        width -= w;
+    }
+    return width;
+}
+
+static void list_row(list *ctx, int row, pg_item const *item, a_size index, int focus)
+{
+    WINDOW *win = ctx->win;
+    int const cols = getmaxx(win);
+    wmove(win, row, 0);
+    if (!item)
+    {
+        wclrtoeol(win);
+        return;
+    }
+    pg_view view;
+    pg_item_view(item, &view);
+    char head[1 << 6];
+    int n = snprintf(head, sizeof(head), "%05zu %u %3u %-7s ", index, view.type, view.size, view.hash);
+    if (n > cols) { n = cols; }
+    if (focus) { wattron(win, A_REVERSE); }
+    waddnstr(win, head, n);
+    /* the selection spans the row, so the rest is filled with spaces */
+    for (int left = list_text(win, view.text, cols - n); left > 0; --left) { waddch(win, ' '); }
+    wattroff(win, A_REVERSE);
+}
+
+void list_draw(list *ctx)
+{
+    a_size const rows = list_rows(ctx);
+    if (!ctx->full && ctx->drawn_first != ctx->first)
+    {
+        a_size const shift = ctx->first > ctx->drawn_first ? ctx->first - ctx->drawn_first : ctx->drawn_first - ctx->first;
+        if (shift < rows)
+        {
+            scrollok(ctx->win, TRUE);
+            wscrl(ctx->win, ctx->first > ctx->drawn_first ? (int)shift : -(int)shift);
+            scrollok(ctx->win, FALSE);
+        }
+        else { ctx->full = 1; }
+    }
+    a_avl_node *cur = ctx->hits ? A_NULL : ctx->top;
+    a_size const count = list_count(ctx);
+    for (a_size row = 0; row != rows; ++row)
+    {
+        a_size const index = ctx->first + row;
+        /* rows that scrolled in, and the old and new selection */
+        if (ctx->full || index == ctx->focus || index == ctx->drawn_focus ||
+            index < ctx->drawn_first || index - ctx->drawn_first >= rows)
+        {
+            if (ctx->hits && index < count)
+            {
+                pg_fuzzy_hit const *hit = A_VEC_AT_(pg_fuzzy_hit, ctx->hits, index);
+                list_row(ctx, (int)row, hit->item, hit->index, index == ctx->focus);
+            }
+            else { list_row(ctx, (int)row, cur ? pg_tree_entry(cur) : A_NULL, index, index == ctx->focus); }
+        }
+        if (cur) { cur = a_avl_next(cur); }
+    }
+    ctx->drawn_first = ctx->first;
+    ctx->drawn_focus = ctx->focus;
+    ctx->full = 0;
+    wnoutrefresh(ctx->win);
+}
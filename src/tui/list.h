@@ -0,0 +1,78 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include "pg/fuzzy.h"
+#include <ncursesw/ncurses.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief list view over the records of a tree, or over hits of a search
+ @details the view keeps the node of its first row, so scrolling walks only
+ as far as it moves and a frame visits only the rows on the screen. Hits are
+ in a vector, so their rows are found by position. Rows are
+ painted again only when they changed since the last frame, the terminal is
+ then updated with wnoutrefresh and doupdate.
+*/
+typedef struct list
+{
+    WINDOW *win;
+    pg_tree const *tree;
+    a_vec const *hits; /*!< vector of \ref pg_fuzzy_hit shown in place of the tree, or null */
+    a_avl_node *top; /*!< record on the first row */
+    a_size first; /*!< position of top in the tree */
+    a_size focus; /*!< position of the selected record */
+    a_size drawn_first; /*!< first as the window shows it */
+    a_size drawn_focus; /*!< focus as the window shows it */
+    int full; /*!< every row is painted on the next frame */
+} list;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+void list_init(list *ctx, WINDOW *win, pg_tree const *tree);
+
+/*!
+ @brief move the selection, scrolling when it leaves the window
+ @param[in,out] ctx points to a list view
+ @param[in] delta rows to move, negative to move up
+*/
+void list_move(list *ctx, long delta);
+
+/*!
+ @brief show hits in place of the tree, from the first row
+ @param[in,out] ctx points to a list view
+ @param[in] hits vector of \ref pg_fuzzy_hit that outlives the view, null for the tree
+*/
+void list_show(list *ctx, a_vec const *hits);
+
+/*!
+ @brief number of rows in the view
+*/
+a_size list_count(list const *ctx);
+void list_home(list *ctx);
+void list_end(list *ctx);
+
+/*!
+ @brief fit the view to the size of its window after a resize
+*/
+void list_resize(list *ctx);
+
+/*!
+ @brief paint the rows that changed and mark the window for doupdate
+*/
+void list_draw(list *ctx);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* LIST_H */
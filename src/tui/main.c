@@ -1,8 +1,14 @@
 #include "pg/pg.h"
 #include "pg/json.h"
+#include "pg/pgb.h"
+#include "pg/pgj.h"
+#include "pg/shard.h"
 #include "pg/sqlite.h"
+#include "search.h"
+#include "list.h"
 #include <getopt.h>
-#include <ncursesw/ncurses.h>
+#include <locale.h>
+#include <errno.h>
 
 #if defined(_WIN32)
 #if defined(_MSC_VER)
@@ -42,90 +48,218 @@ static struct
 {
     char *self;
     char *file;
+    pg_tree tree;
+    search find; /*!< search for the text of query */
+    a_str query; /*!< text of the filter */
+    a_vec hits; /*!< hits of the filter that the list shows */
     a_str rule;
     a_str code;
+    a_size fuzzy; /*!< typos for --fuzzy */
+    int edit; /*!< keys go to the filter */
+    int live; /*!< the search thread runs */
 } local = {
     .self = 0,
     .file = 0,
 };
 
-static int io_getline(char const *fname, char **pdata, size_t *nbyte)
-{
-    long seek = 0;
-    FILE *handle = fopen(fname, "r");
-    if (handle == 0) { return ~0; }
-    *nbyte = 0;
-    for (int c = fgetc(handle); c > ~0; c = fgetc(handle))
-    {
-        if (c == '\n' || c == '\r')
-        {
-            if (*nbyte) { break; }
-            else { ++seek; }
-            continue;
-        }
-        ++*nbyte;
-    }
-    *pdata = malloc(*nbyte);
-    fseek(handle, seek, SEEK_SET);
-    *nbyte = fread(*pdata, 1, *nbyte, handle);
-    return fclose(handle);
-}
-
 static void main_exit(void)
 {
+    if (!isendwin()) { endwin(); }
+    if (local.live) { search_exit(&local.find); }
+    local.live = 0;
+    a_vec_dtor(&local.hits, 0);
+    a_str_dtor(&local.query);
+    pg_tree_dtor(&local.tree);
     a_str_dtor(&local.rule);
     a_str_dtor(&local.code);
     free(local.self);
     free(local.file);
-    endwin();
 }
 
 static void main_init(void)
 {
     atexit(main_exit);
+    pg_tree_ctor(&local.tree);
+    a_str_ctor(&local.query);
+    a_str_cats(&local.query, "");
+    a_vec_ctor(&local.hits, sizeof(pg_fuzzy_hit));
     a_str_ctor(&local.rule);
     a_str_ctor(&local.code);
     local.self = path_self();
 
     char *env = getenv("PG_FILE");
-    if (env) { local.file = strdup(env); }
+    if (env && !local.file) { local.file = strdup(env); }
 
     env = getenv("PG_RULE");
-    if (env)
+    if (env && pg_io_getline(env, &local.rule))
     {
-        char *p = 0;
-        a_size n = 0;
-        if (io_getline(env, &p, &n) > ~0)
-        {
-            a_str_catn(&local.rule, p, n);
-        }
-        else
-        {
-            a_str_cats(&local.rule, env);
-        }
-        free(p);
+        a_str_cats(&local.rule, env);
     }
 
     env = getenv("PG_CODE");
-    if (env)
+    if (env && pg_io_getline(env, &local.code))
+    {
+        a_str_cats(&local.code, env);
+    }
+}
+
+/* reads the vault like pg does, with the changes in its journal */
+static int main_load(char const *fname, pg_tree *tree)
+{
+    int ok = A_SUCCESS;
+    size_t n = strlen(fname);
+    pg_shard shard;
+    int const sharded = pg_shard_open(&shard, fname, 0);
+    if (sharded == A_SUCCESS)
+    {
+        ok = pg_shard_out(&shard, tree);
+        pg_shard_close(&shard);
+    }
+    else if (sharded != A_FAILURE) { ok = sharded; }
+    else if (pg_io_size(fname) < 0) {}
+    else if (n > 4 && strcmp(fname + n - 4, ".pgb") == 0)
     {
-        char *p = 0;
-        a_size n = 0;
-        if (io_getline(env, &p, &n) > ~0)
+        pg_pgb pgb;
+        ok = pg_pgb_open(&pgb, fname);
+        if (ok == A_SUCCESS)
         {
-            a_str_catn(&local.code, p, n);
+            ok = pg_pgb_out(&pgb, tree);
+            pg_pgb_close(&pgb);
         }
-        else
+    }
+    else
+    {
+        sqlite3 *db = 0;
+        ok = sqlite3_open_v2(fname, &db, SQLITE_OPEN_READONLY, 0);
+        if (ok == SQLITE_OK) { ok = pg_sqlite_out(db, tree); }
+        sqlite3_close(db);
+    }
+    if (ok == A_SUCCESS)
+    {
+        a_str jname = A_STR_INIT;
+        a_str_cats(&jname, fname);
+        a_str_cats(&jname, ".pgj");
+        ok = pg_pgj_replay(a_str_ptr(&jname), tree, A_NULL, ~(a_u64)0, A_NULL);
+        a_str_dtor(&jname);
+    }
+    return ok;
+}
+
+static void main_status(WINDOW *win, list const *view)
+{
+    werase(win);
+    if (local.edit || a_str_len(&local.query))
+    {
+        mvwaddch(win, 0, 0, '/');
+        waddnstr(win, a_str_ptr(&local.query), getmaxx(win) - 1);
+    }
+    else { mvwaddnstr(win, 0, 0, local.file, getmaxx(win)); }
+    char buf[1 << 6];
+    a_size const count = list_count(view);
+    int n = snprintf(buf, sizeof(buf), " %s%zu/%zu", local.live && search_busy(&local.find) ? "~ " : "",
+                     count ? view->focus + 1 : 0, count);
+    if (n < getmaxx(win)) { mvwaddstr(win, 0, getmaxx(win) - n, buf); }
+    wnoutrefresh(win);
+}
+
+/* posts the first n bytes of the query, an empty one shows every record at once */
+static void main_query(list *view, a_size n)
+{
+    a_str_setn_(&local.query, n);
+    a_str_ptr(&local.query)[n] = 0;
+    if (local.live) { search_set(&local.find, a_str_ptr(&local.query)); }
+    if (a_str_len(&local.query) == 0) { list_show(view, A_NULL); }
+}
+
+/* applies one key to the text of the filter, returns 0 for keys it does not take */
+static int main_edit(list *view, int c)
+{
+    switch (c)
+    {
+    case KEY_BACKSPACE:
+    case 127:
+    case 8:
+    {
+        /* drops a whole character of UTF-8 */
+        a_size n = a_str_len(&local.query);
+        while (n && (a_str_ptr(&local.query)[n - 1] & 0xC0) == 0x80) { --n; }
+        if (n) { --n; }
+        main_query(view, n);
+        return 1;
+    }
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+        local.edit = 0;
+        return 1;
+    case 27:
+        local.edit = 0;
+        main_query(view, 0);
+        return 1;
+    default:
+        if (c >= 0x20 && c <= 0xFF && c != 0x7F)
         {
-            a_str_cats(&local.code, env);
+            a_str_catc(&local.query, c);
+            main_query(view, a_str_len(&local.query));
+            return 1;
         }
-        free(p);
+        return 0;
     }
+}
 
-    initscr();
-    cbreak();
-    noecho();
-    noraw();
+/* applies one key, returns 0 to quit */
+static int main_key(list *view, int c)
+{
+    long const page = getmaxy(view->win) > 1 ? getmaxy(view->win) - 1 : 1;
+    if (local.edit && main_edit(view, c)) { return 1; }
+    switch (c)
+    {
+    case KEY_UP:
+    case 'k':
+        list_move(view, -1);
+        break;
+    case KEY_DOWN:
+    case 'j':
+        list_move(view, 1);
+        break;
+    case KEY_PPAGE:
+        list_move(view, -page);
+        break;
+    case KEY_NPAGE:
+    case ' ':
+        list_move(view, page);
+        break;
+    case KEY_HOME:
+    case 'g':
+        list_home(view);
+        break;
+    case KEY_END:
+    case 'G':
+        list_end(view);
+        break;
+    case '/':
+        local.edit = local.live;
+        break;
+    case 27:
+        if (a_str_len(&local.query) == 0) { return 0; }
+        main_query(view, 0);
+        break;
+    case 'q':
+        return 0;
+    default:
+        break;
+    }
+    return 1;
+}
+
+/* a whole decimal number from lo to hi, or -1 */
+static long main_num(char const *s, long lo, long hi)
+{
+    char *p = 0;
+    errno = 0;
+    long const x = strtol(s, &p, 10);
+    if (p == s || *p || errno || x < lo || x > hi) { return -1; }
+    return x;
 }
 
 static int main_help(void)
@@ -137,10 +271,12 @@ static int main_help(void)
 
 int main(int argc, char *argv[])
 {
-    char const *shortopts = "vh";
+    char const *shortopts = "vhf:";
     static struct option const longopts[] = {
         {"version", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
+        {"filename", required_argument, 0, 'f'},
+        {"fuzzy", optional_argument, 0, 'F'},
         {0, 0, 0, 0},
     };
 
@@ -155,6 +291,21 @@ int main(int argc, char *argv[])
             printf("liba %s\n", A_VERSION);
             printf("pg 0.1.0\n");
             exit(EXIT_SUCCESS);
+        case 'f':
+            free(local.file);
+            local.file = strdup(optarg);
+            break;
+        case 'F':
+        {
+            long const num = optarg ? main_num(optarg, 0, LONG_MAX) : 2;
+            if (num < 0)
+            {
+                fprintf(stderr, "%s: invalid number of typos\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            local.fuzzy = (a_size)num;
+            break;
+        }
         case 'h':
         default:
             exit(main_help());
@@ -181,6 +332,17 @@ int main(int argc, char *argv[])
         local.file = a_str_exit(&str);
     }
 
+    if (main_load(local.file, &local.tree) != A_SUCCESS)
+    {
+        fprintf(stderr, "%s: invalid vault\n", local.file);
+        return EXIT_FAILURE;
+    }
+
+    setlocale(LC_ALL, "");
+    initscr();
+    cbreak();
+    noecho();
+    curs_set(0);
     if (has_colors())
     {
         start_color();
@@ -188,22 +350,38 @@ int main(int argc, char *argv[])
         init_pair(2, COLOR_BLUE, COLOR_WHITE);
     }
 
-    WINDOW *win = newwin(LINES, COLS, 0, 0);
-    box(win, ACS_VLINE, ACS_HLINE);
-    wmove(win, 0, (COLS >> 1) - 9);
-    wprintw(win, "password generator");
-    scrollok(win, TRUE);
-    keypad(win, TRUE);
-
-    for (int x = 1; x < LINES - 1; x += 1)
+    list view;
+    WINDOW *bar = newwin(1, COLS, LINES - 1, 0);
+    list_init(&view, newwin(LINES - 1, COLS, 0, 0), &local.tree);
+    wbkgdset(bar, COLOR_PAIR(2) | A_REVERSE);
+    /* without the thread there is no search, the list still works */
+    local.live = search_init(&local.find, &local.tree, local.fuzzy) == A_SUCCESS;
+    for (;;)
     {
-        WINDOW *w = subwin(win, 1, COLS - 4, x, 2);
-        wprintw(w, "( ) %i", x);
+        if (local.live && search_take(&local.find, &local.hits)) { list_show(&view, &local.hits); }
+        list_draw(&view);
+        main_status(bar, &view);
+        doupdate();
+        /* keys that queued up while drawing are applied before the next frame,
+           and while a search runs its hits are polled for about every frame */
+        wtimeout(view.win, local.live && search_busy(&local.find) ? 16 : -1);
+        int c = wgetch(view.win);
+        wtimeout(view.win, 0);
+        for (; c != ERR; c = wgetch(view.win))
+        {
+            if (c == KEY_RESIZE)
+            {
+                wresize(view.win, LINES > 1 ? LINES - 1 : 1, COLS);
+                wresize(bar, 1, COLS);
+                mvwin(bar, LINES > 1 ? LINES - 1 : 0, 0);
+                list_resize(&view);
+            }
+            else if (!main_key(&view, c)) { goto exit; }
+        }
     }
 
-    wrefresh(win);
-    wgetch(win);
-    delwin(win);
-
+exit:
+    delwin(view.win);
+    delwin(bar);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,154 @@
+#include "search.h"
+
+/* the thread reads ctx->run alone, the lock guards it against a newer query */
+static int search_stop(void *arg)
+{
+    search *ctx = (search *)arg;
+    pg_mutex_lock(&ctx->lock);
+    int stop = ctx->quit || ctx->gen != ctx->run;
+    pg_mutex_unlock(&ctx->lock);
+    return stop;
+}
+
+static int search_find(search *ctx, a_str const *text, a_vec *next)
+{
+    /* a longer query only drops hits, so the previous ones are enough */
+    a_vec const *in = A_NULL;
+    a_size const n = a_str_len(&ctx->have);
+    if (n && a_str_len(text) >= n && memcmp(a_str_ptr(text), a_str_ptr(&ctx->have), n) == 0)
+    {
+        in = &ctx->last;
+    }
+    a_vec_setn(next, 0, 0);
+    if (a_str_len(text) == 0) { return A_SUCCESS; }
+    return pg_fuzzy_find(&ctx->index, a_str_ptr(text), ctx->k, in, next, search_stop, ctx);
+}
+
+static void *search_main(void *arg)
+{
+    search *ctx = (search *)arg;
+    a_str text = A_STR_INIT;
+    a_vec next;
+    a_vec_ctor(&next, sizeof(pg_fuzzy_hit));
+    int ok = pg_fuzzy_init(&ctx->index, ctx->tree);
+    pg_mutex_lock(&ctx->lock);
+    if (ok != A_SUCCESS) { ctx->quit = 1; }
+    while (ok == A_SUCCESS)
+    {
+        while (!ctx->quit && ctx->run == ctx->gen) { pg_cond_wait(&ctx->cond, &ctx->lock); }
+        if (ctx->quit) { break; }
+        ctx->run = ctx->gen;
+        a_str_setn_(&text, 0);
+        a_str_cat(&text, &ctx->want);
+        pg_mutex_unlock(&ctx->lock);
+
+        int found = search_find(ctx, &text, &next);
+        if (found == A_SUCCESS)
+        {
+            a_vec_swap(&ctx->last, &next);
+            a_str_setn_(&ctx->have, 0);
+            a_str_cat(&ctx->have, &text);
+            /* the copy is made outside the lock, then swapped in */
+            found = a_vec_setn(&next, a_vec_num(&ctx->last), 0);
+            if (found == A_SUCCESS)
+            {
+                a_copy(a_vec_ptr(&next), a_vec_ptr(&ctx->last), sizeof(pg_fuzzy_hit) * a_vec_num(&ctx->last));
+            }
+        }
+        /* a cancelled search keeps the hits of an older prefix, which still hold */
+        else if (found != A_FAILURE) { a_str_setn_(&ctx->have, 0); }
+
+        pg_mutex_lock(&ctx->lock);
+        if (found == A_SUCCESS && ctx->gen == ctx->run && a_str_len(&text))
+        {
+            a_vec_swap(&ctx->done, &next);
+            ctx->ready = ctx->run;
+        }
+    }
+    pg_mutex_unlock(&ctx->lock);
+    a_vec_dtor(&next, 0);
+    a_str_dtor(&text);
+    return A_NULL;
+}
+
+int search_init(search *ctx, pg_tree const *tree, a_size k)
+{
+    ctx->tree = tree;
+    ctx->k = k;
+    ctx->gen = 0;
+    ctx->run = 0;
+    ctx->ready = 0;
+    ctx->taken = 0;
+    ctx->quit = 0;
+    ctx->index.item = A_NULL;
+    ctx->index.head = A_NULL;
+    ctx->index.list = A_NULL;
+    ctx->index.count = 0;
+    a_str_ctor(&ctx->want);
+    a_str_ctor(&ctx->have);
+    a_vec_ctor(&ctx->last, sizeof(pg_fuzzy_hit));
+    a_vec_ctor(&ctx->done, sizeof(pg_fuzzy_hit));
+    pg_mutex_ctor(&ctx->lock);
+    pg_cond_ctor(&ctx->cond);
+    int ok = pg_thread_ctor(&ctx->thread, search_main, ctx);
+    if (ok != A_SUCCESS)
+    {
+        ctx->thread.func = A_NULL;
+        search_exit(ctx);
+    }
+    return ok;
+}
+
+void search_exit(search *ctx)
+{
+    if (ctx->thread.func)
+    {
+        pg_mutex_lock(&ctx->lock);
+        ctx->quit = 1;
+        pg_cond_signal(&ctx->cond);
+        pg_mutex_unlock(&ctx->lock);
+        pg_thread_join(&ctx->thread);
+        ctx->thread.func = A_NULL;
+    }
+    pg_cond_dtor(&ctx->cond);
+    pg_mutex_dtor(&ctx->lock);
+    pg_fuzzy_exit(&ctx->index);
+    a_vec_dtor(&ctx->done, 0);
+    a_vec_dtor(&ctx->last, 0);
+    a_str_dtor(&ctx->have);
+    a_str_dtor(&ctx->want);
+}
+
+void search_set(search *ctx, char const *text)
+{
+    pg_mutex_lock(&ctx->lock);
+    a_str_setn_(&ctx->want, 0);
+    a_str_cats(&ctx->want, text);
+    ++ctx->gen;
+    /* nothing to wait for, every record is shown */
+    if (*text == 0) { ctx->taken = ctx->gen; }
+    pg_cond_signal(&ctx->cond);
+    pg_mutex_unlock(&ctx->lock);
+}
+
+int search_take(search *ctx, a_vec *hits)
+{
+    int took = 0;
+    pg_mutex_lock(&ctx->lock);
+    if (ctx->ready == ctx->gen && ctx->taken != ctx->gen)
+    {
+        a_vec_swap(hits, &ctx->done);
+        ctx->taken = ctx->gen;
+        took = 1;
+    }
+    pg_mutex_unlock(&ctx->lock);
+    return took;
+}
+
+int search_busy(search *ctx)
+{
+    pg_mutex_lock(&ctx->lock);
+    int busy = !ctx->quit && ctx->taken != ctx->gen;
+    pg_mutex_unlock(&ctx->lock);
+    return busy;
+}
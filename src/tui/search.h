@@ -0,0 +1,82 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "pg/fuzzy.h"
+#include "pg/thread.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+#endif /* __GNUC__ || __clang__ */
+
+/*!
+ @brief search as you type, on a thread of its own
+ @details every query gets a number, and the search gives up as soon as a
+ newer one arrives, so only the hits of the last query are ever taken. When
+ a query is the previous one with more bytes, only the previous hits are
+ checked again, since they hold every hit of the longer query. Any other
+ query, such as after a backspace, starts over from the index of bigrams.
+*/
+typedef struct search
+{
+    pg_thread thread;
+    pg_mutex lock;
+    pg_cond cond;
+    pg_fuzzy index; /*!< built by the thread before its first search */
+    pg_tree const *tree;
+    a_str want; /*!< latest query */
+    a_str have; /*!< query of last */
+    a_vec last; /*!< hits of the last search that finished, owned by the thread */
+    a_vec done; /*!< copy of last that waits to be taken */
+    a_size k; /*!< largest distance of a hit */
+    a_size gen; /*!< number of want */
+    a_size run; /*!< number of the query being searched */
+    a_size ready; /*!< number of the query in done */
+    a_size taken; /*!< number of the query taken last */
+    int quit; /*!< set to stop the thread, or by the thread when it has no index */
+} search;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif /* __GNUC__ || __clang__ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ @brief start the thread of a search
+ @param[out] ctx points to a search
+ @param[in] tree records to search, they must not change until search_exit
+ @param[in] k largest number of typos in a hit, 0 for plain substrings
+ @return error code value
+  @retval 0 success
+*/
+int search_init(search *ctx, pg_tree const *tree, a_size k);
+void search_exit(search *ctx);
+
+/*!
+ @brief post a query, which cancels the one that runs
+ @param[in,out] ctx points to a search
+ @param[in] text query, an empty one is left to the caller to show every record
+*/
+void search_set(search *ctx, char const *text);
+
+/*!
+ @brief take the hits of the latest query once they are ready
+ @param[in,out] ctx points to a search
+ @param[in,out] hits vector of \ref pg_fuzzy_hit that the hits are swapped into
+ @return 1 if hits changed, 0 otherwise
+*/
+int search_take(search *ctx, a_vec *hits);
+
+/*!
+ @brief whether the latest query has hits that were not taken yet
+*/
+int search_busy(search *ctx);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* SEARCH_H */